@@ -4,13 +4,23 @@
 
 #pragma once
 
+#include "Instrumentation.h"
 #include "Morton.h"
+#include "Parallel.h"
 #include "propagate_const.h"
 
 #include <Logging.h>
 
+#include <atomic>
 #include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <execution>
+#include <limits>
 #include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 struct unitialized_t
 {
@@ -18,20 +28,86 @@ struct unitialized_t
 
 constexpr unitialized_t unitialized;
 
+// The lowest level of the library's own log messages that is compiled in: 0 debug, 1 info, 2 warning, 3 error, 4 none.
+// Messages below it cost nothing, not even the evaluation of their arguments. Debug messages sit on the allocation
+// paths, so they are out by default.
+#if !defined(IMAGE_LIBRARY_LOG_LEVEL)
+    #define IMAGE_LIBRARY_LOG_LEVEL 1
+#endif
+
+inline constexpr bool k_log_debug = IMAGE_LIBRARY_LOG_LEVEL <= 0;
+
+// Array2DSFC storage allocations and deallocations, for turning into metrics.
+//     set_allocation_hook([](const ArrayAllocationEvent& e) noexcept { ... });
+// The hook is called on the allocating thread, so it has to be thread-safe. Without one, each allocation costs a
+// relaxed atomic load.
+struct ArrayAllocationEvent
+{
+    enum class Kind
+    {
+        allocate,
+        deallocate
+    };
+
+    Kind          kind;
+    const void*   data;
+    std::size_t   bytes;
+    std::uint64_t width;
+    std::uint64_t height;
+};
+
+using ArrayAllocationHook = void (*)(const ArrayAllocationEvent&) noexcept;
+
+namespace array_detail {
+inline constinit std::atomic<ArrayAllocationHook> allocation_hook{ nullptr };
+} // namespace array_detail
+
+// Installs the hook (nullptr removes it), and returns the previous one.
+inline ArrayAllocationHook set_allocation_hook(ArrayAllocationHook hook) noexcept
+{
+    return array_detail::allocation_hook.exchange(hook, std::memory_order_acq_rel);
+}
+
+// Layout tags. Two containers with the same layout type and the same dimensions store the element for (x, y) at the
+// same storage index, which lets bulk operations walk them in storage order instead of through operator().
+struct row_major_layout
+{
+};
+
+template <std::uint32_t log_tile_size>
+struct morton_tiled_layout
+{
+};
+
 // This array uses a space-filling curve to access elements, allowing greater cache coherency. It does it's own memory
 // management, because it allocates more space than it has elements. If it wrapped a std::vector, for instance, we would
 // have to put further constraints on the contained type: e.g., it will have to be default constructable (because there
 // will be unused gaps in the vector, but the items would still have to be constructed).
-template <typename T, std::uint32_t log_tile_size = 4, typename allocator_t = std::allocator<T>>
+//
+// Construction, copying, and clear() take an optional execution policy. With a parallel policy, runs of contiguous
+// tiles are handed to the shared thread pool, so the pages are first touched, and on NUMA hosts placed, by the threads
+// of the pool rather than all by one; NumaAllocator gives a fixed assignment of tiles to nodes. Trivially copyable
+// elements with the default allocator are copied a whole tile at a time with memcpy.
+//
+// index_t is the type of dimensions and storage indices. 32 bits are the fast path, and limit the storage, padding
+// included, to 2^32 elements; Array2DSFC64 indexes with 64 bits, for larger images. Constructing an array that its
+// index_t cannot address throws std::length_error.
+template <typename T,
+          std::uint32_t log_tile_size = 4,
+          typename allocator_t        = std::allocator<T>,
+          typename index_t            = std::uint32_t>
 class Array2DSFC
 {
+    static_assert(std::is_unsigned_v<index_t> && sizeof(index_t) >= sizeof(std::uint32_t),
+                  "Indices are unsigned, and at least 32 bits");
+
     static constexpr int k_tile_width  = 1 << log_tile_size;
     static constexpr int k_tile_height = 1 << log_tile_size;
 
     using allocator_traits = std::allocator_traits<allocator_t>;
 
 public:
-    using size_type       = std::uint32_t;
+    using size_type       = index_t;
     using difference_type = std::ptrdiff_t;
     using allocator_type  = allocator_t;
     using value_type      = T;
@@ -39,6 +115,11 @@ public:
     using const_reference = const value_type&;
     using pointer         = typename allocator_traits::pointer;
     using const_pointer   = typename allocator_traits::const_pointer;
+    using layout_type     = morton_tiled_layout<log_tile_size>;
+
+    static constexpr size_type tile_width  = k_tile_width;
+    static constexpr size_type tile_height = k_tile_height;
+    static constexpr size_type tile_area   = k_tile_width * k_tile_height;
 
     Array2DSFC() noexcept(noexcept(Impl()))
     : m_impl()
@@ -55,6 +136,24 @@ public:
     {
     }
 
+    template <typename ExecutionPolicy>
+    requires is_execution_policy_v<ExecutionPolicy>
+    Array2DSFC(ExecutionPolicy&& policy, size_type width, size_type height, allocator_type allocator = allocator_type{})
+    : m_impl(policy, width, height, allocator)
+    {
+    }
+
+    template <typename ExecutionPolicy>
+    requires is_execution_policy_v<ExecutionPolicy>
+    Array2DSFC(ExecutionPolicy&& policy,
+               size_type         width,
+               size_type         height,
+               const T&          val,
+               allocator_type    allocator = allocator_type{})
+    : m_impl(policy, width, height, val, allocator)
+    {
+    }
+
 #if 0
     Array2DSFC(size_type width, size_type height, unitialized_t, allocator_type allocator = allocator_type{})
     : m_impl(width, height, allocator)
@@ -69,6 +168,13 @@ public:
     {
     }
 
+    template <typename ExecutionPolicy>
+    requires is_execution_policy_v<ExecutionPolicy>
+    Array2DSFC(ExecutionPolicy&& policy, const Array2DSFC& other)
+    : m_impl(policy, other.m_impl)
+    {
+    }
+
     Array2DSFC(Array2DSFC&& other) noexcept
     : m_impl(std::move(other.m_impl))
     {
@@ -90,7 +196,23 @@ public:
         return *this;
     }
 
-    void swap(Array2DSFC& other) noexcept(noexcept(std::declval<Array2DSFC>().swap(other)))
+    // Copy assignment with the copy split as the policy says.
+    template <typename ExecutionPolicy>
+    requires is_execution_policy_v<ExecutionPolicy>
+    void assign(ExecutionPolicy&& policy, const Array2DSFC& other)
+    {
+        m_impl.assign(policy, other.m_impl);
+    }
+
+    // Destroys the elements as the policy says and releases the storage, leaving an empty array.
+    template <typename ExecutionPolicy>
+    requires is_execution_policy_v<ExecutionPolicy>
+    void clear(ExecutionPolicy&& policy) noexcept
+    {
+        m_impl.release(policy);
+    }
+
+    void swap(Array2DSFC& other) noexcept(noexcept(std::declval<Impl&>().swap(other.m_impl)))
     {
         m_impl.swap(other.m_impl);
     }
@@ -122,6 +244,45 @@ public:
         return m_impl.m_data[idx];
     }
 
+    size_type num_tiles_width() const noexcept
+    {
+        return Impl::num_tiles_width(m_impl.m_width);
+    }
+
+    size_type num_tiles_height() const noexcept
+    {
+        return Impl::num_tiles_height(m_impl.m_height);
+    }
+
+    // The number of element slots in storage, including the padding at the right and bottom edge tiles.
+    size_type storage_size() const noexcept
+    {
+        return Impl::memory_size(m_impl.m_width, m_impl.m_height);
+    }
+
+    size_type storage_index(size_type x, size_type y) const noexcept
+    {
+        return m_impl.get_data_index(x, y);
+    }
+
+    // Tiles are stored contiguously in row-major tile order, each tile holding tile_area slots in Morton order.
+    size_type tile_storage_index(size_type tile_x, size_type tile_y) const noexcept
+    {
+        return (tile_y * num_tiles_width() + tile_x) * tile_area;
+    }
+
+    // Raw storage. Padding slots in edge tiles are never constructed, so only the slots reachable through
+    // storage_index() may be read or written.
+    pointer data() noexcept
+    {
+        return m_impl.m_data.get();
+    }
+
+    const_pointer data() const noexcept
+    {
+        return m_impl.m_data.get();
+    }
+
 private:
     // TODO: replace with [[no_unique_address]] (or [[msvc::no_unique_address]])
     struct Impl : public allocator_type
@@ -134,55 +295,51 @@ private:
         {
         }
 
-        Impl(size_type width, size_type height) noexcept(noexcept(allocator_type{}))
-        : allocator_type()
-        , m_width(width)
-        , m_height(height)
-        , m_data(allocator_traits::allocate(m_impl.get_allocator(), memory_size(width, height)))
+        Impl(size_type width, size_type height, allocator_type allocator)
+        : Impl(std::execution::seq, width, height, allocator)
         {
-            logging::log_debug("Allocated storage for {} objects", memory_size(width, height));
-            logging::log_debug("Tiles width: {}", num_tiles_width(width));
-            logging::log_debug("Tiles height: {}", num_tiles_height(height));
-            construct();
         }
 
-        Impl(size_type width, size_type height, allocator_type allocator)
+        Impl(size_type width, size_type height, const T& val, allocator_type allocator)
+        : Impl(std::execution::seq, width, height, val, allocator)
+        {
+        }
+
+        template <typename ExecutionPolicy>
+        Impl(ExecutionPolicy&& policy, size_type width, size_type height, allocator_type allocator)
         : allocator_type(allocator)
         , m_width(width)
         , m_height(height)
-        , m_data(allocator_traits::allocate(this->get_allocator(), memory_size(width, height)))
+        , m_data(allocate_storage(width, height))
         {
-            logging::log_debug("Allocated storage for {} objects", memory_size(width, height));
-            logging::log_debug("Tiles width: {}", num_tiles_width(width));
-            logging::log_debug("Tiles height: {}", num_tiles_height(height));
-            construct();
+            log_allocation();
+            construct(policy);
         }
 
-        Impl(size_type width, size_type height, const T& val, allocator_type allocator)
+        template <typename ExecutionPolicy>
+        Impl(ExecutionPolicy&& policy, size_type width, size_type height, const T& val, allocator_type allocator)
         : allocator_type(allocator)
         , m_width(width)
         , m_height(height)
-        , m_data(allocator_traits::allocate(this->get_allocator(), memory_size(width, height)))
+        , m_data(allocate_storage(width, height))
         {
-            logging::log_debug("Allocated storage for {} objects", memory_size(width, height));
-            logging::log_debug("Tiles width: {}", num_tiles_width(width));
-            logging::log_debug("Tiles height: {}", num_tiles_height(height));
-            construct(val);
+            log_allocation();
+            construct(policy, val);
         }
 
         Impl(const Impl& other)
+        : Impl(std::execution::seq, other)
+        {
+        }
+
+        template <typename ExecutionPolicy>
+        Impl(ExecutionPolicy&& policy, const Impl& other)
         : allocator_type(allocator_traits::select_on_container_copy_construction(other))
         , m_width(other.m_width)
         , m_height(other.m_height)
-        , m_data(allocator_traits::allocate(this->get_allocator(), memory_size(m_width, m_height)))
+        , m_data(allocate_storage(m_width, m_height))
         {
-            for (size_type y = 0; y < m_height; ++y) {
-                for (size_type x = 0; x < m_width; ++x) {
-                    const auto idx = get_data_index(x, y);
-                    T* const   p   = m_data + idx;
-                    allocator_traits::construct(this->get_allocator(), p, other.m_data[idx]);
-                }
-            }
+            copy_construct(policy, other);
         }
 
         Impl(Impl&& other) noexcept
@@ -198,17 +355,39 @@ private:
 
         ~Impl()
         {
-            destroy();
-            allocator_traits::deallocate(this->get_allocator(), m_data, memory_size(m_width, m_height));
+            release(std::execution::seq);
+        }
+
+        template <typename ExecutionPolicy>
+        void release(ExecutionPolicy&& policy) noexcept
+        {
+            if (m_data) {
+                destroy(policy);
+                deallocate_storage();
+            }
+            m_width  = 0;
+            m_height = 0;
+            m_data   = nullptr;
         }
 
         static bool allocators_equal(const allocator_type& a, const allocator_type& b) noexcept
         {
-            return allocator_traits::is_always_equal || a == b;
+            return allocator_traits::is_always_equal::value || a == b;
         }
 
         Impl& operator=(const Impl& other)
         {
+            assign(std::execution::seq, other);
+            return *this;
+        }
+
+        template <typename ExecutionPolicy>
+        void assign(ExecutionPolicy&& policy, const Impl& other)
+        {
+            if (this == &other) {
+                return;
+            }
+
             // If we have to propagate allocators, and the allocators are not equal, we have to deallocate and
             // re-allocate. If we don't have to propagate, we have to reallocate if the size has changed.
 
@@ -219,18 +398,18 @@ private:
             // !propagate |
             // -----------+--------------+--------------+
 
-            constexpr bool propagate = allocator_traits::propagate_on_container_copy_assignment;
+            constexpr bool propagate = allocator_traits::propagate_on_container_copy_assignment::value;
             const bool     realloc   = (propagate && !allocators_equal(*this, other)) ||
                                  (m_width != other.m_width || m_height != other.m_height);
 
-            destroy();
+            destroy(policy);
 
             if (realloc) {
-                allocator_traits::deallocate(this->get_allocator(), m_data, memory_size(m_width, m_height));
+                deallocate_storage();
             }
 
             if (propagate) {
-                static_cast<allocator_type>(*this) = static_cast<allocator_type>(other);
+                static_cast<allocator_type&>(*this) = static_cast<const allocator_type&>(other);
             }
 
             // These may already be equal
@@ -238,30 +417,23 @@ private:
             m_height = other.m_height;
 
             if (realloc) {
-                m_data = allocator_traits::allocate(m_impl.get_allocator(), memory_size(m_width, m_height));
+                m_data = allocate_storage(m_width, m_height);
             }
 
-            for (size_type y = 0; y < m_height; ++y) {
-                for (size_type x = 0; x < m_width; ++x) {
-                    const auto idx = get_data_index(x, y);
-                    T* const   p   = m_data + idx;
-                    allocator_traits::construct(this->get_allocator(), p, other.m_data[idx]);
-                }
-            }
-            return *this;
+            copy_construct(policy, other);
         }
 
         Impl& operator=(Impl&& other) // TODO: noexcept clause
         {
-            if constexpr (allocator_traits::propagate_on_container_move_assignment) {
-                destroy();
-                allocator_traits::deallocate(this->get_allocator(), m_data, memory_size(m_width, m_height));
+            if constexpr (allocator_traits::propagate_on_container_move_assignment::value) {
+                destroy(std::execution::seq);
+                deallocate_storage();
 
-                static_cast<allocator_type>(*this) = std::move(static_cast<allocator_type>(other));
+                static_cast<allocator_type&>(*this) = std::move(static_cast<allocator_type&>(other));
 
                 m_width  = other.m_width;
                 m_height = other.m_height;
-                m_data   = other.m_data;
+                m_data   = std::move(other.m_data);
 
                 other.m_width  = 0;
                 other.m_height = 0;
@@ -273,12 +445,12 @@ private:
                     swap(m_height, other.m_height);
                     swap(m_data, other.m_data);
                 } else {
-                    destroy();
-                    allocator_traits::deallocate(this->get_allocator(), m_data, memory_size(m_width, m_height));
+                    destroy(std::execution::seq);
+                    deallocate_storage();
 
                     m_width  = other.m_width;
                     m_height = other.m_height;
-                    m_data   = allocator_traits::allocate(m_impl.get_allocator(), memory_size(m_width, m_height));
+                    m_data   = allocate_storage(m_width, m_height);
 
                     for (size_type y = 0; y < m_height; ++y) {
                         for (size_type x = 0; x < m_width; ++x) {
@@ -315,24 +487,28 @@ private:
             // No-op
         }
 
-        void swap(Impl& other) noexcept(!allocator_traits::propagate_on_container_swap) // TODO: or the swap is noexcept
+        // TODO: or the swap is noexcept
+        void swap(Impl& other) noexcept(!allocator_traits::propagate_on_container_swap::value)
         {
             std::swap(m_width, other.m_width);
             std::swap(m_height, other.m_height);
-            swap_allocator(other, allocator_traits::propagate_on_container_swap);
+            std::swap(m_data, other.m_data);
+            swap_allocator(other, typename allocator_traits::propagate_on_container_swap{});
         }
 
+        // The tile size is a power of two known at compile time: the tile is found with shifts, the position in it
+        // with masks and a table lookup (see morton_tile_index), and the two combine with a shift and an or.
         size_type get_data_index(size_type x, size_type y) const noexcept
         {
-            const size_type     tile_x   = x / k_tile_width;
-            const size_type     tile_y   = y / k_tile_height;
-            const std::uint16_t offset_x = x % k_tile_height;
-            const std::uint16_t offset_y = y % k_tile_height;
+            constexpr size_type k_mask = k_tile_width - 1;
 
-            const size_type index_in_tile = morton_encode(offset_x, offset_y);
+            const size_type tile_x        = x >> log_tile_size;
+            const size_type tile_y        = y >> log_tile_size;
+            const size_type index_in_tile = morton_tile_index<log_tile_size>(static_cast<std::uint32_t>(x & k_mask),
+                                                                             static_cast<std::uint32_t>(y & k_mask));
             assert(index_in_tile < k_tile_width * k_tile_height);
             const size_type tile_index = tile_y * num_tiles_width(m_width) + tile_x;
-            const size_type idx        = tile_index * (k_tile_width * k_tile_height) + index_in_tile;
+            const size_type idx        = (tile_index << (2 * log_tile_size)) | index_in_tile;
             assert(idx < memory_size(m_width, m_height));
             return idx;
         }
@@ -352,33 +528,154 @@ private:
             return (height + k_tile_height - 1) / k_tile_height;
         }
 
-        void construct(const T& val)
+        // Elements that need none of the allocator's or the type's construction and destruction logic: whole tiles,
+        // padding included, can be filled, copied, and dropped as bytes.
+        static constexpr bool k_trivial =
+            std::is_trivially_copyable_v<T> && std::is_same_v<allocator_t, std::allocator<T>>;
+
+        // Calls f(tile_index) for every tile, split as the policy says.
+        template <typename ExecutionPolicy, typename Function>
+        void for_each_tile(ExecutionPolicy&& policy, Function f) const
+        {
+            const size_type tiles = num_tiles_width(m_width) * num_tiles_height(m_height);
+            for_each_index(policy, size_type{ 0 }, tiles, f);
+        }
+
+        // Calls f(idx) for the storage index of every element in the tile, skipping the padding of edge tiles.
+        template <typename Function>
+        void for_each_in_tile(size_type tile_index, Function f) const
         {
-            for (size_type y = 0; y < m_height; ++y) {
-                for (size_type x = 0; x < m_width; ++x) {
-                    T* const p = m_data + get_data_index(x, y);
-                    allocator_traits::construct(this->get_allocator(), p, val);
+            const size_type x0 = (tile_index % num_tiles_width(m_width)) * k_tile_width;
+            const size_type y0 = (tile_index / num_tiles_width(m_width)) * k_tile_height;
+            const size_type nx = std::min<size_type>(k_tile_width, m_width - x0);
+            const size_type ny = std::min<size_type>(k_tile_height, m_height - y0);
+            for (size_type y = 0; y < ny; ++y) {
+                for (size_type x = 0; x < nx; ++x) {
+                    f(tile_index * (k_tile_width * k_tile_height) + morton_tile_index<log_tile_size>(x, y));
                 }
             }
         }
 
-        void construct()
+        // Throws if the storage, padding included, has more elements than size_type can index.
+        static void check_size(size_type width, size_type height)
         {
-            for (size_type y = 0; y < m_height; ++y) {
-                for (size_type x = 0; x < m_width; ++x) {
-                    T* const p = m_data + get_data_index(x, y);
-                    allocator_traits::construct(this->get_allocator(), p);
+            if constexpr (sizeof(size_type) < sizeof(std::uint64_t)) {
+                const std::uint64_t tiles_x = (std::uint64_t{ width } + k_tile_width - 1) >> log_tile_size;
+                const std::uint64_t tiles_y = (std::uint64_t{ height } + k_tile_height - 1) >> log_tile_size;
+                if (tiles_x * tiles_y > std::numeric_limits<size_type>::max() >> (2 * log_tile_size)) {
+                    throw std::length_error("Array2DSFC dimensions exceed its index type");
                 }
             }
         }
 
-        void destroy() noexcept
+        T* allocate_storage(size_type width, size_type height)
+        {
+            check_size(width, height);
+            const size_type count = memory_size(width, height);
+            IMAGE_LIBRARY_COUNT(allocations, 1);
+            IMAGE_LIBRARY_COUNT(bytes_allocated, std::uint64_t{ count } * sizeof(T));
+            T* const data = allocator_traits::allocate(this->get_allocator(), count);
+            notify(ArrayAllocationEvent::Kind::allocate, data, count, width, height);
+            return data;
+        }
+
+        // Frees the storage for the current dimensions. The elements have to be destroyed already.
+        void deallocate_storage() noexcept
+        {
+            if (!m_data) {
+                return;
+            }
+            const size_type count = memory_size(m_width, m_height);
+            notify(ArrayAllocationEvent::Kind::deallocate, m_data.get(), count, m_width, m_height);
+            allocator_traits::deallocate(this->get_allocator(), m_data, count);
+        }
+
+        static void notify(ArrayAllocationEvent::Kind kind,
+                           const T*                   data,
+                           size_type                  count,
+                           size_type                  width,
+                           size_type                  height) noexcept
         {
-            for (size_type y = 0; y < m_height; ++y) {
-                for (size_type x = 0; x < m_width; ++x) {
-                    T* const p = m_data + get_data_index(x, y);
-                    allocator_traits::destroy(this->get_allocator(), p);
+            if (const ArrayAllocationHook hook = array_detail::allocation_hook.load(std::memory_order_relaxed)) {
+                hook(ArrayAllocationEvent{ kind, data, std::size_t{ count } * sizeof(T), width, height });
+            }
+        }
+
+        void log_allocation() const
+        {
+            if constexpr (k_log_debug) {
+                logging::log_debug("Allocated storage for {} objects, {} x {} tiles",
+                                   memory_size(m_width, m_height),
+                                   num_tiles_width(m_width),
+                                   num_tiles_height(m_height));
+            }
+        }
+
+        template <typename ExecutionPolicy>
+        void construct(ExecutionPolicy&& policy, const T& val)
+        {
+            IMAGE_LIBRARY_TIMED_SCOPE("Array2DSFC::construct");
+            for_each_tile(policy, [&](size_type tile_index) {
+                if constexpr (k_trivial) {
+                    std::uninitialized_fill_n(m_data.get() + tile_index * (k_tile_width * k_tile_height),
+                                              k_tile_width * k_tile_height,
+                                              val);
+                } else {
+                    for_each_in_tile(tile_index, [&](size_type idx) {
+                        allocator_traits::construct(this->get_allocator(), m_data + idx, val);
+                    });
+                }
+            });
+        }
+
+        template <typename ExecutionPolicy>
+        void construct(ExecutionPolicy&& policy)
+        {
+            IMAGE_LIBRARY_TIMED_SCOPE("Array2DSFC::construct");
+            for_each_tile(policy, [&](size_type tile_index) {
+                if constexpr (k_trivial && std::is_trivially_default_constructible_v<T>) {
+                    // Value-initialization of a trivial type is zero-initialization.
+                    std::memset(static_cast<void*>(m_data.get() + tile_index * (k_tile_width * k_tile_height)),
+                                0,
+                                sizeof(T) * k_tile_width * k_tile_height);
+                } else {
+                    for_each_in_tile(tile_index, [&](size_type idx) {
+                        allocator_traits::construct(this->get_allocator(), m_data + idx);
+                    });
+                }
+            });
+        }
+
+        // Constructs our elements from other's, which has the same dimensions.
+        template <typename ExecutionPolicy>
+        void copy_construct(ExecutionPolicy&& policy, const Impl& other)
+        {
+            assert(m_width == other.m_width && m_height == other.m_height);
+            IMAGE_LIBRARY_TIMED_SCOPE("Array2DSFC::copy_construct");
+            for_each_tile(policy, [&](size_type tile_index) {
+                if constexpr (k_trivial) {
+                    const size_type offset = tile_index * (k_tile_width * k_tile_height);
+                    std::memcpy(static_cast<void*>(m_data.get() + offset),
+                                static_cast<const void*>(other.m_data.get() + offset),
+                                sizeof(T) * k_tile_width * k_tile_height);
+                } else {
+                    for_each_in_tile(tile_index, [&](size_type idx) {
+                        allocator_traits::construct(this->get_allocator(), m_data + idx, other.m_data[idx]);
+                    });
                 }
+            });
+        }
+
+        template <typename ExecutionPolicy>
+        void destroy(ExecutionPolicy&& policy) noexcept
+        {
+            if constexpr (!std::is_trivially_destructible_v<T> || !std::is_same_v<allocator_t, std::allocator<T>>) {
+                IMAGE_LIBRARY_TIMED_SCOPE("Array2DSFC::destroy");
+                for_each_tile(policy, [&](size_type tile_index) {
+                    for_each_in_tile(tile_index, [&](size_type idx) {
+                        allocator_traits::destroy(this->get_allocator(), m_data + idx);
+                    });
+                });
             }
         }
 
@@ -391,15 +688,19 @@ private:
     Impl m_impl;
 };
 
-template <typename T, typename allocator_t = std::allocator<T>>
+// Row-major. index_t is as for Array2DSFC: Array2D64 holds more than 2^32 elements.
+template <typename T, typename allocator_t = std::allocator<T>, typename index_t = std::uint32_t>
 class Array2D
 {
+    static_assert(std::is_unsigned_v<index_t> && sizeof(index_t) >= sizeof(std::uint32_t),
+                  "Indices are unsigned, and at least 32 bits");
+
     using MemoryContainer = std::vector<T, allocator_t>;
 
     using allocator_traits = std::allocator_traits<allocator_t>;
 
 public:
-    using size_type       = std::uint32_t;
+    using size_type       = index_t;
     using difference_type = std::ptrdiff_t;
     using allocator_type  = allocator_t;
     using value_type      = T;
@@ -407,18 +708,19 @@ public:
     using const_reference = const value_type&;
     using pointer         = typename allocator_traits::pointer;
     using const_pointer   = typename allocator_traits::const_pointer;
+    using layout_type     = row_major_layout;
 
     Array2D() = default;
 
     Array2D(size_type width, size_type height, allocator_type allocator = allocator_type{})
     : m_width(width)
-    , m_data(width * height, allocator)
+    , m_data(element_count(width, height), allocator)
     {
     }
 
     Array2D(size_type width, size_type height, const T& val, allocator_type allocator = allocator_type{})
     : m_width(width)
-    , m_data(width * height, val, allocator)
+    , m_data(element_count(width, height), val, allocator)
     {
     }
 
@@ -482,6 +784,15 @@ public:
     }
 
 private:
+    static std::size_t element_count(size_type width, size_type height)
+    {
+        const std::uint64_t count = std::uint64_t{ width } * height;
+        if (count > std::numeric_limits<size_type>::max()) {
+            throw std::length_error("Array2D dimensions exceed its index type");
+        }
+        return static_cast<std::size_t>(count);
+    }
+
     size_type get_data_index(size_type x, size_type y) const noexcept
     {
         return m_width * y + x;
@@ -490,3 +801,9 @@ private:
     size_type       m_width;
     MemoryContainer m_data;
 };
+
+template <typename T, std::uint32_t log_tile_size = 4, typename allocator_t = std::allocator<T>>
+using Array2DSFC64 = Array2DSFC<T, log_tile_size, allocator_t, std::uint64_t>;
+
+template <typename T, typename allocator_t = std::allocator<T>>
+using Array2D64 = Array2D<T, allocator_t, std::uint64_t>;
@@ -0,0 +1,386 @@
+#pragma once
+
+#include "Image.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+#include <span>
+#include <spanstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(IMAGE_LIBRARY_IO_URING)
+    #include <fcntl.h>
+    #include <liburing.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Loads batches of PPM and PFM files in the background. Reading the files and decoding them overlap: the I/O side
+// reads whole files into memory, and the files are decoded on the library's shared pool (TaskScheduler::global()).
+//     AsyncImageLoader<Image_RGBf> loader({ .max_in_flight = 32 });
+//     auto images = loader.load(paths);
+//     for (auto& f : images) {
+//         process(f.get());
+//     }
+//
+// When built with IMAGE_LIBRARY_IO_URING (Linux, liburing), a single thread keeps up to max_in_flight reads queued in
+// the kernel. Otherwise, or if the kernel refuses to set up a ring, io_threads threads do blocking reads.
+//
+// The files that have been read by the time a decode pass starts are decoded together, in one parallel_for.
+//
+// max_in_flight bounds the number of files that have been read but not yet decoded, and so the memory used for file
+// contents. Floating-point images are read from PFM files; integer images from binary PPM files of either depth.
+
+struct AsyncLoaderOptions
+{
+    std::size_t max_in_flight{ 16 };
+    unsigned    io_threads{ 4 };
+};
+
+namespace async_detail {
+// An unbounded multi-producer, multi-consumer queue. pop() returns an empty optional once the queue is closed and
+// drained.
+template <typename T>
+class WorkQueue
+{
+public:
+    void push(T value)
+    {
+        {
+            std::scoped_lock lock(m_mutex);
+            m_items.push_back(std::move(value));
+        }
+        m_ready.notify_one();
+    }
+
+    std::optional<T> pop()
+    {
+        std::unique_lock lock(m_mutex);
+        m_ready.wait(lock, [this] { return !m_items.empty() || m_closed; });
+        return take();
+    }
+
+    std::optional<T> try_pop()
+    {
+        std::scoped_lock lock(m_mutex);
+        return take();
+    }
+
+    void close()
+    {
+        {
+            std::scoped_lock lock(m_mutex);
+            m_closed = true;
+        }
+        m_ready.notify_all();
+    }
+
+private:
+    std::optional<T> take()
+    {
+        if (m_items.empty()) {
+            return std::nullopt;
+        }
+        std::optional<T> value = std::move(m_items.front());
+        m_items.pop_front();
+        return value;
+    }
+
+    std::mutex              m_mutex;
+    std::condition_variable m_ready;
+    std::deque<T>           m_items;
+    bool                    m_closed{ false };
+};
+
+inline std::vector<char> read_file(const std::filesystem::path& file)
+{
+    std::ifstream ins(file, std::ios_base::binary | std::ios_base::in);
+    if (!ins) {
+        throw ImageError("Unable to open " + file.string());
+    }
+    std::vector<char> contents(std::filesystem::file_size(file));
+    ins.read(contents.data(), static_cast<std::streamsize>(contents.size()));
+    if (!ins) {
+        throw ImageError("Unable to read " + file.string());
+    }
+    return contents;
+}
+
+template <typename ImageType>
+ImageType decode_image(std::vector<char>& contents)
+{
+    std::ispanstream ins(std::span<char>(contents.data(), contents.size()));
+    if constexpr (is_floating_point_image_v<ImageType>) {
+        return read_pfm<ImageType>(ins);
+    } else {
+        const auto header = read_pnm_header(ins);
+        if (header.max_color > std::numeric_limits<std::uint8_t>::max()) {
+            return read_ppm_16<ImageType>(ins);
+        } else {
+            return read_ppm_8<ImageType>(ins);
+        }
+    }
+}
+} // namespace async_detail
+
+template <typename ImageType>
+class AsyncImageLoader
+{
+public:
+    explicit AsyncImageLoader(const AsyncLoaderOptions& options = {})
+    : m_budget(static_cast<std::ptrdiff_t>(std::clamp<std::size_t>(options.max_in_flight, 1, k_max_in_flight)))
+    {
+        m_decoder = std::thread([this] { decode_loop(); });
+
+#if defined(IMAGE_LIBRARY_IO_URING)
+        const auto entries = static_cast<unsigned>(std::clamp<std::size_t>(options.max_in_flight, 1, 4096));
+        if (io_uring_queue_init(entries, &m_ring, 0) == 0) {
+            m_ring_entries = entries;
+            m_io_threads.emplace_back([this] { uring_loop(); });
+            return;
+        }
+#endif
+        const unsigned io_threads = std::max(options.io_threads, 1u);
+        for (unsigned i = 0; i < io_threads; ++i) {
+            m_io_threads.emplace_back([this] { blocking_io_loop(); });
+        }
+    }
+
+    AsyncImageLoader(const AsyncImageLoader&)            = delete;
+    AsyncImageLoader& operator=(const AsyncImageLoader&) = delete;
+
+    // Finishes all of the loads that have been requested.
+    ~AsyncImageLoader()
+    {
+        m_requests.close();
+        for (auto& t : m_io_threads) {
+            t.join();
+        }
+        m_decodes.close();
+        m_decoder.join();
+#if defined(IMAGE_LIBRARY_IO_URING)
+        if (m_ring_entries > 0) {
+            io_uring_queue_exit(&m_ring);
+        }
+#endif
+    }
+
+    // Errors opening, reading, or decoding the file are reported through the future.
+    std::future<ImageType> load(std::filesystem::path file)
+    {
+        Request request{ std::move(file), {} };
+        auto    future = request.promise.get_future();
+        m_requests.push(std::move(request));
+        return future;
+    }
+
+    std::vector<std::future<ImageType>> load(std::span<const std::filesystem::path> files)
+    {
+        std::vector<std::future<ImageType>> futures;
+        futures.reserve(files.size());
+        for (const auto& file : files) {
+            futures.push_back(load(file));
+        }
+        return futures;
+    }
+
+private:
+    static constexpr std::ptrdiff_t k_max_in_flight = 1 << 16;
+
+    struct Request
+    {
+        std::filesystem::path    file;
+        std::promise<ImageType> promise;
+    };
+
+    struct Decode
+    {
+        std::vector<char>       contents;
+        std::promise<ImageType> promise;
+    };
+
+    // Every path through here releases the in-flight slot that the request was read under.
+    void decode_one(Decode& decode) noexcept
+    {
+        try {
+            decode.promise.set_value(async_detail::decode_image<ImageType>(decode.contents));
+        } catch (...) {
+            decode.promise.set_exception(std::current_exception());
+        }
+        decode.contents = {};
+        m_budget.release();
+    }
+
+    // Waits for a read to complete, then decodes it together with every other completed read. This thread works on
+    // the pass too, so decoding goes ahead even when the pool has no workers.
+    void decode_loop()
+    {
+        std::vector<Decode> batch;
+        while (auto first = m_decodes.pop()) {
+            batch.push_back(std::move(*first));
+            while (auto next = m_decodes.try_pop()) {
+                batch.push_back(std::move(*next));
+            }
+            TaskScheduler::global().parallel_for(std::size_t{ 0 },
+                                                 batch.size(),
+                                                 [&](std::size_t i) { decode_one(batch[i]); },
+                                                 ParallelOptions{ .grain = 1 });
+            batch.clear();
+        }
+    }
+
+    void fail(std::promise<ImageType>& promise)
+    {
+        promise.set_exception(std::current_exception());
+        m_budget.release();
+    }
+
+    void blocking_io_loop()
+    {
+        for (;;) {
+            m_budget.acquire();
+            auto request = m_requests.pop();
+            if (!request) {
+                m_budget.release();
+                return;
+            }
+            try {
+                m_decodes.push(Decode{ async_detail::read_file(request->file), std::move(request->promise) });
+            } catch (...) {
+                fail(request->promise);
+            }
+        }
+    }
+
+#if defined(IMAGE_LIBRARY_IO_URING)
+    struct Read
+    {
+        int                     fd{ -1 };
+        std::size_t             done{ 0 };
+        std::filesystem::path   file;
+        std::vector<char>       contents;
+        std::promise<ImageType> promise;
+    };
+
+    // io_uring takes 32-bit read lengths: larger files are read a chunk at a time.
+    static constexpr std::size_t k_read_chunk = std::size_t{ 1 } << 30;
+
+    // Opens the file and queues the first read. Returns false if the request failed before reaching the ring.
+    bool start_read(Request& request)
+    {
+        auto read  = std::make_unique<Read>();
+        read->file = std::move(request.file);
+        try {
+            read->fd = ::open(read->file.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st{};
+            if (read->fd < 0 || ::fstat(read->fd, &st) != 0) {
+                throw ImageError("Unable to open " + read->file.string());
+            }
+            read->contents.resize(static_cast<std::size_t>(st.st_size));
+        } catch (...) {
+            if (read->fd >= 0) {
+                ::close(read->fd);
+            }
+            fail(request.promise);
+            return false;
+        }
+        read->promise = std::move(request.promise);
+        submit(read.release());
+        return true;
+    }
+
+    void submit(Read* read)
+    {
+        io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+        io_uring_prep_read(sqe,
+                           read->fd,
+                           read->contents.data() + read->done,
+                           static_cast<unsigned>(std::min(read->contents.size() - read->done, k_read_chunk)),
+                           read->done);
+        io_uring_sqe_set_data(sqe, read);
+        io_uring_submit(&m_ring);
+        ++m_ring_outstanding;
+    }
+
+    void complete(io_uring_cqe* cqe)
+    {
+        std::unique_ptr<Read> read(static_cast<Read*>(io_uring_cqe_get_data(cqe)));
+        const int             result = cqe->res;
+        io_uring_cqe_seen(&m_ring, cqe);
+        --m_ring_outstanding;
+
+        if (result > 0 && read->done + result < read->contents.size()) {
+            // A short read, or the next chunk: queue the rest.
+            read->done += static_cast<std::size_t>(result);
+            submit(read.release());
+            return;
+        }
+
+        ::close(read->fd);
+        if (result < 0 || (result == 0 && read->done < read->contents.size())) {
+            try {
+                throw ImageError("Unable to read " + read->file.string());
+            } catch (...) {
+                fail(read->promise);
+            }
+            return;
+        }
+        m_decodes.push(Decode{ std::move(read->contents), std::move(read->promise) });
+    }
+
+    // Keeps the ring full while there are requests and in-flight slots, and hands completed reads to the decoders.
+    void uring_loop()
+    {
+        for (;;) {
+            if (m_ring_outstanding == 0) {
+                // Nothing to reap: we can block for a slot and a request.
+                m_budget.acquire();
+                auto request = m_requests.pop();
+                if (!request) {
+                    m_budget.release();
+                    return;
+                }
+                start_read(*request);
+            }
+            while (m_ring_outstanding < m_ring_entries && m_budget.try_acquire()) {
+                auto request = m_requests.try_pop();
+                if (!request) {
+                    m_budget.release();
+                    break;
+                }
+                start_read(*request);
+            }
+            if (m_ring_outstanding > 0) {
+                io_uring_cqe* cqe = nullptr;
+                if (io_uring_wait_cqe(&m_ring, &cqe) == 0) {
+                    complete(cqe);
+                }
+            }
+        }
+    }
+
+    io_uring    m_ring{};
+    unsigned    m_ring_entries{ 0 };
+    unsigned    m_ring_outstanding{ 0 };
+#endif
+
+    std::counting_semaphore<k_max_in_flight> m_budget;
+    async_detail::WorkQueue<Request>         m_requests;
+    async_detail::WorkQueue<Decode>          m_decodes;
+    std::vector<std::thread>                 m_io_threads;
+    std::thread                              m_decoder;
+};
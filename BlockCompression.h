@@ -0,0 +1,732 @@
+#pragma once
+
+#include "Array2D.h"
+#include "Half.h"
+#include "Parallel.h"
+#include "RGB.h"
+#include "RGBA.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <execution>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+// CPU encoders for the GPU block-compressed texture formats:
+//     BC1  - RGB, 4 bits per texel, from RGBA8 images (alpha is dropped: blocks are always opaque).
+//     BC3  - RGBA, 8 bits per texel, from RGBA8 images.
+//     BC6H - unsigned HDR RGB (BC6H_UF16), 8 bits per texel, from RGBf images. Negative values are clamped to zero.
+//
+// BCMode::fast fits the endpoints to the bounding box of each block. BCMode::quality fits them to the principal axis of
+// the block's colors, refines them with a least-squares solve, and keeps whichever candidate has the lower error.
+// BC6H only uses its single-region mode with 10-bit endpoints (mode 11); the two-region modes are not searched.
+//
+// Blocks are emitted in row-major block order, starting with the block containing (0, 0). Note that this is the bottom
+// row of the image in the convention used by our PPM/PFM writers (which matches OpenGL's texture origin). Texels past
+// the right or bottom edge replicate the edge texels.
+//
+// Array2DSFC images (with tiles of at least 4x4) are read directly from storage: each 4x4 block is 16 consecutive
+// slots in Morton order. The per-block kernels are written as fixed-size loops over the 16 texels so that the compiler
+// can vectorize them, and block rows are distributed over threads with std::execution::par.
+
+enum class BCFormat
+{
+    BC1,
+    BC3,
+    BC6H
+};
+
+enum class BCMode
+{
+    fast,
+    quality
+};
+
+struct CompressedImage
+{
+    BCFormat                  format{ BCFormat::BC1 };
+    std::uint32_t             width{ 0 };
+    std::uint32_t             height{ 0 };
+    std::vector<std::uint8_t> data;
+};
+
+constexpr std::uint32_t bc_block_size_bytes(BCFormat format) noexcept
+{
+    return (format == BCFormat::BC1) ? 8u : 16u;
+}
+
+namespace bc_detail {
+constexpr std::uint32_t k_block_dim    = 4;
+constexpr std::uint32_t k_block_texels = k_block_dim * k_block_dim;
+
+using BlockRGBA8 = std::array<RGBA8, k_block_texels>;
+using BlockRGBf  = std::array<RGBf, k_block_texels>;
+
+// Maps the Morton index of a texel in a 4x4 block to its row-major index.
+inline constexpr std::array<std::uint8_t, k_block_texels> k_morton_to_row_major = [] {
+    std::array<std::uint8_t, k_block_texels> t{};
+    for (std::uint32_t m = 0; m < k_block_texels; ++m) {
+        const std::uint32_t x = (m & 1u) | ((m >> 1u) & 2u);
+        const std::uint32_t y = ((m >> 1u) & 1u) | ((m >> 2u) & 2u);
+        t[m]                  = static_cast<std::uint8_t>(y * k_block_dim + x);
+    }
+    return t;
+}();
+
+template <typename T>
+struct is_sfc_image : std::false_type
+{
+};
+
+template <typename T, std::uint32_t log_tile_size, typename allocator_t, typename index_t>
+struct is_sfc_image<Array2DSFC<T, log_tile_size, allocator_t, index_t>> : std::true_type
+{
+};
+
+// Gathers the 4x4 block at block coordinates (bx, by) into row-major order.
+template <typename ImageType, typename Block>
+void load_block(const ImageType& img, std::uint32_t bx, std::uint32_t by, Block& block)
+{
+    const std::uint32_t x0 = bx * k_block_dim;
+    const std::uint32_t y0 = by * k_block_dim;
+
+    const bool interior = x0 + k_block_dim <= img.width() && y0 + k_block_dim <= img.height();
+
+    if constexpr (is_sfc_image<ImageType>::value) {
+        static_assert(ImageType::tile_width >= k_block_dim, "Tiles have to hold whole blocks");
+        if (interior) {
+            const auto* const texels = img.data() + img.storage_index(x0, y0);
+            for (std::uint32_t m = 0; m < k_block_texels; ++m) {
+                block[k_morton_to_row_major[m]] = texels[m];
+            }
+            return;
+        }
+    } else {
+        if (interior) {
+            for (std::uint32_t y = 0; y < k_block_dim; ++y) {
+                for (std::uint32_t x = 0; x < k_block_dim; ++x) {
+                    block[y * k_block_dim + x] = img(x0 + x, y0 + y);
+                }
+            }
+            return;
+        }
+    }
+
+    for (std::uint32_t y = 0; y < k_block_dim; ++y) {
+        for (std::uint32_t x = 0; x < k_block_dim; ++x) {
+            const std::uint32_t sx     = std::min(x0 + x, img.width() - 1);
+            const std::uint32_t sy     = std::min(y0 + y, img.height() - 1);
+            block[y * k_block_dim + x] = img(sx, sy);
+        }
+    }
+}
+
+inline void store_le(std::uint8_t* out, std::uint64_t v, std::uint32_t bytes) noexcept
+{
+    for (std::uint32_t i = 0; i < bytes; ++i) {
+        out[i] = static_cast<std::uint8_t>(v >> (8u * i));
+    }
+}
+
+// Principal axis of a set of points by power iteration on the covariance matrix.
+inline std::array<float, 3> principal_axis(const float (&cov)[6]) noexcept
+{
+    // cov = { xx, xy, xz, yy, yz, zz }
+    std::array<float, 3> v = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        const float x = cov[0] * v[0] + cov[1] * v[1] + cov[2] * v[2];
+        const float y = cov[1] * v[0] + cov[3] * v[1] + cov[4] * v[2];
+        const float z = cov[2] * v[0] + cov[4] * v[1] + cov[5] * v[2];
+        const float m = std::max({ std::abs(x), std::abs(y), std::abs(z) });
+        if (m == 0.0f) {
+            break;
+        }
+        v = { x / m, y / m, z / m };
+    }
+    return v;
+}
+
+// Fits two endpoints to points (three channels, n = 16) along their principal axis.
+inline void fit_principal_axis(const float (&points)[3][k_block_texels], float (&e0)[3], float (&e1)[3]) noexcept
+{
+    float mean[3] = {};
+    for (int c = 0; c < 3; ++c) {
+        for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+            mean[c] += points[c][i];
+        }
+        mean[c] /= k_block_texels;
+    }
+
+    float cov[6] = {};
+    for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+        const float dx = points[0][i] - mean[0];
+        const float dy = points[1][i] - mean[1];
+        const float dz = points[2][i] - mean[2];
+        cov[0] += dx * dx;
+        cov[1] += dx * dy;
+        cov[2] += dx * dz;
+        cov[3] += dy * dy;
+        cov[4] += dy * dz;
+        cov[5] += dz * dz;
+    }
+
+    const auto axis = principal_axis(cov);
+
+    float lo = std::numeric_limits<float>::max();
+    float hi = std::numeric_limits<float>::lowest();
+    for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+        const float t = (points[0][i] - mean[0]) * axis[0] + (points[1][i] - mean[1]) * axis[1] +
+                        (points[2][i] - mean[2]) * axis[2];
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+    }
+
+    const float norm2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    const float scale = (norm2 > 0.0f) ? 1.0f / norm2 : 0.0f;
+    for (int c = 0; c < 3; ++c) {
+        e0[c] = mean[c] + axis[c] * lo * scale;
+        e1[c] = mean[c] + axis[c] * hi * scale;
+    }
+}
+
+// Least-squares endpoints for fixed interpolation weights: minimizes sum |(1 - w_i) e0 + w_i e1 - p_i|^2.
+inline bool solve_endpoints(const float (&points)[3][k_block_texels],
+                            const float (&weights)[k_block_texels],
+                            float (&e0)[3],
+                            float (&e1)[3]) noexcept
+{
+    float aa = 0.0f;
+    float ab = 0.0f;
+    float bb = 0.0f;
+    float ax[3] = {};
+    float bx[3] = {};
+    for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+        const float b = weights[i];
+        const float a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < 3; ++c) {
+            ax[c] += a * points[c][i];
+            bx[c] += b * points[c][i];
+        }
+    }
+
+    const float det = aa * bb - ab * ab;
+    if (std::abs(det) < 1e-6f) {
+        return false;
+    }
+    const float inv = 1.0f / det;
+    for (int c = 0; c < 3; ++c) {
+        e0[c] = (ax[c] * bb - bx[c] * ab) * inv;
+        e1[c] = (bx[c] * aa - ax[c] * ab) * inv;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// BC1 color and BC3 alpha blocks
+// ---------------------------------------------------------------------------------------------------------------------
+
+inline std::uint16_t to_565(float r, float g, float b) noexcept
+{
+    const auto q = [](float v, int max) {
+        return static_cast<std::uint32_t>(std::clamp(v, 0.0f, 255.0f) * max / 255.0f + 0.5f);
+    };
+    return static_cast<std::uint16_t>((q(r, 31) << 11u) | (q(g, 63) << 5u) | q(b, 31));
+}
+
+inline void from_565(std::uint16_t c, int (&rgb)[3]) noexcept
+{
+    const int r = (c >> 11u) & 31;
+    const int g = (c >> 5u) & 63;
+    const int b = c & 31;
+    rgb[0]      = (r << 3) | (r >> 2);
+    rgb[1]      = (g << 2) | (g >> 4);
+    rgb[2]      = (b << 3) | (b >> 2);
+}
+
+struct ColorBlock
+{
+    std::uint16_t c0;
+    std::uint16_t c1;
+    std::uint32_t indices;
+    std::uint32_t error;
+};
+
+// Chooses the nearest of the four palette entries for every texel. Endpoints are ordered so that c0 > c1, which
+// selects the four-color interpretation in BC1.
+inline ColorBlock encode_color_indices(const int (&texels)[3][k_block_texels], std::uint16_t c0, std::uint16_t c1)
+{
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+
+    ColorBlock block{ c0, c1, 0, 0 };
+
+    int p0[3];
+    int p1[3];
+    from_565(c0, p0);
+    from_565(c1, p1);
+
+    int palette[4][3];
+    for (int c = 0; c < 3; ++c) {
+        palette[0][c] = p0[c];
+        palette[1][c] = p1[c];
+        palette[2][c] = (2 * p0[c] + p1[c]) / 3;
+        palette[3][c] = (p0[c] + 2 * p1[c]) / 3;
+    }
+
+    if (c0 == c1) {
+        // Three-color mode would apply; index 0 is still the (only) color.
+        for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                const int d = texels[c][i] - palette[0][c];
+                block.error += static_cast<std::uint32_t>(d * d);
+            }
+        }
+        return block;
+    }
+
+    int distance[4][k_block_texels];
+    for (int p = 0; p < 4; ++p) {
+        for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+            const int dr   = texels[0][i] - palette[p][0];
+            const int dg   = texels[1][i] - palette[p][1];
+            const int db   = texels[2][i] - palette[p][2];
+            distance[p][i] = dr * dr + dg * dg + db * db;
+        }
+    }
+
+    for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+        std::uint32_t best = 0;
+        for (std::uint32_t p = 1; p < 4; ++p) {
+            if (distance[p][i] < distance[best][i]) {
+                best = p;
+            }
+        }
+        block.indices |= best << (2u * i);
+        block.error += static_cast<std::uint32_t>(distance[best][i]);
+    }
+    return block;
+}
+
+inline ColorBlock compress_color(const BlockRGBA8& block, BCMode mode)
+{
+    int   texels[3][k_block_texels];
+    float points[3][k_block_texels];
+    for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+        texels[0][i] = block[i].r;
+        texels[1][i] = block[i].g;
+        texels[2][i] = block[i].b;
+        for (int c = 0; c < 3; ++c) {
+            points[c][i] = static_cast<float>(texels[c][i]);
+        }
+    }
+
+    // Bounding box, inset by 1/16th of its extent to reduce the quantization error of the extremes.
+    float lo[3];
+    float hi[3];
+    for (int c = 0; c < 3; ++c) {
+        lo[c] = *std::min_element(points[c], points[c] + k_block_texels);
+        hi[c] = *std::max_element(points[c], points[c] + k_block_texels);
+        const float inset = (hi[c] - lo[c]) / 16.0f;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+
+    ColorBlock best =
+        encode_color_indices(texels, to_565(hi[0], hi[1], hi[2]), to_565(lo[0], lo[1], lo[2]));
+    if (mode == BCMode::fast || best.error == 0) {
+        return best;
+    }
+
+    float e0[3];
+    float e1[3];
+    fit_principal_axis(points, e0, e1);
+    ColorBlock candidate = encode_color_indices(texels, to_565(e0[0], e0[1], e0[2]), to_565(e1[0], e1[1], e1[2]));
+    if (candidate.error < best.error) {
+        best = candidate;
+    }
+
+    // Refine: solve for the endpoints that best fit the chosen indices, then re-pick the indices.
+    constexpr float k_weight[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+    for (int iteration = 0; iteration < 2 && best.c0 != best.c1; ++iteration) {
+        float weights[k_block_texels];
+        for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+            weights[i] = k_weight[(best.indices >> (2u * i)) & 3u];
+        }
+        if (!solve_endpoints(points, weights, e0, e1)) {
+            break;
+        }
+        candidate = encode_color_indices(texels, to_565(e0[0], e0[1], e0[2]), to_565(e1[0], e1[1], e1[2]));
+        if (candidate.error >= best.error) {
+            break;
+        }
+        best = candidate;
+    }
+    return best;
+}
+
+inline void write_color_block(const ColorBlock& block, std::uint8_t* out) noexcept
+{
+    store_le(out, block.c0, 2);
+    store_le(out + 2, block.c1, 2);
+    store_le(out + 4, block.indices, 4);
+}
+
+struct AlphaBlock
+{
+    std::uint8_t  a0;
+    std::uint8_t  a1;
+    std::uint64_t indices;
+    std::uint32_t error;
+};
+
+inline AlphaBlock encode_alpha_indices(const int (&alpha)[k_block_texels], std::uint8_t a0, std::uint8_t a1)
+{
+    AlphaBlock block{ a0, a1, 0, 0 };
+
+    int palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1) {
+        for (int i = 2; i < 8; ++i) {
+            palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+        }
+    } else {
+        for (int i = 2; i < 6; ++i) {
+            palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+        std::uint32_t best      = 0;
+        int           best_diff = std::abs(alpha[i] - palette[0]);
+        for (std::uint32_t p = 1; p < 8; ++p) {
+            const int diff = std::abs(alpha[i] - palette[p]);
+            if (diff < best_diff) {
+                best      = p;
+                best_diff = diff;
+            }
+        }
+        block.indices |= static_cast<std::uint64_t>(best) << (3u * i);
+        block.error += static_cast<std::uint32_t>(best_diff * best_diff);
+    }
+    return block;
+}
+
+inline AlphaBlock compress_alpha(const BlockRGBA8& block, BCMode mode)
+{
+    int alpha[k_block_texels];
+    for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+        alpha[i] = block[i].a;
+    }
+
+    const int lo = *std::min_element(alpha, alpha + k_block_texels);
+    const int hi = *std::max_element(alpha, alpha + k_block_texels);
+
+    // Eight-value mode (a0 > a1). With a constant block a0 == a1 selects the six-value mode, where index 0 is still a0.
+    AlphaBlock best = encode_alpha_indices(alpha, static_cast<std::uint8_t>(hi), static_cast<std::uint8_t>(lo));
+    if (mode == BCMode::fast || best.error == 0) {
+        return best;
+    }
+
+    // Six-value mode has exact 0 and 255, so we can spend the interpolated values on the remaining range.
+    int inner_lo = 255;
+    int inner_hi = 0;
+    for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+        if (alpha[i] != 0 && alpha[i] != 255) {
+            inner_lo = std::min(inner_lo, alpha[i]);
+            inner_hi = std::max(inner_hi, alpha[i]);
+        }
+    }
+    if (inner_lo <= inner_hi) {
+        const AlphaBlock candidate =
+            encode_alpha_indices(alpha, static_cast<std::uint8_t>(inner_lo), static_cast<std::uint8_t>(inner_hi));
+        if (candidate.error < best.error) {
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+inline void write_alpha_block(const AlphaBlock& block, std::uint8_t* out) noexcept
+{
+    out[0] = block.a0;
+    out[1] = block.a1;
+    store_le(out + 2, block.indices, 6);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// BC6H, unsigned, mode 11: one region, 10-bit endpoints, 4-bit indices.
+// ---------------------------------------------------------------------------------------------------------------------
+
+constexpr int k_bc6h_precision = 10;
+
+inline constexpr std::array<int, 16> k_bc6h_weights = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// The decoder's dequantization of an endpoint to 16 bits.
+constexpr int bc6h_unquantize(int q) noexcept
+{
+    if (q == 0) {
+        return 0;
+    }
+    if (q == (1 << k_bc6h_precision) - 1) {
+        return 0xFFFF;
+    }
+    return ((q << 16) + 0x8000) >> k_bc6h_precision;
+}
+
+inline int bc6h_quantize(float v) noexcept
+{
+    constexpr int max = (1 << k_bc6h_precision) - 1;
+
+    const float clamped = std::clamp(v, 0.0f, 65535.0f);
+    const int   q       = std::clamp(static_cast<int>(clamped * max / 65535.0f + 0.5f), 0, max);
+
+    // The dequantization is not quite linear; check the neighbors.
+    int best = q;
+    for (int c = std::max(q - 1, 0); c <= std::min(q + 1, max); ++c) {
+        if (std::abs(bc6h_unquantize(c) - clamped) < std::abs(bc6h_unquantize(best) - clamped)) {
+            best = c;
+        }
+    }
+    return best;
+}
+
+// The decoder's final step for unsigned blocks maps 16 bits to half bits.
+constexpr int bc6h_finish(int v) noexcept
+{
+    return (v * 31) >> 6;
+}
+
+struct BC6HBlock
+{
+    int           e0[3];
+    int           e1[3];
+    std::uint8_t  indices[k_block_texels];
+    std::uint64_t error;
+};
+
+inline BC6HBlock encode_bc6h_indices(const int (&texels)[3][k_block_texels], const float (&f0)[3], const float (&f1)[3])
+{
+    BC6HBlock block{};
+    int       palette[16][3];
+    for (int c = 0; c < 3; ++c) {
+        block.e0[c]    = bc6h_quantize(f0[c]);
+        block.e1[c]    = bc6h_quantize(f1[c]);
+        const int u0   = bc6h_unquantize(block.e0[c]);
+        const int u1   = bc6h_unquantize(block.e1[c]);
+        for (int p = 0; p < 16; ++p) {
+            const int w    = k_bc6h_weights[p];
+            palette[p][c] = bc6h_finish((u0 * (64 - w) + u1 * w + 32) >> 6);
+        }
+    }
+
+    for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+        std::uint8_t  best       = 0;
+        std::uint64_t best_error = std::numeric_limits<std::uint64_t>::max();
+        for (int p = 0; p < 16; ++p) {
+            const std::int64_t dr = texels[0][i] - palette[p][0];
+            const std::int64_t dg = texels[1][i] - palette[p][1];
+            const std::int64_t db = texels[2][i] - palette[p][2];
+            const auto         e  = static_cast<std::uint64_t>(dr * dr + dg * dg + db * db);
+            if (e < best_error) {
+                best       = static_cast<std::uint8_t>(p);
+                best_error = e;
+            }
+        }
+        block.indices[i] = best;
+        block.error += best_error;
+    }
+
+    // The most significant bit of the first index is implied to be zero.
+    if (block.indices[0] & 8u) {
+        std::swap(block.e0, block.e1);
+        for (auto& index : block.indices) {
+            index = static_cast<std::uint8_t>(15u - index);
+        }
+    }
+    return block;
+}
+
+inline BC6HBlock compress_bc6h(const BlockRGBf& block, BCMode mode)
+{
+    // We fit in the domain of half-float bit patterns, which is roughly logarithmic, scaled to what the decoder
+    // interpolates in (the inverse of bc6h_finish).
+    int   texels[3][k_block_texels];
+    float points[3][k_block_texels];
+    for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+        for (std::uint32_t c = 0; c < 3; ++c) {
+            const float v = block[i][c];
+            // Also maps NaN to zero.
+            const float clamped = (v > 0.0f) ? std::min(v, 65504.0f) : 0.0f;
+            texels[c][i]        = float_to_half_bits(clamped);
+            points[c][i]        = texels[c][i] * (64.0f / 31.0f);
+        }
+    }
+
+    float lo[3];
+    float hi[3];
+    for (int c = 0; c < 3; ++c) {
+        lo[c] = *std::min_element(points[c], points[c] + k_block_texels);
+        hi[c] = *std::max_element(points[c], points[c] + k_block_texels);
+    }
+
+    BC6HBlock best = encode_bc6h_indices(texels, lo, hi);
+    if (mode == BCMode::fast || best.error == 0) {
+        return best;
+    }
+
+    float e0[3];
+    float e1[3];
+    fit_principal_axis(points, e0, e1);
+    BC6HBlock candidate = encode_bc6h_indices(texels, e0, e1);
+    if (candidate.error < best.error) {
+        best = candidate;
+    }
+
+    for (int iteration = 0; iteration < 2; ++iteration) {
+        float weights[k_block_texels];
+        for (std::uint32_t i = 0; i < k_block_texels; ++i) {
+            weights[i] = k_bc6h_weights[best.indices[i]] / 64.0f;
+        }
+        if (!solve_endpoints(points, weights, e0, e1)) {
+            break;
+        }
+        candidate = encode_bc6h_indices(texels, e0, e1);
+        if (candidate.error >= best.error) {
+            break;
+        }
+        best = candidate;
+    }
+    return best;
+}
+
+class BitWriter
+{
+public:
+    explicit BitWriter(std::uint8_t* out) noexcept
+    : m_out(out)
+    {
+        std::memset(m_out, 0, 16);
+    }
+
+    void write(std::uint32_t value, std::uint32_t bits) noexcept
+    {
+        for (std::uint32_t i = 0; i < bits; ++i, ++m_position) {
+            if ((value >> i) & 1u) {
+                m_out[m_position / 8u] |= static_cast<std::uint8_t>(1u << (m_position % 8u));
+            }
+        }
+    }
+
+private:
+    std::uint8_t* m_out;
+    std::uint32_t m_position{ 0 };
+};
+
+inline void write_bc6h_block(const BC6HBlock& block, std::uint8_t* out) noexcept
+{
+    BitWriter bits(out);
+    bits.write(0x03, 5); // Mode 11
+    for (int c = 0; c < 3; ++c) {
+        bits.write(static_cast<std::uint32_t>(block.e0[c]), k_bc6h_precision);
+    }
+    for (int c = 0; c < 3; ++c) {
+        bits.write(static_cast<std::uint32_t>(block.e1[c]), k_bc6h_precision);
+    }
+    bits.write(block.indices[0], 3);
+    for (std::uint32_t i = 1; i < k_block_texels; ++i) {
+        bits.write(block.indices[i], 4);
+    }
+}
+
+template <typename ExecutionPolicy, typename ImageType, typename EncodeBlock>
+CompressedImage encode_blocks(ExecutionPolicy&& policy, const ImageType& img, BCFormat format, EncodeBlock encode)
+{
+    CompressedImage result;
+    result.format = format;
+    result.width  = img.width();
+    result.height = img.height();
+
+    const std::uint32_t blocks_x   = (img.width() + k_block_dim - 1) / k_block_dim;
+    const std::uint32_t blocks_y   = (img.height() + k_block_dim - 1) / k_block_dim;
+    const std::uint32_t block_size = bc_block_size_bytes(format);
+    result.data.resize(std::size_t{ blocks_x } * blocks_y * block_size);
+
+    if (img.width() == 0 || img.height() == 0) {
+        return result;
+    }
+
+    for_each_index(policy, std::uint32_t{ 0 }, blocks_y, [&](std::uint32_t by) {
+        std::uint8_t* out = result.data.data() + std::size_t{ by } * blocks_x * block_size;
+        for (std::uint32_t bx = 0; bx < blocks_x; ++bx, out += block_size) {
+            encode(img, bx, by, out);
+        }
+    });
+    return result;
+}
+} // namespace bc_detail
+
+template <typename ExecutionPolicy, typename ImageType>
+requires is_execution_policy_v<ExecutionPolicy> && std::is_same_v<typename ImageType::value_type, RGBA8>
+CompressedImage encode_bc1(ExecutionPolicy&& policy, const ImageType& img, BCMode mode = BCMode::fast)
+{
+    using namespace bc_detail;
+    return encode_blocks(policy, img, BCFormat::BC1, [mode](const ImageType& im, auto bx, auto by, std::uint8_t* out) {
+        BlockRGBA8 block;
+        load_block(im, bx, by, block);
+        write_color_block(compress_color(block, mode), out);
+    });
+}
+
+template <typename ExecutionPolicy, typename ImageType>
+requires is_execution_policy_v<ExecutionPolicy> && std::is_same_v<typename ImageType::value_type, RGBA8>
+CompressedImage encode_bc3(ExecutionPolicy&& policy, const ImageType& img, BCMode mode = BCMode::fast)
+{
+    using namespace bc_detail;
+    return encode_blocks(policy, img, BCFormat::BC3, [mode](const ImageType& im, auto bx, auto by, std::uint8_t* out) {
+        BlockRGBA8 block;
+        load_block(im, bx, by, block);
+        write_alpha_block(compress_alpha(block, mode), out);
+        write_color_block(compress_color(block, mode), out + 8);
+    });
+}
+
+template <typename ExecutionPolicy, typename ImageType>
+requires is_execution_policy_v<ExecutionPolicy> && std::is_same_v<typename ImageType::value_type, RGBf>
+CompressedImage encode_bc6h(ExecutionPolicy&& policy, const ImageType& img, BCMode mode = BCMode::fast)
+{
+    using namespace bc_detail;
+    return encode_blocks(policy, img, BCFormat::BC6H, [mode](const ImageType& im, auto bx, auto by, std::uint8_t* out) {
+        BlockRGBf block;
+        load_block(im, bx, by, block);
+        write_bc6h_block(compress_bc6h(block, mode), out);
+    });
+}
+
+template <typename ImageType>
+CompressedImage encode_bc1(const ImageType& img, BCMode mode = BCMode::fast)
+{
+    return encode_bc1(std::execution::seq, img, mode);
+}
+
+template <typename ImageType>
+CompressedImage encode_bc3(const ImageType& img, BCMode mode = BCMode::fast)
+{
+    return encode_bc3(std::execution::seq, img, mode);
+}
+
+template <typename ImageType>
+CompressedImage encode_bc6h(const ImageType& img, BCMode mode = BCMode::fast)
+{
+    return encode_bc6h(std::execution::seq, img, mode);
+}
@@ -0,0 +1,380 @@
+#pragma once
+
+#include "Array2D.h"
+#include "Instrumentation.h"
+#include "Morton.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <execution>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// An image with Array2DSFC's tiling whose tiles are reference counted and shared between copies until they are written.
+// A copy (a snapshot, for undo history or a branching edit) costs a pointer and a reference count per tile, and a write
+// duplicates only the tile it lands in, if that tile is shared.
+//     CowArray2DSFC<RGBf> img(std::execution::par, dense);
+//     const CowArray2DSFC<RGBf> before = img.snapshot();
+//     img.set(x, y, RGBf(1, 0, 0));  // Copies the tile of (x, y) once; before keeps the old one.
+//
+// A new image's tiles all share one tile holding the fill value. Within a tile, elements are in the same Morton order
+// as in Array2DSFC<T, log_tile_size>.
+//
+// Reference counting is atomic, so copies that share tiles can be read, written, and destroyed on different threads.
+// Each copy is still a single object: writes to one copy may run concurrently as long as they go to different tiles.
+template <typename T, std::uint32_t log_tile_size = 4, typename allocator_t = std::allocator<T>>
+class CowArray2DSFC
+{
+    static constexpr int k_tile_width  = 1 << log_tile_size;
+    static constexpr int k_tile_height = 1 << log_tile_size;
+
+    struct Tile
+    {
+        T* elements() noexcept
+        {
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
+
+        const T* elements() const noexcept
+        {
+            return std::launder(reinterpret_cast<const T*>(storage));
+        }
+
+        std::atomic<std::size_t> refs{ 1 };
+        alignas(T) std::byte storage[sizeof(T) << (2 * log_tile_size)];
+    };
+
+    using allocator_traits      = std::allocator_traits<allocator_t>;
+    using tile_allocator_type   = typename allocator_traits::template rebind_alloc<Tile>;
+    using tile_allocator_traits = std::allocator_traits<tile_allocator_type>;
+
+public:
+    using size_type       = std::uint32_t;
+    using allocator_type  = allocator_t;
+    using value_type      = T;
+    using reference       = value_type&;
+    using const_reference = const value_type&;
+    using dense_type      = Array2DSFC<T, log_tile_size, allocator_t>;
+
+    static constexpr size_type tile_width  = k_tile_width;
+    static constexpr size_type tile_height = k_tile_height;
+    static constexpr size_type tile_area   = k_tile_width * k_tile_height;
+
+    CowArray2DSFC()
+    : CowArray2DSFC(0, 0)
+    {
+    }
+
+    CowArray2DSFC(size_type width, size_type height, const T& fill = T{}, allocator_type allocator = allocator_type{})
+    : m_allocator(allocator)
+    , m_width(width)
+    , m_height(height)
+    , m_tiles(std::size_t{ num_tiles_width(width) } * num_tiles_height(height), nullptr)
+    {
+        if (m_tiles.empty()) {
+            return;
+        }
+        Tile* const shared = new_tile(fill);
+        shared->refs.store(m_tiles.size(), std::memory_order_relaxed);
+        std::fill(m_tiles.begin(), m_tiles.end(), shared);
+    }
+
+    // Copies the tiles of an Array2DSFC; none are shared.
+    template <typename ExecutionPolicy>
+    requires is_execution_policy_v<ExecutionPolicy>
+    CowArray2DSFC(ExecutionPolicy&& policy, const dense_type& dense)
+    : m_allocator(dense.get_allocator())
+    , m_width(dense.width())
+    , m_height(dense.height())
+    , m_tiles(std::size_t{ num_tiles_width(m_width) } * num_tiles_height(m_height), nullptr)
+    {
+        try {
+            for_each_index(policy, size_type{ 0 }, tile_count(), [&](size_type tile_index) {
+                const T* const source = dense.data() + std::size_t{ tile_index } * tile_area;
+                if (is_whole_tile(tile_index)) {
+                    m_tiles[tile_index] = new_tile(source);
+                } else {
+                    // Only the dense array's elements are initialized, not the padding of its edge tiles, so only
+                    // they are read. The first slot of a tile always holds an element.
+                    Tile* const tile = new_tile(source[0]);
+                    for_each_in_tile(tile_index, [&](size_type i) { tile->elements()[i] = source[i]; });
+                    m_tiles[tile_index] = tile;
+                }
+            });
+        } catch (...) {
+            release_tiles();
+            throw;
+        }
+    }
+
+    // Shares every tile with other.
+    CowArray2DSFC(const CowArray2DSFC& other)
+    : m_allocator(allocator_traits::select_on_container_copy_construction(other.m_allocator))
+    , m_width(other.m_width)
+    , m_height(other.m_height)
+    , m_tiles(other.m_tiles)
+    {
+        for (Tile* const tile : m_tiles) {
+            tile->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    CowArray2DSFC(CowArray2DSFC&& other) noexcept
+    : m_allocator(std::move(other.m_allocator))
+    , m_width(std::exchange(other.m_width, 0))
+    , m_height(std::exchange(other.m_height, 0))
+    , m_tiles(std::move(other.m_tiles))
+    {
+        other.m_tiles.clear();
+    }
+
+    ~CowArray2DSFC()
+    {
+        release_tiles();
+    }
+
+    CowArray2DSFC& operator=(CowArray2DSFC other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    void swap(CowArray2DSFC& other) noexcept
+    {
+        using std::swap; // Allow ADL
+        swap(m_allocator, other.m_allocator);
+        swap(m_width, other.m_width);
+        swap(m_height, other.m_height);
+        m_tiles.swap(other.m_tiles);
+    }
+
+    // The same as copying: every tile is shared until one side writes to it.
+    CowArray2DSFC snapshot() const
+    {
+        return *this;
+    }
+
+    allocator_type get_allocator() const noexcept
+    {
+        return m_allocator;
+    }
+
+    size_type width() const noexcept
+    {
+        return m_width;
+    }
+
+    size_type height() const noexcept
+    {
+        return m_height;
+    }
+
+    size_type num_tiles_width() const noexcept
+    {
+        return num_tiles_width(m_width);
+    }
+
+    size_type num_tiles_height() const noexcept
+    {
+        return num_tiles_height(m_height);
+    }
+
+    const_reference operator()(size_type x, size_type y) const noexcept
+    {
+        return m_tiles[tile_index_of(x, y)]->elements()[index_in_tile(x, y)];
+    }
+
+    // A writable reference to (x, y), copying its tile first if it is shared.
+    reference writable(size_type x, size_type y)
+    {
+        return unshare(tile_index_of(x, y))[index_in_tile(x, y)];
+    }
+
+    void set(size_type x, size_type y, const T& value)
+    {
+        writable(x, y) = value;
+    }
+
+    // The tile's tile_area slots in Morton order.
+    const T* tile_data(size_type tile_x, size_type tile_y) const noexcept
+    {
+        return m_tiles[tile_y * num_tiles_width() + tile_x]->elements();
+    }
+
+    // As tile_data, but copies the tile first if it is shared.
+    T* writable_tile_data(size_type tile_x, size_type tile_y)
+    {
+        return unshare(tile_y * num_tiles_width() + tile_x);
+    }
+
+    // Whether a write to the tile would copy it.
+    bool tile_shared(size_type tile_x, size_type tile_y) const noexcept
+    {
+        return m_tiles[tile_y * num_tiles_width() + tile_x]->refs.load(std::memory_order_acquire) != 1;
+    }
+
+    size_type shared_tile_count() const noexcept
+    {
+        return static_cast<size_type>(std::count_if(m_tiles.begin(), m_tiles.end(), [](const Tile* tile) {
+            return tile->refs.load(std::memory_order_relaxed) != 1;
+        }));
+    }
+
+    // An Array2DSFC with the same elements. Its storage order is the same, so tiles are copied whole.
+    template <typename ExecutionPolicy>
+    requires is_execution_policy_v<ExecutionPolicy>
+    dense_type to_dense(ExecutionPolicy&& policy) const
+    {
+        dense_type dense(policy, m_width, m_height, m_allocator);
+        for_each_index(policy, size_type{ 0 }, tile_count(), [&](size_type tile_index) {
+            const T* const tile = m_tiles[tile_index]->elements();
+            T* const       out  = dense.data() + std::size_t{ tile_index } * tile_area;
+            if constexpr (std::is_trivially_copyable_v<T>) {
+                std::memcpy(static_cast<void*>(out), static_cast<const void*>(tile), sizeof(T) * tile_area);
+            } else {
+                for_each_in_tile(tile_index, [&](size_type i) { out[i] = tile[i]; });
+            }
+        });
+        return dense;
+    }
+
+    dense_type to_dense() const
+    {
+        return to_dense(std::execution::seq);
+    }
+
+private:
+    static constexpr size_type num_tiles_width(size_type width) noexcept
+    {
+        return (width + k_tile_width - 1) >> log_tile_size;
+    }
+
+    static constexpr size_type num_tiles_height(size_type height) noexcept
+    {
+        return (height + k_tile_height - 1) >> log_tile_size;
+    }
+
+    size_type tile_count() const noexcept
+    {
+        return static_cast<size_type>(m_tiles.size());
+    }
+
+    size_type tile_index_of(size_type x, size_type y) const noexcept
+    {
+        assert(x < m_width && y < m_height);
+        return (y >> log_tile_size) * num_tiles_width() + (x >> log_tile_size);
+    }
+
+    static size_type index_in_tile(size_type x, size_type y) noexcept
+    {
+        return morton_tile_index<log_tile_size>(x & (k_tile_width - 1), y & (k_tile_height - 1));
+    }
+
+    // The tile lies inside the image, so it has no padding.
+    bool is_whole_tile(size_type tile_index) const noexcept
+    {
+        const size_type x0 = (tile_index % num_tiles_width()) * k_tile_width;
+        const size_type y0 = (tile_index / num_tiles_width()) * k_tile_height;
+        return m_width - x0 >= k_tile_width && m_height - y0 >= k_tile_height;
+    }
+
+    // Calls f(i) for the in-tile index of every element of the tile, skipping the padding of edge tiles.
+    template <typename Function>
+    void for_each_in_tile(size_type tile_index, Function f) const
+    {
+        const size_type x0 = (tile_index % num_tiles_width()) * k_tile_width;
+        const size_type y0 = (tile_index / num_tiles_width()) * k_tile_height;
+        const size_type nx = std::min<size_type>(k_tile_width, m_width - x0);
+        const size_type ny = std::min<size_type>(k_tile_height, m_height - y0);
+        for (size_type y = 0; y < ny; ++y) {
+            for (size_type x = 0; x < nx; ++x) {
+                f(morton_tile_index<log_tile_size>(x, y));
+            }
+        }
+    }
+
+    T* unshare(size_type tile_index)
+    {
+        Tile*& tile = m_tiles[tile_index];
+        // Acquire, so that the other owners' reads of the tile happen before our writes once they have let go of it.
+        if (tile->refs.load(std::memory_order_acquire) != 1) {
+            Tile* const copy = new_tile(tile->elements());
+            release(tile);
+            tile = copy;
+        }
+        return tile->elements();
+    }
+
+    // A tile with every slot, padding included, constructed from value.
+    Tile* new_tile(const T& value)
+    {
+        return make_tile([&](T* p, size_type) { allocator_traits::construct(m_allocator, p, value); });
+    }
+
+    // A copy of a tile's tile_area slots.
+    Tile* new_tile(const T* source)
+    {
+        return make_tile([&](T* p, size_type i) { allocator_traits::construct(m_allocator, p, source[i]); });
+    }
+
+    template <typename Construct>
+    Tile* make_tile(Construct construct)
+    {
+        IMAGE_LIBRARY_COUNT(allocations, 1);
+        IMAGE_LIBRARY_COUNT(bytes_allocated, sizeof(Tile));
+        tile_allocator_type tile_allocator(m_allocator);
+        // Default-initialized: the element storage is left for construct, rather than zeroed first.
+        Tile* const tile        = ::new (static_cast<void*>(tile_allocator_traits::allocate(tile_allocator, 1))) Tile;
+        T* const    elements    = reinterpret_cast<T*>(tile->storage);
+        size_type   constructed = 0;
+        try {
+            for (; constructed < tile_area; ++constructed) {
+                construct(elements + constructed, constructed);
+            }
+        } catch (...) {
+            for (size_type i = 0; i < constructed; ++i) {
+                allocator_traits::destroy(m_allocator, elements + i);
+            }
+            std::destroy_at(tile);
+            tile_allocator_traits::deallocate(tile_allocator, tile, 1);
+            throw;
+        }
+        return tile;
+    }
+
+    void release(Tile* tile) noexcept
+    {
+        if (tile->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        T* const elements = tile->elements();
+        for (size_type i = 0; i < tile_area; ++i) {
+            allocator_traits::destroy(m_allocator, elements + i);
+        }
+        std::destroy_at(tile);
+        tile_allocator_type tile_allocator(m_allocator);
+        tile_allocator_traits::deallocate(tile_allocator, tile, 1);
+    }
+
+    void release_tiles() noexcept
+    {
+        for (Tile*& tile : m_tiles) {
+            if (tile) {
+                release(std::exchange(tile, nullptr));
+            }
+        }
+    }
+
+    allocator_type     m_allocator;
+    size_type          m_width;
+    size_type          m_height;
+    std::vector<Tile*> m_tiles;
+};
@@ -0,0 +1,771 @@
+#pragma once
+
+#include "ImageView.h"
+#include "Instrumentation.h"
+#include "Parallel.h"
+#include "PixelTraits.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <execution>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Convolution and Gaussian blur.
+//     Image_RGBf blurred(photo.width(), photo.height());
+//     gaussian_blur(std::execution::par, blurred, photo, 4.0f);
+//
+// Filtering is done on the channel values as stored (sRGB encoded for 8- and 16-bit images), in float, and the result
+// is rounded and clamped back into integer channels. The source and destination have the same channels; convert_image
+// (ImageConvert.h) changes the pixel type before or after filtering.
+//
+// The destination is cut into blocks, which are distributed over threads with std::execution::par. Each block reads
+// its part of the source plus a halo of the filter's radius into float lines, runs the horizontal filters along the
+// lines and the vertical filters across them, and stores the result: directly into the rows of an Array2D, and for an
+// Array2DSFC, through a row-major block that is transcoded into its tiles (blocks are tile aligned). Kernels whose
+// weights are all equal, such as the boxes of the box cascade, run as moving sums, so their cost does not depend on
+// their radius.
+//
+// The recursive Gaussian is the exception: its filters run the length of whole rows and then of strips of columns,
+// through a float copy of the image.
+//
+// The destination must not be the source, nor overlap it.
+
+// What the filters see outside the image.
+enum class BorderMode
+{
+    clamp,  // the nearest edge pixel
+    mirror, // reflected about the edge pixel: -1 is 1
+    wrap    // the image repeats
+};
+
+enum class BlurMethod
+{
+    automatic, // kernel for small sigmas, box above
+    kernel,    // sampled Gaussian kernel, out to 3 sigma
+    box,       // three box filters (Kovesi, "Fast almost-Gaussian filtering")
+    recursive  // recursive filter (Young and van Vliet, "Recursive implementation of the Gaussian filter")
+};
+
+// A kernel with an odd number of weights, centred on the middle one.
+class Kernel1D
+{
+public:
+    explicit Kernel1D(std::vector<float> weights)
+    : m_weights(std::move(weights))
+    {
+        if (m_weights.size() % 2 == 0) {
+            throw std::invalid_argument("Kernels have an odd number of weights");
+        }
+        m_box = std::all_of(m_weights.begin(), m_weights.end(), [this](float w) { return w == m_weights.front(); });
+    }
+
+    std::uint32_t radius() const noexcept
+    {
+        return static_cast<std::uint32_t>(m_weights.size() / 2);
+    }
+
+    const std::vector<float>& weights() const noexcept
+    {
+        return m_weights;
+    }
+
+    // All weights are equal: the kernel is filtered as a moving sum.
+    bool is_box() const noexcept
+    {
+        return m_box;
+    }
+
+private:
+    std::vector<float> m_weights;
+    bool               m_box;
+};
+
+// A square kernel of odd size, its weights row by row.
+class Kernel2D
+{
+public:
+    Kernel2D(std::uint32_t size, std::vector<float> weights)
+    : m_size(size)
+    , m_weights(std::move(weights))
+    {
+        if (size % 2 == 0 || m_weights.size() != std::size_t{ size } * size) {
+            throw std::invalid_argument("Kernels are square with an odd number of weights on a side");
+        }
+    }
+
+    std::uint32_t size() const noexcept
+    {
+        return m_size;
+    }
+
+    std::uint32_t radius() const noexcept
+    {
+        return m_size / 2;
+    }
+
+    float operator()(std::uint32_t x, std::uint32_t y) const noexcept
+    {
+        return m_weights[std::size_t{ y } * m_size + x];
+    }
+
+private:
+    std::uint32_t      m_size;
+    std::vector<float> m_weights;
+};
+
+inline Kernel1D box_kernel(std::uint32_t radius)
+{
+    const std::size_t size = 2 * std::size_t{ radius } + 1;
+    return Kernel1D(std::vector<float>(size, 1.0f / static_cast<float>(size)));
+}
+
+// Sampled out to 3 sigma and normalized.
+inline Kernel1D gaussian_kernel(float sigma)
+{
+    if (!(sigma > 0.0f)) {
+        throw std::invalid_argument("Sigma has to be positive");
+    }
+    const auto         radius = static_cast<std::int32_t>(std::ceil(3.0f * sigma));
+    std::vector<float> weights(2 * radius + 1);
+    float              sum = 0.0f;
+    for (std::int32_t i = -radius; i <= radius; ++i) {
+        const float w        = std::exp(-0.5f * static_cast<float>(i * i) / (sigma * sigma));
+        weights[i + radius]  = w;
+        sum                 += w;
+    }
+    for (float& w : weights) {
+        w /= sum;
+    }
+    return Kernel1D(std::move(weights));
+}
+
+namespace filter_detail {
+constexpr std::size_t k_block_width  = 128;
+constexpr std::size_t k_block_height = 64;
+constexpr std::size_t k_strip_width  = 64;
+
+// Float buffers, kept per thread from one block to the next: allocating blocks' worth of them each time costs about as
+// much as filtering.
+struct Scratch
+{
+    std::vector<float> line;
+    std::vector<float> line_scratch;
+    std::vector<float> block;
+    std::vector<float> block_scratch;
+    std::vector<float> out;
+};
+
+inline Scratch& thread_scratch()
+{
+    thread_local Scratch scratch;
+    return scratch;
+}
+
+inline std::int64_t border_index(std::int64_t i, std::int64_t n, BorderMode border) noexcept
+{
+    if (i >= 0 && i < n) {
+        return i;
+    }
+    switch (border) {
+    case BorderMode::mirror: {
+        if (n == 1) {
+            return 0;
+        }
+        const std::int64_t period = 2 * (n - 1);
+        std::int64_t       r      = i % period;
+        r                         = (r < 0) ? r + period : r;
+        return (r < n) ? r : period - r;
+    }
+    case BorderMode::wrap: {
+        const std::int64_t r = i % n;
+        return (r < 0) ? r + n : r;
+    }
+    case BorderMode::clamp:
+    default:
+        return std::clamp<std::int64_t>(i, 0, n - 1);
+    }
+}
+
+template <typename Channel>
+Channel from_float(float v) noexcept
+{
+    if constexpr (std::is_integral_v<Channel>) {
+        constexpr auto k_max = static_cast<float>(std::numeric_limits<Channel>::max());
+        return static_cast<Channel>(std::clamp(v, 0.0f, k_max) + 0.5f);
+    } else {
+        return static_cast<Channel>(v);
+    }
+}
+
+template <typename Pixel>
+void pixel_to_float(const Pixel& p, float* out) noexcept
+{
+    for (std::uint32_t c = 0; c < channel_count_v<Pixel>; ++c) {
+        out[c] = static_cast<float>(pixel_channel(p, c));
+    }
+}
+
+template <typename Pixel>
+void float_to_pixel(const float* in, Pixel& p) noexcept
+{
+    for (std::uint32_t c = 0; c < channel_count_v<Pixel>; ++c) {
+        pixel_channel(p, c) = from_float<channel_type_t<Pixel>>(in[c]);
+    }
+}
+
+// Channel values are not rescaled between types, so the source and destination pixels have to agree on them.
+template <typename DstPixel, typename SrcPixel>
+constexpr bool same_channels_v = channel_count_v<DstPixel> == channel_count_v<SrcPixel> &&
+                                 std::is_same_v<channel_type_t<DstPixel>, channel_type_t<SrcPixel>>;
+
+template <typename Image>
+constexpr bool is_row_major_image_v = viewable_image<Image> && !is_tiled_image_v<Image>;
+
+// Loads count pixels of row y of src, starting at x_begin, as floats. Either may be outside the image.
+template <typename SrcImage>
+void load_row(const SrcImage&  src,
+              std::int64_t     y,
+              std::int64_t     x_begin,
+              std::size_t      count,
+              BorderMode       border,
+              float*           out)
+{
+    using Pixel                      = typename SrcImage::value_type;
+    using size_type                  = typename SrcImage::size_type;
+    constexpr std::size_t k_channels = channel_count_v<Pixel>;
+
+    const auto         width = static_cast<std::int64_t>(src.width());
+    const auto         sy    = static_cast<size_type>(border_index(y, src.height(), border));
+    const std::int64_t end   = x_begin + static_cast<std::int64_t>(count);
+    const std::int64_t in0   = std::clamp<std::int64_t>(0, x_begin, end);
+    const std::int64_t in1   = std::clamp<std::int64_t>(width, x_begin, end);
+
+    const auto load_outside = [&](std::int64_t x) {
+        const auto sx = static_cast<size_type>(border_index(x, width, border));
+        pixel_to_float(src(sx, sy), out + (x - x_begin) * k_channels);
+    };
+
+    for (std::int64_t x = x_begin; x < in0; ++x) {
+        load_outside(x);
+    }
+    if constexpr (is_row_major_image_v<const SrcImage>) {
+        const Pixel* const row = view(src).row(sy);
+        for (std::int64_t x = in0; x < in1; ++x) {
+            pixel_to_float(row[x], out + (x - x_begin) * k_channels);
+        }
+    } else {
+        for (std::int64_t x = in0; x < in1; ++x) {
+            pixel_to_float(src(static_cast<size_type>(x), sy), out + (x - x_begin) * k_channels);
+        }
+    }
+    for (std::int64_t x = std::max(in1, in0); x < end; ++x) {
+        load_outside(x);
+    }
+}
+
+// Stores a width x height block of floats, row by row, at (x0, y0) of dst. For tiled images, (x0, y0) is a tile corner.
+template <typename DstImage>
+void store_block(DstImage&                     dst,
+                 typename DstImage::size_type  x0,
+                 typename DstImage::size_type  y0,
+                 typename DstImage::size_type  width,
+                 typename DstImage::size_type  height,
+                 const float*                  in)
+{
+    using Pixel                      = typename DstImage::value_type;
+    using size_type                  = typename DstImage::size_type;
+    constexpr std::size_t k_channels = channel_count_v<Pixel>;
+
+    const std::size_t row_size = std::size_t{ width } * k_channels;
+    if constexpr (is_row_major_image_v<DstImage>) {
+        const auto rows = view(dst);
+        for (size_type y = 0; y < height; ++y) {
+            Pixel* const out = rows.row(y0 + y) + x0;
+            for (size_type x = 0; x < width; ++x) {
+                float_to_pixel(in + y * row_size + x * k_channels, out[x]);
+            }
+        }
+    } else if constexpr (is_tiled_image_v<DstImage>) {
+        thread_local std::vector<Pixel> pixels;
+        pixels.resize(std::size_t{ width } * height);
+        const ImageView<Pixel, size_type> block(pixels.data(), width, height, width);
+        for (size_type y = 0; y < height; ++y) {
+            for (size_type x = 0; x < width; ++x) {
+                float_to_pixel(in + y * row_size + x * k_channels, block(x, y));
+            }
+        }
+        blit(crop(dst, x0, y0, width, height), block);
+    } else {
+        for (size_type y = 0; y < height; ++y) {
+            for (size_type x = 0; x < width; ++x) {
+                float_to_pixel(in + y * row_size + x * k_channels, dst(x0 + x, y0 + y));
+            }
+        }
+    }
+}
+
+// out[i] = w * in[i], and out[i] += w * in[i]. The arrays do not overlap, which the compiler needs told to vectorize.
+inline void scale_lanes(const float* __restrict in, float* __restrict out, float w, std::size_t count) noexcept
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        out[i] = w * in[i];
+    }
+}
+
+inline void scale_add_lanes(const float* __restrict in, float* __restrict out, float w, std::size_t count) noexcept
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        out[i] += w * in[i];
+    }
+}
+
+// out[i] = prev[i] + w * (add[i] - sub[i]): a moving sum one step on.
+inline void slide_lanes(const float* __restrict prev,
+                        const float* __restrict add,
+                        const float* __restrict sub,
+                        float* __restrict       out,
+                        float                   w,
+                        std::size_t             count) noexcept
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        out[i] = prev[i] + w * (add[i] - sub[i]);
+    }
+}
+
+// Filters lanes interleaved lines of values: out[s * lanes + l] is the kernel over in[(s + k) * lanes + l] for its
+// 2 * radius + 1 taps k, for steps positions s. Along a row of pixels, the lanes are the channels; down a column of
+// rows, they are every channel of every pixel of a row, and each tap is one pass over contiguous memory.
+inline void filter_lanes(const float* in, float* out, std::size_t steps, std::size_t lanes, const Kernel1D& kernel)
+{
+    const std::size_t taps = kernel.weights().size();
+
+    if (kernel.is_box()) {
+        const float w = kernel.weights().front();
+        scale_lanes(in, out, w, lanes);
+        for (std::size_t k = 1; k < taps; ++k) {
+            scale_add_lanes(in + k * lanes, out, w, lanes);
+        }
+        for (std::size_t s = 1; s < steps; ++s) {
+            slide_lanes(
+                out + (s - 1) * lanes, in + (s + taps - 1) * lanes, in + (s - 1) * lanes, out + s * lanes, w, lanes);
+        }
+        return;
+    }
+
+    const std::size_t count = steps * lanes;
+    scale_lanes(in, out, kernel.weights().front(), count);
+    for (std::size_t k = 1; k < taps; ++k) {
+        scale_add_lanes(in + k * lanes, out, kernel.weights()[k], count);
+    }
+}
+
+inline std::uint32_t total_radius(const std::vector<Kernel1D>& stages) noexcept
+{
+    std::uint32_t r = 0;
+    for (const auto& k : stages) {
+        r += k.radius();
+    }
+    return r;
+}
+
+// Runs the stages one after the other, each shortening the line by twice its radius, from in, which holds steps plus
+// twice their total radius positions, to out, which holds steps. in and scratch, of the size of in, are overwritten.
+inline void filter_stages(float*                       in,
+                          float*                       scratch,
+                          float*                       out,
+                          std::size_t                  steps,
+                          std::size_t                  lanes,
+                          const std::vector<Kernel1D>& stages)
+{
+    if (stages.empty()) {
+        std::copy_n(in, steps * lanes, out);
+        return;
+    }
+    std::size_t length = steps + 2 * std::size_t{ total_radius(stages) };
+    for (std::size_t i = 0; i < stages.size(); ++i) {
+        length -= 2 * std::size_t{ stages[i].radius() };
+        filter_lanes(in, (i + 1 == stages.size()) ? out : scratch, length, lanes, stages[i]);
+        std::swap(in, scratch);
+    }
+}
+
+// Tile aligned blocks of at least the default size, and tall enough that the vertical halo does not dominate.
+template <typename DstImage>
+std::pair<std::size_t, std::size_t> block_size(std::uint32_t vertical_radius) noexcept
+{
+    std::size_t width  = k_block_width;
+    std::size_t height = std::max<std::size_t>(k_block_height, 2 * std::size_t{ vertical_radius });
+    if constexpr (is_tiled_image_v<DstImage>) {
+        using View                  = std::remove_const_t<decltype(view(std::declval<DstImage&>()))>;
+        constexpr std::size_t tw    = View::tile_width;
+        constexpr std::size_t th    = View::tile_height;
+        width                       = (width + tw - 1) / tw * tw;
+        height                      = (height + th - 1) / th * th;
+    }
+    return { width, height };
+}
+
+// Calls f(x0, y0, width, height) for each block of dst, split as the policy says.
+template <typename ExecutionPolicy, typename DstImage, typename Function>
+void for_each_block(ExecutionPolicy&& policy, const DstImage& dst, std::pair<std::size_t, std::size_t> size, Function f)
+{
+    using size_type = typename DstImage::size_type;
+
+    const auto [block_width, block_height] = size;
+    const std::size_t blocks_x             = (std::size_t{ dst.width() } + block_width - 1) / block_width;
+    const std::size_t blocks_y             = (std::size_t{ dst.height() } + block_height - 1) / block_height;
+    for_each_index(policy, std::size_t{ 0 }, blocks_x * blocks_y, [&](std::size_t b) {
+        const std::size_t x0 = (b % blocks_x) * block_width;
+        const std::size_t y0 = (b / blocks_x) * block_height;
+        f(static_cast<size_type>(x0),
+          static_cast<size_type>(y0),
+          static_cast<size_type>(std::min(block_width, dst.width() - x0)),
+          static_cast<size_type>(std::min(block_height, dst.height() - y0)));
+    });
+}
+
+template <typename ExecutionPolicy, typename DstImage, typename SrcImage>
+void convolve_stages(ExecutionPolicy&&             policy,
+                     DstImage&                     dst,
+                     const SrcImage&               src,
+                     const std::vector<Kernel1D>& horizontal,
+                     const std::vector<Kernel1D>& vertical,
+                     BorderMode                    border)
+{
+    constexpr std::size_t k_channels = channel_count_v<typename DstImage::value_type>;
+    static_assert(same_channels_v<typename DstImage::value_type, typename SrcImage::value_type>,
+                  "Filtering keeps the channels of the source");
+    assert(dst.width() == src.width() && dst.height() == src.height());
+
+    if (dst.width() == 0 || dst.height() == 0) {
+        return;
+    }
+
+    const std::uint32_t rh = total_radius(horizontal);
+    const std::uint32_t rv = total_radius(vertical);
+
+    for_each_block(policy, dst, block_size<DstImage>(rv), [&](auto x0, auto y0, auto width, auto height) {
+        const std::size_t line_size = (std::size_t{ width } + 2 * rh) * k_channels;
+        const std::size_t row_size  = std::size_t{ width } * k_channels;
+        const std::size_t rows      = std::size_t{ height } + 2 * rv;
+
+        Scratch& scratch = thread_scratch();
+        scratch.line.resize(line_size);
+        scratch.line_scratch.resize(line_size);
+        scratch.block.resize(rows * row_size);
+        scratch.block_scratch.resize(rows * row_size);
+        scratch.out.resize(std::size_t{ height } * row_size);
+
+        for (std::size_t j = 0; j < rows; ++j) {
+            load_row(src,
+                     static_cast<std::int64_t>(y0) + static_cast<std::int64_t>(j) - rv,
+                     static_cast<std::int64_t>(x0) - rh,
+                     std::size_t{ width } + 2 * rh,
+                     border,
+                     scratch.line.data());
+            filter_stages(scratch.line.data(),
+                          scratch.line_scratch.data(),
+                          scratch.block.data() + j * row_size,
+                          width,
+                          k_channels,
+                          horizontal);
+        }
+
+        filter_stages(
+            scratch.block.data(), scratch.block_scratch.data(), scratch.out.data(), height, row_size, vertical);
+        store_block(dst, x0, y0, width, height, scratch.out.data());
+    });
+}
+
+// The 3 box filters whose cascade best matches a Gaussian of sigma.
+inline std::vector<Kernel1D> gaussian_boxes(float sigma)
+{
+    constexpr int k_boxes = 3;
+
+    const float ideal = std::sqrt(12.0f * sigma * sigma / k_boxes + 1.0f);
+    int         lower = static_cast<int>(std::floor(ideal));
+    if (lower % 2 == 0) {
+        --lower;
+    }
+    const float m        = (12.0f * sigma * sigma - k_boxes * lower * lower - 4.0f * k_boxes * lower - 3.0f * k_boxes) /
+                    (-4.0f * lower - 4.0f);
+    const int   n_lower  = static_cast<int>(std::round(m));
+
+    std::vector<Kernel1D> boxes;
+    for (int i = 0; i < k_boxes; ++i) {
+        const int size = (i < n_lower) ? lower : lower + 2;
+        boxes.push_back(box_kernel(static_cast<std::uint32_t>(size / 2)));
+    }
+    return boxes;
+}
+
+// Young and van Vliet's third-order recursive approximation, run forwards and then backwards.
+class RecursiveGaussian
+{
+public:
+    explicit RecursiveGaussian(float sigma) noexcept
+    {
+        const float q  = (sigma >= 2.5f) ? 0.98711f * sigma - 0.96330f
+                                         : 3.97156f - 4.14554f * std::sqrt(1.0f - 0.26891f * sigma);
+        const float q2 = q * q;
+        const float q3 = q2 * q;
+        const float b0 = 1.57825f + 2.44413f * q + 1.4281f * q2 + 0.422205f * q3;
+        m_c1           = (2.44413f * q + 2.85619f * q2 + 1.26661f * q3) / b0;
+        m_c2           = -(1.4281f * q2 + 1.26661f * q3) / b0;
+        m_c3           = 0.422205f * q3 / b0;
+        m_gain         = 1.0f - (m_c1 + m_c2 + m_c3);
+        m_padding      = static_cast<std::uint32_t>(std::ceil(4.0f * sigma));
+    }
+
+    // How far past the ends of a line its values are loaded, for the border to settle.
+    std::uint32_t padding() const noexcept
+    {
+        return m_padding;
+    }
+
+    // Filters steps positions of lanes interleaved lines in place. The filters start from the value at either end, as
+    // if it went on forever.
+    void filter(float* data, std::size_t steps, std::size_t lanes) const
+    {
+        std::vector<float> edge(data, data + lanes);
+        for (std::size_t s = 0; s < steps; ++s) {
+            float* const       cur = data + s * lanes;
+            const float* const p1  = (s >= 1) ? cur - lanes : edge.data();
+            const float* const p2  = (s >= 2) ? cur - 2 * lanes : edge.data();
+            const float* const p3  = (s >= 3) ? cur - 3 * lanes : edge.data();
+            for (std::size_t l = 0; l < lanes; ++l) {
+                cur[l] = m_gain * cur[l] + m_c1 * p1[l] + m_c2 * p2[l] + m_c3 * p3[l];
+            }
+        }
+
+        float* const last = data + (steps - 1) * lanes;
+        edge.assign(last, last + lanes);
+        for (std::size_t s = steps; s-- > 0;) {
+            float* const       cur = data + s * lanes;
+            const float* const n1  = (s + 1 < steps) ? cur + lanes : edge.data();
+            const float* const n2  = (s + 2 < steps) ? cur + 2 * lanes : edge.data();
+            const float* const n3  = (s + 3 < steps) ? cur + 3 * lanes : edge.data();
+            for (std::size_t l = 0; l < lanes; ++l) {
+                cur[l] = m_gain * cur[l] + m_c1 * n1[l] + m_c2 * n2[l] + m_c3 * n3[l];
+            }
+        }
+    }
+
+private:
+    float         m_c1;
+    float         m_c2;
+    float         m_c3;
+    float         m_gain;
+    std::uint32_t m_padding;
+};
+
+template <typename ExecutionPolicy, typename DstImage, typename SrcImage>
+void recursive_gaussian(ExecutionPolicy&& policy, DstImage& dst, const SrcImage& src, float sigma, BorderMode border)
+{
+    using size_type                  = typename DstImage::size_type;
+    constexpr std::size_t k_channels = channel_count_v<typename DstImage::value_type>;
+    static_assert(same_channels_v<typename DstImage::value_type, typename SrcImage::value_type>,
+                  "Filtering keeps the channels of the source");
+    assert(dst.width() == src.width() && dst.height() == src.height());
+
+    if (dst.width() == 0 || dst.height() == 0) {
+        return;
+    }
+
+    const RecursiveGaussian filter(sigma);
+    const std::size_t       pad      = filter.padding();
+    const std::size_t       width    = dst.width();
+    const std::size_t       height   = dst.height();
+    const std::size_t       row_size = width * k_channels;
+
+    // Rows, into a float copy of the image.
+    std::vector<float> rows(height * row_size);
+    for_each_index(policy, std::size_t{ 0 }, height, [&](std::size_t y) {
+        std::vector<float>& line = thread_scratch().line;
+        line.resize((width + 2 * pad) * k_channels);
+        load_row(
+            src, static_cast<std::int64_t>(y), -static_cast<std::int64_t>(pad), width + 2 * pad, border, line.data());
+        filter.filter(line.data(), width + 2 * pad, k_channels);
+        std::copy_n(line.data() + pad * k_channels, row_size, rows.data() + y * row_size);
+    });
+
+    // Columns, a strip at a time.
+    std::size_t strip_width = k_strip_width;
+    if constexpr (is_tiled_image_v<DstImage>) {
+        using View              = std::remove_const_t<decltype(view(std::declval<DstImage&>()))>;
+        constexpr std::size_t tw = View::tile_width;
+        strip_width              = (strip_width + tw - 1) / tw * tw;
+    }
+    const std::size_t strips = (width + strip_width - 1) / strip_width;
+    for_each_index(policy, std::size_t{ 0 }, strips, [&](std::size_t strip) {
+        const std::size_t x0         = strip * strip_width;
+        const std::size_t w          = std::min(strip_width, width - x0);
+        const std::size_t strip_size = w * k_channels;
+        const std::size_t length     = height + 2 * pad;
+
+        std::vector<float> columns(length * strip_size);
+        for (std::size_t j = 0; j < length; ++j) {
+            const auto y = border_index(static_cast<std::int64_t>(j) - static_cast<std::int64_t>(pad),
+                                        static_cast<std::int64_t>(height),
+                                        border);
+            std::copy_n(rows.data() + y * row_size + x0 * k_channels, strip_size, columns.data() + j * strip_size);
+        }
+        filter.filter(columns.data(), length, strip_size);
+        store_block(dst,
+                    static_cast<size_type>(x0),
+                    size_type{ 0 },
+                    static_cast<size_type>(w),
+                    static_cast<size_type>(height),
+                    columns.data() + pad * strip_size);
+    });
+}
+} // namespace filter_detail
+
+// Convolves src with horizontal along the rows and vertical down the columns, into dst of the same dimensions.
+template <typename ExecutionPolicy, typename DstImage, typename SrcImage>
+requires is_execution_policy_v<ExecutionPolicy>
+void convolve_separable(ExecutionPolicy&& policy,
+                        DstImage&&        dst,
+                        const SrcImage&   src,
+                        const Kernel1D&   horizontal,
+                        const Kernel1D&   vertical,
+                        BorderMode        border = BorderMode::clamp)
+{
+    IMAGE_LIBRARY_TIMED_SCOPE("convolve_separable");
+    filter_detail::convolve_stages(policy, dst, src, { horizontal }, { vertical }, border);
+}
+
+template <typename DstImage, typename SrcImage>
+requires(!is_execution_policy_v<DstImage>)
+void convolve_separable(DstImage&&      dst,
+                        const SrcImage& src,
+                        const Kernel1D& horizontal,
+                        const Kernel1D& vertical,
+                        BorderMode      border = BorderMode::clamp)
+{
+    convolve_separable(std::execution::seq, dst, src, horizontal, vertical, border);
+}
+
+// Convolves src with a small square kernel, into dst of the same dimensions. Kernels that factor into a row and a
+// column are much cheaper through convolve_separable.
+template <typename ExecutionPolicy, typename DstImage, typename SrcImage>
+requires is_execution_policy_v<ExecutionPolicy>
+void convolve(ExecutionPolicy&& policy,
+              DstImage&&        dst,
+              const SrcImage&   src,
+              const Kernel2D&   kernel,
+              BorderMode        border = BorderMode::clamp)
+{
+    constexpr std::size_t k_channels = channel_count_v<typename std::remove_cvref_t<DstImage>::value_type>;
+    static_assert(filter_detail::same_channels_v<typename std::remove_cvref_t<DstImage>::value_type,
+                                                 typename SrcImage::value_type>,
+                  "Filtering keeps the channels of the source");
+    assert(dst.width() == src.width() && dst.height() == src.height());
+
+    IMAGE_LIBRARY_TIMED_SCOPE("convolve");
+    if (dst.width() == 0 || dst.height() == 0) {
+        return;
+    }
+
+    const std::uint32_t r    = kernel.radius();
+    const auto          size = filter_detail::block_size<std::remove_reference_t<DstImage>>(r);
+
+    filter_detail::for_each_block(policy, dst, size, [&](auto x0, auto y0, auto width, auto height) {
+        const std::size_t line_size = (std::size_t{ width } + 2 * r) * k_channels;
+        const std::size_t row_size  = std::size_t{ width } * k_channels;
+        const std::size_t rows      = std::size_t{ height } + 2 * r;
+
+        filter_detail::Scratch& scratch = filter_detail::thread_scratch();
+        std::vector<float>&     lines   = scratch.block;
+        lines.resize(rows * line_size);
+        for (std::size_t j = 0; j < rows; ++j) {
+            filter_detail::load_row(src,
+                                    static_cast<std::int64_t>(y0) + static_cast<std::int64_t>(j) - r,
+                                    static_cast<std::int64_t>(x0) - r,
+                                    std::size_t{ width } + 2 * r,
+                                    border,
+                                    lines.data() + j * line_size);
+        }
+
+        std::vector<float>& out = scratch.out;
+        out.assign(std::size_t{ height } * row_size, 0.0f);
+        for (std::size_t j = 0; j < height; ++j) {
+            float* const row = out.data() + j * row_size;
+            for (std::uint32_t ky = 0; ky < kernel.size(); ++ky) {
+                for (std::uint32_t kx = 0; kx < kernel.size(); ++kx) {
+                    const float        w   = kernel(kx, ky);
+                    const float* const tap = lines.data() + (j + ky) * line_size + kx * k_channels;
+                    for (std::size_t i = 0; i < row_size; ++i) {
+                        row[i] += w * tap[i];
+                    }
+                }
+            }
+        }
+        filter_detail::store_block(dst, x0, y0, width, height, out.data());
+    });
+}
+
+template <typename DstImage, typename SrcImage>
+requires(!is_execution_policy_v<DstImage>)
+void convolve(DstImage&& dst, const SrcImage& src, const Kernel2D& kernel, BorderMode border = BorderMode::clamp)
+{
+    convolve(std::execution::seq, dst, src, kernel, border);
+}
+
+// Blurs src with a Gaussian of standard deviation sigma, in pixels, into dst of the same dimensions. Throws
+// std::invalid_argument unless sigma is positive.
+template <typename ExecutionPolicy, typename DstImage, typename SrcImage>
+requires is_execution_policy_v<ExecutionPolicy>
+void gaussian_blur(ExecutionPolicy&& policy,
+                   DstImage&&        dst,
+                   const SrcImage&   src,
+                   float             sigma,
+                   BlurMethod        method = BlurMethod::automatic,
+                   BorderMode        border = BorderMode::clamp)
+{
+    if (!(sigma > 0.0f)) {
+        throw std::invalid_argument("Sigma has to be positive");
+    }
+    IMAGE_LIBRARY_TIMED_SCOPE("gaussian_blur");
+
+    if (method == BlurMethod::automatic) {
+        method = (sigma < 2.0f) ? BlurMethod::kernel : BlurMethod::box;
+    }
+    // The box and recursive approximations are poor below about half a pixel.
+    if (sigma < 0.5f) {
+        method = BlurMethod::kernel;
+    }
+
+    switch (method) {
+    case BlurMethod::box: {
+        const auto boxes = filter_detail::gaussian_boxes(sigma);
+        filter_detail::convolve_stages(policy, dst, src, boxes, boxes, border);
+        break;
+    }
+    case BlurMethod::recursive:
+        filter_detail::recursive_gaussian(policy, dst, src, sigma, border);
+        break;
+    default: {
+        const auto kernel = gaussian_kernel(sigma);
+        filter_detail::convolve_stages(policy, dst, src, { kernel }, { kernel }, border);
+        break;
+    }
+    }
+}
+
+template <typename DstImage, typename SrcImage>
+requires(!is_execution_policy_v<DstImage>)
+void gaussian_blur(DstImage&&      dst,
+                   const SrcImage& src,
+                   float           sigma,
+                   BlurMethod      method = BlurMethod::automatic,
+                   BorderMode      border = BorderMode::clamp)
+{
+    gaussian_blur(std::execution::seq, dst, src, sigma, method, border);
+}
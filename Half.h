@@ -0,0 +1,181 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// GCC and Clang define __F16C__ with -mf16c (or a -march that has it); -mavx2 alone does not enable it. MSVC never
+// defines __F16C__, but every CPU with AVX2 has F16C.
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+    #include <immintrin.h>
+    #define IMAGE_LIBRARY_F16C 1
+#endif
+
+#if defined(__STDCPP_FLOAT16_T__)
+    #include <stdfloat>
+#endif
+
+// IEEE 754 binary16 <-> binary32, rounding to nearest even. These are only used where the compiler does not provide
+// std::float16_t and for the scalar tails of the bulk conversions below.
+constexpr std::uint16_t float_to_half_bits(float f) noexcept
+{
+    const std::uint32_t x    = std::bit_cast<std::uint32_t>(f);
+    const std::uint32_t sign = (x >> 16u) & 0x8000u;
+    const std::uint32_t abs  = x & 0x7FFF'FFFFu;
+
+    if (abs >= 0x7F80'0000u) {
+        // Infinity stays infinity; NaN keeps its top payload bits and stays quiet.
+        const std::uint32_t nan = (abs > 0x7F80'0000u) ? (0x200u | ((abs >> 13u) & 0x3FFu)) : 0u;
+        return static_cast<std::uint16_t>(sign | 0x7C00u | nan);
+    }
+    if (abs >= 0x477F'F000u) {
+        // At least halfway between the largest half (65504) and the next power of two.
+        return static_cast<std::uint16_t>(sign | 0x7C00u);
+    }
+    if (abs < 0x3880'0000u) {
+        // Below the smallest normal half (2^-14): the result is subnormal or zero.
+        if (abs < 0x3300'0000u) {
+            return static_cast<std::uint16_t>(sign);
+        }
+        const std::uint32_t exponent = abs >> 23u;
+        const std::uint32_t mantissa = (abs & 0x7F'FFFFu) | 0x80'0000u;
+        const std::uint32_t shift    = 126u - exponent;
+        const std::uint32_t rest     = mantissa & ((1u << shift) - 1u);
+        const std::uint32_t halfway  = 1u << (shift - 1u);
+        std::uint32_t       h        = mantissa >> shift;
+        if (rest > halfway || (rest == halfway && (h & 1u))) {
+            ++h;
+        }
+        return static_cast<std::uint16_t>(sign | h);
+    }
+
+    // Re-bias the exponent from 127 to 15. A carry out of the mantissa correctly bumps the exponent.
+    std::uint32_t       h    = (abs - 0x3800'0000u) >> 13u;
+    const std::uint32_t rest = abs & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (h & 1u))) {
+        ++h;
+    }
+    return static_cast<std::uint16_t>(sign | h);
+}
+
+constexpr float half_bits_to_float(std::uint16_t h) noexcept
+{
+    const std::uint32_t sign     = (static_cast<std::uint32_t>(h) & 0x8000u) << 16u;
+    const std::uint32_t exponent = (h >> 10u) & 0x1Fu;
+    std::uint32_t       mantissa = h & 0x3FFu;
+
+    std::uint32_t bits = sign;
+    if (exponent == 0) {
+        if (mantissa != 0) {
+            // Subnormal: normalize.
+            std::uint32_t e = 0;
+            while (!(mantissa & 0x400u)) {
+                mantissa <<= 1u;
+                ++e;
+            }
+            bits |= ((113u - e) << 23u) | ((mantissa & 0x3FFu) << 13u);
+        }
+    } else if (exponent == 0x1Fu) {
+        bits |= 0x7F80'0000u | (mantissa << 13u);
+    } else {
+        bits |= ((exponent + 112u) << 23u) | (mantissa << 13u);
+    }
+    return std::bit_cast<float>(bits);
+}
+
+#if defined(__STDCPP_FLOAT16_T__)
+using half = std::float16_t;
+#else
+// A storage-only stand-in for std::float16_t. All arithmetic is done in float through the implicit conversion.
+class half
+{
+public:
+    constexpr half() noexcept = default;
+
+    constexpr half(float f) noexcept
+    : m_bits(float_to_half_bits(f))
+    {
+    }
+
+    constexpr operator float() const noexcept
+    {
+        return half_bits_to_float(m_bits);
+    }
+
+    half& operator+=(float f) noexcept
+    {
+        return *this = half(static_cast<float>(*this) + f);
+    }
+
+    half& operator-=(float f) noexcept
+    {
+        return *this = half(static_cast<float>(*this) - f);
+    }
+
+    half& operator*=(float f) noexcept
+    {
+        return *this = half(static_cast<float>(*this) * f);
+    }
+
+    half& operator/=(float f) noexcept
+    {
+        return *this = half(static_cast<float>(*this) / f);
+    }
+
+private:
+    std::uint16_t m_bits{ 0 };
+};
+#endif
+
+static_assert(sizeof(half) == 2);
+static_assert(std::is_trivially_copyable_v<half>);
+
+template <typename T>
+inline constexpr bool is_floating_point_channel_v = std::is_floating_point_v<T> || std::is_same_v<T, half>;
+
+// The type arithmetic on a channel type is done in: half and integer channels promote to float, so that, e.g., an
+// 8-bit channel times 1.5f neither truncates nor wraps around; float and double are left alone.
+template <typename T>
+struct promoted_channel
+{
+    using type = std::conditional_t<std::is_integral_v<T>, float, T>;
+};
+
+template <>
+struct promoted_channel<half>
+{
+    using type = float;
+};
+
+template <typename T>
+using promoted_channel_t = typename promoted_channel<T>::type;
+
+// Bulk conversions of n values. These use F16C eight at a time when the target supports it.
+inline void convert_half_to_float(const half* src, float* dst, std::size_t n) noexcept
+{
+    std::size_t i = 0;
+#if defined(IMAGE_LIBRARY_F16C)
+    for (; i + 8 <= n; i += 8) {
+        const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = half_bits_to_float(std::bit_cast<std::uint16_t>(src[i]));
+    }
+}
+
+inline void convert_float_to_half(const float* src, half* dst, std::size_t n) noexcept
+{
+    std::size_t i = 0;
+#if defined(IMAGE_LIBRARY_F16C)
+    for (; i + 8 <= n; i += 8) {
+        const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = std::bit_cast<half>(float_to_half_bits(src[i]));
+    }
+}
@@ -6,22 +6,39 @@
 
 #include "Array2D.h"
 #include "Endian.h"
-#include "IgnoreLineCommentsBuf.h"
+#include "ImageView.h"
+#include "Instrumentation.h"
+#include "Parallel.h"
+#include "PixelTraits.h"
 #include "RGB.h"
 #include "RGBA.h"
 
+#include <array>
 #include <cassert>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <execution>
 #include <filesystem>
 #include <fstream>
+#include <limits>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <vector>
 
 enum class ImageFormat
 {
     unknown,
-    PPM_binary,
-    PPM_ascii,
-    PFM
+    PPM_binary, // P6
+    PPM_ascii,  // P3
+    PFM,        // PF (color) and Pf (gray)
+    PBM_ascii,  // P1
+    PGM_ascii,  // P2
+    PBM_binary, // P4
+    PGM_binary, // P5
+    PAM         // P7
 };
 
 struct PNM_header
@@ -31,6 +48,7 @@ struct PNM_header
     std::uint32_t height{ 0 };
     std::endian   byte_order{ std::endian::big }; // 16-bit PPM is big: only PFM changes this
     std::uint16_t max_color{ 0 };
+    std::uint32_t channels{ 0 }; // 1: gray, 2: gray and alpha, 3: RGB, 4: RGBA
 };
 
 class ImageError : public std::runtime_error
@@ -40,44 +58,115 @@ public:
 };
 
 using ImageSFC_RGBf = Array2DSFC<RGBf>;
+using ImageSFC_RGBh = Array2DSFC<RGBh>;
 using Image_RGBf    = Array2D<RGBf>;
+using Image_RGBh    = Array2D<RGBh>;
 using Image_RGB8    = Array2D<RGB8>;
 using Image_RGB16   = Array2D<RGB16>;
 using Image_RGB32   = Array2D<RGB32>;
 
 using ImageSFC_RGBAf = Array2DSFC<RGBAf>;
+using ImageSFC_RGBAh = Array2DSFC<RGBAh>;
 using Image_RGBAf    = Array2D<RGBAf>;
+using Image_RGBAh    = Array2D<RGBAh>;
 using Image_RGBA8    = Array2D<RGBA8>;
 using Image_RGBA16   = Array2D<RGBA16>;
 using Image_RGBA32   = Array2D<RGBA32>;
 
+using ImageSFC_Grayf = Array2DSFC<float>;
+using ImageSFC_Grayh = Array2DSFC<half>;
+using Image_Grayf    = Array2D<float>;
+using Image_Grayh    = Array2D<half>;
+using Image_Gray8    = Array2D<std::uint8_t>;
+using Image_Gray16   = Array2D<std::uint16_t>;
+using Image_Gray32   = Array2D<std::uint32_t>;
+
+// Images (of any container, index type and allocator, and views) whose pixels are gray, RGB or RGBA with float or half
+// channels: the images that PFM reads and writes.
 template <typename T>
 struct is_floating_point_image : public std::false_type
 {
 };
 
-template <>
-struct is_floating_point_image<ImageSFC_RGBf> : public std::true_type
+template <typename T>
+requires requires { typename T::value_type; }
+struct is_floating_point_image<T>
+: public std::bool_constant<is_color_pixel_v<std::remove_const_t<typename T::value_type>> &&
+                            is_floating_point_channel_v<channel_type_t<std::remove_const_t<typename T::value_type>>>>
 {
 };
 
-template <>
-struct is_floating_point_image<ImageSFC_RGBAf> : public std::true_type
+template <typename T>
+inline constexpr bool is_floating_point_image_v = is_floating_point_image<T>::value;
+
+// Identifies pixel types in serialized data. The values are stored in files: do not renumber them.
+enum class PixelFormat : std::uint8_t
 {
+    unknown = 0,
+    RGB8    = 1,
+    RGB16   = 2,
+    RGB32   = 3,
+    RGBh    = 4,
+    RGBf    = 5,
+    RGBA8   = 6,
+    RGBA16  = 7,
+    RGBA32  = 8,
+    RGBAh   = 9,
+    RGBAf   = 10,
+    Gray8   = 11,
+    Gray16  = 12,
+    Gray32  = 13,
+    Grayh   = 14,
+    Grayf   = 15
 };
 
+template <typename Pixel>
+inline constexpr PixelFormat pixel_format_v = PixelFormat::unknown;
+
 template <>
-struct is_floating_point_image<Image_RGBf> : public std::true_type
-{
-};
+inline constexpr PixelFormat pixel_format_v<RGB8> = PixelFormat::RGB8;
 
 template <>
-struct is_floating_point_image<Image_RGBAf> : public std::true_type
-{
-};
+inline constexpr PixelFormat pixel_format_v<RGB16> = PixelFormat::RGB16;
 
-template <typename T>
-inline constexpr bool is_floating_point_image_v = is_floating_point_image<T>::value;
+template <>
+inline constexpr PixelFormat pixel_format_v<RGB32> = PixelFormat::RGB32;
+
+template <>
+inline constexpr PixelFormat pixel_format_v<RGBh> = PixelFormat::RGBh;
+
+template <>
+inline constexpr PixelFormat pixel_format_v<RGBf> = PixelFormat::RGBf;
+
+template <>
+inline constexpr PixelFormat pixel_format_v<RGBA8> = PixelFormat::RGBA8;
+
+template <>
+inline constexpr PixelFormat pixel_format_v<RGBA16> = PixelFormat::RGBA16;
+
+template <>
+inline constexpr PixelFormat pixel_format_v<RGBA32> = PixelFormat::RGBA32;
+
+template <>
+inline constexpr PixelFormat pixel_format_v<RGBAh> = PixelFormat::RGBAh;
+
+template <>
+inline constexpr PixelFormat pixel_format_v<RGBAf> = PixelFormat::RGBAf;
+
+template <>
+inline constexpr PixelFormat pixel_format_v<std::uint8_t> = PixelFormat::Gray8;
+
+template <>
+inline constexpr PixelFormat pixel_format_v<std::uint16_t> = PixelFormat::Gray16;
+
+template <>
+inline constexpr PixelFormat pixel_format_v<std::uint32_t> = PixelFormat::Gray32;
+
+template <>
+inline constexpr PixelFormat pixel_format_v<half> = PixelFormat::Grayh;
+
+template <>
+inline constexpr PixelFormat pixel_format_v<float> = PixelFormat::Grayf;
 
 inline float rgb_to_srgb(const float u) noexcept
 {
@@ -117,69 +206,243 @@ inline RGBAf srgb_to_rgb(const RGBAf& c) noexcept
     return { srgb_to_rgb(c.r), srgb_to_rgb(c.g), srgb_to_rgb(c.b), c.a };
 }
 
-class LineCommentStreamBufDecorator
+namespace pnm_detail {
+constexpr bool is_space(char c) noexcept
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Scans the whitespace-separated tokens of a PNM header, skipping '#' comments, which run to the end of the line.
+class HeaderScanner
 {
 public:
-    explicit LineCommentStreamBufDecorator(std::istream& ins)
-    : m_new_streambuf(ins.rdbuf())
-    , m_original_streambuf(ins.rdbuf())
-    , m_stream(std::addressof(ins))
+    explicit HeaderScanner(std::span<const char> bytes) noexcept
+    : m_bytes(bytes)
+    {
+    }
+
+    // Returns an empty token if the bytes end before the token does: we can't tell that the token is complete.
+    std::string_view next_token() noexcept
     {
-        ins.rdbuf(std::addressof(m_new_streambuf));
+        while (m_position < m_bytes.size()) {
+            const char c = m_bytes[m_position];
+            if (c == '#') {
+                while (m_position < m_bytes.size() && m_bytes[m_position] != '\n') {
+                    ++m_position;
+                }
+            } else if (is_space(c)) {
+                ++m_position;
+            } else {
+                break;
+            }
+        }
+
+        const std::size_t begin = m_position;
+        while (m_position < m_bytes.size() && !is_space(m_bytes[m_position]) && m_bytes[m_position] != '#') {
+            ++m_position;
+        }
+        if (m_position == m_bytes.size()) {
+            return {};
+        }
+        return { m_bytes.data() + begin, m_position - begin };
     }
 
-    ~LineCommentStreamBufDecorator()
+    // The position just after the single whitespace character that ends the header. Zero if it is missing.
+    std::size_t data_offset() const noexcept
     {
-        m_stream->rdbuf(m_original_streambuf);
+        return (m_position < m_bytes.size()) ? m_position + 1 : 0;
     }
 
 private:
-    IgnoreLineCommentsBuf m_new_streambuf;
-    std::streambuf*       m_original_streambuf;
-    std::istream*         m_stream;
+    std::span<const char> m_bytes;
+    std::size_t           m_position{ 0 };
 };
 
-// Post-condition: ins is set to read image data values.
-PNM_header read_pnm_header(std::istream& ins)
+template <typename T>
+T parse_number(std::string_view token)
 {
-    ins.seekg(0);
-
-    // Skip over comments in header reading by wrapping the stream in an RAII construct that changes out the streambuf.
-    LineCommentStreamBufDecorator stream_raii(ins);
+    T value{};
+    const auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (error != std::errc{} || end != token.data() + token.size()) {
+        throw ImageError("Malformed header value: " + std::string(token));
+    }
+    return value;
+}
+} // namespace pnm_detail
 
-    PNM_header header;
+namespace pnm_detail {
+// PAM headers are keyword and value pairs, in any order, up to ENDHDR.
+inline std::size_t parse_pam_header(HeaderScanner& scanner, PNM_header& header)
+{
+    bool has_max_color = false;
+    for (;;) {
+        const auto keyword = scanner.next_token();
+        if (keyword.empty()) {
+            return 0;
+        }
+        if (keyword == "ENDHDR") {
+            break;
+        }
+        const auto value = scanner.next_token();
+        if (value.empty()) {
+            return 0;
+        }
+        if (keyword == "WIDTH") {
+            header.width = parse_number<std::uint32_t>(value);
+        } else if (keyword == "HEIGHT") {
+            header.height = parse_number<std::uint32_t>(value);
+        } else if (keyword == "DEPTH") {
+            header.channels = parse_number<std::uint32_t>(value);
+        } else if (keyword == "MAXVAL") {
+            header.max_color = parse_number<std::uint16_t>(value);
+            has_max_color    = true;
+        } else if (keyword != "TUPLTYPE") {
+            // The tuple type is implied by the depth for the types we support.
+            throw ImageError("Unexpected PAM header field: " + std::string(keyword));
+        }
+    }
 
-    std::string format;
-    ins >> format;
+    if (header.channels < 1 || header.channels > 16 || !has_max_color || header.max_color == 0) {
+        throw ImageError("Unsupported PAM header");
+    }
+    return scanner.data_offset();
+}
+} // namespace pnm_detail
 
-    if (format == "P3") {
-        header.format = ImageFormat::PPM_ascii;
+// Parses the header at the start of bytes. Returns the offset of the first byte of image data, or zero if bytes ends
+// before the header does, in which case the caller may retry with more of the file. Unrecognized formats leave
+// header.format as unknown and return a non-zero offset.
+inline std::size_t parse_pnm_header(std::span<const char> bytes, PNM_header& header)
+{
+    pnm_detail::HeaderScanner scanner(bytes);
+
+    header = PNM_header{};
+
+    const auto format = scanner.next_token();
+    if (format.empty()) {
+        return 0;
+    } else if (format == "P1") {
+        header.format   = ImageFormat::PBM_ascii;
+        header.channels = 1;
+    } else if (format == "P2") {
+        header.format   = ImageFormat::PGM_ascii;
+        header.channels = 1;
+    } else if (format == "P3") {
+        header.format   = ImageFormat::PPM_ascii;
+        header.channels = 3;
+    } else if (format == "P4") {
+        header.format   = ImageFormat::PBM_binary;
+        header.channels = 1;
+    } else if (format == "P5") {
+        header.format   = ImageFormat::PGM_binary;
+        header.channels = 1;
     } else if (format == "P6") {
-        header.format = ImageFormat::PPM_binary;
+        header.format   = ImageFormat::PPM_binary;
+        header.channels = 3;
+    } else if (format == "P7") {
+        header.format = ImageFormat::PAM;
+        return pnm_detail::parse_pam_header(scanner, header);
     } else if (format == "PF") {
-        header.format = ImageFormat::PFM;
+        header.format   = ImageFormat::PFM;
+        header.channels = 3;
+    } else if (format == "Pf") {
+        header.format   = ImageFormat::PFM;
+        header.channels = 1;
     } else {
-        return header;
+        return format.size();
     }
 
-    ins >> header.width;
-    ins >> header.height;
+    const auto width  = scanner.next_token();
+    const auto height = scanner.next_token();
+    if (height.empty()) {
+        return 0;
+    }
+    header.width  = pnm_detail::parse_number<std::uint32_t>(width);
+    header.height = pnm_detail::parse_number<std::uint32_t>(height);
+
+    // Bitmaps have no maximum value.
+    if (header.format == ImageFormat::PBM_ascii || header.format == ImageFormat::PBM_binary) {
+        header.max_color = 1;
+        return scanner.data_offset();
+    }
 
+    const auto last = scanner.next_token();
+    if (last.empty()) {
+        return 0;
+    }
     if (header.format == ImageFormat::PFM) {
-        float byte_order;
-        ins >> byte_order;
-        header.byte_order = (byte_order > 0) ? std::endian::big : std::endian::little;
+        const auto byte_order = pnm_detail::parse_number<float>(last);
+        header.byte_order     = (byte_order > 0) ? std::endian::big : std::endian::little;
     } else {
-        ins >> header.max_color;
+        header.max_color = pnm_detail::parse_number<std::uint16_t>(last);
     }
-    ins.get(); // Get final whitespace character
 
+    return scanner.data_offset();
+}
+
+namespace pnm_detail {
+constexpr std::size_t k_probe_size     = 4096;
+constexpr std::size_t k_max_header_size = 1 << 20;
+
+// Reads from the current position in blocks until the header is complete, and returns the offset of the image data
+// relative to where we started.
+template <typename Read>
+std::size_t read_header_blocks(PNM_header& header, Read read)
+{
+    std::vector<char> buffer;
+    for (std::size_t size = k_probe_size;; size *= 2) {
+        const std::size_t old_size = buffer.size();
+        buffer.resize(size);
+        const std::size_t count = read(buffer.data() + old_size, size - old_size);
+        buffer.resize(old_size + count);
+
+        if (const std::size_t offset = parse_pnm_header(buffer, header)) {
+            return offset;
+        }
+        if (buffer.size() < size || size >= k_max_header_size) {
+            throw ImageError("Incomplete header");
+        }
+    }
+}
+} // namespace pnm_detail
+
+// Post-condition: ins is set to read image data values.
+inline PNM_header read_pnm_header(std::istream& ins)
+{
+    IMAGE_LIBRARY_TIMED_SCOPE("read_pnm_header");
+    ins.seekg(0);
+
+    PNM_header        header;
+    const std::size_t offset = pnm_detail::read_header_blocks(header, [&ins](char* data, std::size_t count) {
+        ins.read(data, static_cast<std::streamsize>(count));
+        return static_cast<std::size_t>(ins.gcount());
+    });
+
+    ins.clear();
+    ins.seekg(static_cast<std::streamoff>(offset));
+    IMAGE_LIBRARY_COUNT(bytes_read, offset);
+    return header;
+}
+
+// Reads just enough of the file (usually a single block) to return its header.
+inline PNM_header probe_image(const std::filesystem::path& file)
+{
+    std::ifstream ins(file, std::ios_base::binary | std::ios_base::in);
+    if (!ins) {
+        throw ImageError("Unable to open " + file.string());
+    }
+    PNM_header header;
+    pnm_detail::read_header_blocks(header, [&ins](char* data, std::size_t count) {
+        ins.read(data, static_cast<std::streamsize>(count));
+        return static_cast<std::size_t>(ins.gcount());
+    });
     return header;
 }
 
 template <typename ImageType>
 inline void write_ppm_8(std::ostream& outs, const ImageType& img)
 {
+    IMAGE_LIBRARY_TIMED_SCOPE("write_ppm_8");
     constexpr uint8_t max_value = 255;
 
     const int nx = img.width();
@@ -198,11 +461,14 @@ inline void write_ppm_8(std::ostream& outs, const ImageType& img)
             outs.write(reinterpret_cast<const char*>(&ib), sizeof(uint8_t));
         }
     }
+    IMAGE_LIBRARY_COUNT(pixels_converted, std::uint64_t{ img.width() } * img.height());
+    IMAGE_LIBRARY_COUNT(bytes_written, std::uint64_t{ img.width() } * img.height() * 3 * sizeof(uint8_t));
 }
 
 template <typename ImageType>
 inline void write_ppm_16(std::ostream& outs, const ImageType& img)
 {
+    IMAGE_LIBRARY_TIMED_SCOPE("write_ppm_16");
     constexpr uint16_t max_value = 65'535;
 
     const int nx = img.width();
@@ -221,25 +487,98 @@ inline void write_ppm_16(std::ostream& outs, const ImageType& img)
             outs.write(reinterpret_cast<const char*>(&ib), sizeof(uint16_t));
         }
     }
+    IMAGE_LIBRARY_COUNT(pixels_converted, std::uint64_t{ img.width() } * img.height());
+    IMAGE_LIBRARY_COUNT(bytes_written, std::uint64_t{ img.width() } * img.height() * 3 * sizeof(uint16_t));
 }
 
-template <typename ImageType>
-inline void write_plain_ppm(std::ostream& outs, const ImageType& img)
+namespace pnm_detail {
+// The decimal text of 0 to 255 followed by a separator, padded to four bytes so that it can be copied as one word.
+struct DecimalEntry
 {
-    const int nx = img.width();
-    const int ny = img.height();
+    std::array<char, 4> text;
+    std::uint8_t        size; // Including the separator
+};
+
+inline constexpr std::array<DecimalEntry, 256> k_decimal_bytes = [] {
+    std::array<DecimalEntry, 256> table{};
+    for (int v = 0; v < 256; ++v) {
+        auto&       e = table[v];
+        std::size_t n = 0;
+        if (v >= 100) {
+            e.text[n++] = static_cast<char>('0' + v / 100);
+        }
+        if (v >= 10) {
+            e.text[n++] = static_cast<char>('0' + v / 10 % 10);
+        }
+        e.text[n++] = static_cast<char>('0' + v % 10);
+        e.text[n++] = ' ';
+        e.size      = static_cast<std::uint8_t>(n);
+    }
+    return table;
+}();
+
+// Appends v and a space at out, and returns the position after them. There have to be four writable bytes at out.
+inline char* append_decimal_byte(char* out, std::uint8_t v) noexcept
+{
+    const auto& e = k_decimal_bytes[v];
+    std::memcpy(out, e.text.data(), e.text.size());
+    return out + e.size;
+}
+
+constexpr std::uint32_t k_plain_band_rows = 64;
+} // namespace pnm_detail
+
+// Each row is formatted into its own buffer, a band of rows at a time, and then written out in order.
+template <typename ExecutionPolicy, typename ImageType>
+requires is_execution_policy_v<ExecutionPolicy>
+inline void write_plain_ppm(ExecutionPolicy&& policy, std::ostream& outs, const ImageType& img)
+{
+    IMAGE_LIBRARY_TIMED_SCOPE("write_plain_ppm");
+
+    using size_type = typename ImageType::size_type;
+
+    const size_type nx = img.width();
+    const size_type ny = img.height();
     println(outs, "P3");
     println(outs, "{} {}", nx, ny);
     println(outs, "255");
-    for (int j = ny - 1; j >= 0; --j) {
-        for (int i = 0; i < nx; ++i) {
-            const RGBf c  = rgb_to_srgb(clamp(to_float(img(i, j))));
-            const auto ir = static_cast<int>(255.0f * c.r);
-            const auto ig = static_cast<int>(255.0f * c.g);
-            const auto ib = static_cast<int>(255.0f * c.b);
-            std::println(outs, "{} {} {}", ir, ig, ib);
+
+    // Three values of at most three digits, each with a separator.
+    const std::size_t max_row_size = std::size_t{ nx } * 12;
+
+    std::vector<std::string> rows(std::min<size_type>(ny, pnm_detail::k_plain_band_rows));
+    for (size_type band = 0; band < ny; band += pnm_detail::k_plain_band_rows) {
+        const size_type band_rows = std::min<size_type>(pnm_detail::k_plain_band_rows, ny - band);
+        for_each_index(policy, size_type{ 0 }, band_rows, [&](size_type r) {
+            const size_type j = ny - 1 - (band + r);
+
+            std::string& row = rows[r];
+            row.resize(max_row_size);
+            char* out = row.data();
+            for (size_type i = 0; i < nx; ++i) {
+                const RGBf c  = rgb_to_srgb(clamp(to_float(img(i, j))));
+                const auto ir = static_cast<std::uint8_t>(255.0f * c.r);
+                const auto ig = static_cast<std::uint8_t>(255.0f * c.g);
+                const auto ib = static_cast<std::uint8_t>(255.0f * c.b);
+                out           = pnm_detail::append_decimal_byte(out, ir);
+                out           = pnm_detail::append_decimal_byte(out, ig);
+                out           = pnm_detail::append_decimal_byte(out, ib);
+                out[-1]       = '\n';
+            }
+            row.resize(static_cast<std::size_t>(out - row.data()));
+        });
+        for (size_type r = 0; r < band_rows; ++r) {
+            outs.write(rows[r].data(), static_cast<std::streamsize>(rows[r].size()));
+            IMAGE_LIBRARY_COUNT(bytes_written, rows[r].size());
         }
     }
+    IMAGE_LIBRARY_COUNT(pixels_converted, std::uint64_t{ nx } * ny);
+}
+
+template <typename ImageType>
+inline void write_plain_ppm(std::ostream& outs, const ImageType& img)
+{
+    write_plain_ppm(std::execution::seq, outs, img);
 }
 
 template <typename ImageType>
@@ -262,33 +601,108 @@ inline void write_ppm_16(const std::filesystem::path& file, const ImageType& img
     write_ppm_16(outs, img);
 }
 
-template <typename ImageType>
-inline void write_plain_ppm(const std::filesystem::path& file, const ImageType& img)
+template <typename ExecutionPolicy, typename ImageType>
+requires is_execution_policy_v<ExecutionPolicy>
+inline void write_plain_ppm(ExecutionPolicy&& policy, const std::filesystem::path& file, const ImageType& img)
 {
     std::ofstream outs(file, std::ios_base::binary | std::ios_base::out);
     if (!outs) {
         throw ImageError("Unable to open " + file.string());
     }
-    write_plain_ppm(outs, img);
+    write_plain_ppm(policy, outs, img);
+}
+
+template <typename ImageType>
+inline void write_plain_ppm(const std::filesystem::path& file, const ImageType& img)
+{
+    write_plain_ppm(std::execution::seq, file, img);
+}
+
+namespace pnm_detail {
+// Widens a row of count pixels to the channels samples per pixel of a PFM row. Half channels are converted in bulk;
+// alpha, if any, is dropped.
+template <std::size_t channels, typename Pixel>
+void pfm_row(const Pixel* row, std::size_t count, float* out, std::vector<float>& wide)
+{
+    using Channel = channel_type_t<Pixel>;
+
+    constexpr std::size_t pixel_channels = channel_count_v<Pixel>;
+    static_assert(sizeof(Pixel) == pixel_channels * sizeof(Channel), "Pixels are packed channels");
+
+    const auto* const samples = reinterpret_cast<const Channel*>(row);
+    float*            dst     = out;
+    if constexpr (pixel_channels != channels) {
+        wide.resize(count * pixel_channels);
+        dst = wide.data();
+    }
+    if constexpr (std::is_same_v<Channel, half>) {
+        convert_half_to_float(samples, dst, count * pixel_channels);
+    } else {
+        std::copy_n(samples, count * pixel_channels, dst);
+    }
+    if constexpr (pixel_channels != channels) {
+        for (std::size_t i = 0; i < count; ++i) {
+            std::copy_n(dst + i * pixel_channels, channels, out + i * channels);
+        }
+    }
 }
+} // namespace pnm_detail
 
+// PFM is always 32-bit float: half images are widened a scanline at a time. Gray images are written as Pf, one sample
+// per pixel; RGB and RGBA as PF, without alpha. Row-major images and views are converted a row at a time, and tiled
+// ones a tile row at a time through a row-major band.
 template <typename ImageType>
 requires is_floating_point_image_v<ImageType>
 inline void write_pfm(std::ostream& outs, const ImageType& img)
 {
-    constexpr int byte_order = (std::endian::native == std::endian::little) ? -1 : +1;
-
-    const int nx = img.width();
-    const int ny = img.height();
-    outs << "PF\n" << nx << ' ' << ny << '\n' << byte_order << '\n';
-    for (int j = ny - 1; j >= 0; --j) {
-        for (int i = 0; i < nx; ++i) {
-            const auto& c = img(i, j);
-            outs.write(reinterpret_cast<const char*>(&c.r), sizeof(float));
-            outs.write(reinterpret_cast<const char*>(&c.g), sizeof(float));
-            outs.write(reinterpret_cast<const char*>(&c.b), sizeof(float));
+    IMAGE_LIBRARY_TIMED_SCOPE("write_pfm");
+    using Pixel = std::remove_const_t<typename ImageType::value_type>;
+
+    constexpr int         byte_order = (std::endian::native == std::endian::little) ? -1 : +1;
+    constexpr std::size_t channels   = (channel_count_v<Pixel> == 1) ? 1 : 3;
+
+    const std::uint32_t nx = img.width();
+    const std::uint32_t ny = img.height();
+    outs << ((channels == 1) ? "Pf\n" : "PF\n") << nx << ' ' << ny << '\n' << byte_order << '\n';
+
+    std::vector<float> scanline(channels * nx);
+    std::vector<float> wide;
+    const auto         write_row = [&](const Pixel* row) {
+        pnm_detail::pfm_row<channels>(row, nx, scanline.data(), wide);
+        outs.write(reinterpret_cast<const char*>(scanline.data()),
+                   static_cast<std::streamsize>(scanline.size() * sizeof(float)));
+    };
+
+    if constexpr (is_tiled_image_v<const ImageType>) {
+        constexpr std::uint32_t tile_height = ImageType::tile_height;
+        Array2D<Pixel>          band(nx, tile_height);
+        for (std::uint32_t tile_y = (ny + tile_height - 1) / tile_height; tile_y-- > 0;) {
+            const std::uint32_t y0   = tile_y * tile_height;
+            const std::uint32_t rows = std::min(tile_height, ny - y0);
+            blit(crop(band, 0, 0, nx, rows), crop(img, 0, y0, nx, rows));
+            for (std::uint32_t i = rows; i-- > 0;) {
+                write_row(&band(0, i));
+            }
+        }
+    } else if constexpr (viewable_image<const ImageType>) {
+        const auto rows = view(img);
+        for (std::uint32_t j = ny; j-- > 0;) {
+            write_row(rows.row(j));
+        }
+    } else {
+        for (std::uint32_t j = ny; j-- > 0;) {
+            for (std::uint32_t i = 0; i < nx; ++i) {
+                const Pixel& p = img(i, j);
+                for (std::uint32_t c = 0; c < channels; ++c) {
+                    scanline[channels * i + c] = static_cast<float>(pixel_channel(p, c));
+                }
+            }
+            outs.write(reinterpret_cast<const char*>(scanline.data()),
+                       static_cast<std::streamsize>(scanline.size() * sizeof(float)));
         }
     }
+    IMAGE_LIBRARY_COUNT(pixels_converted, std::uint64_t{ img.width() } * img.height());
+    IMAGE_LIBRARY_COUNT(bytes_written, std::uint64_t{ img.width() } * img.height() * channels * sizeof(float));
 }
 
 template <typename ImageType>
@@ -303,51 +717,450 @@ inline void write_pfm(const std::filesystem::path& file,
     write_pfm(outs, img);
 }
 
-// This would work with floating-point images if we simply changed the conversion function to [0, 1]
+namespace pnm_detail {
+template <typename Channel>
+float channel_to_unit(Channel v) noexcept
+{
+    if constexpr (is_floating_point_channel_v<Channel>) {
+        return static_cast<float>(v);
+    } else {
+        return static_cast<float>(v) / static_cast<float>(std::numeric_limits<Channel>::max());
+    }
+}
+
+// Writes the samples of every pixel, a row at a time. RGB is sRGB encoded as with write_ppm_8; gray, alpha and generic
+// channels are linear. Samples are rounded to nearest, so read_pnm gives back the values of gray, alpha and generic
+// channels exactly, and of RGB channels wherever the 8- or 16-bit sRGB encoding tells the values apart.
+template <typename Sample, typename ImageType>
+void write_binary_samples(std::ostream& outs, const ImageType& img)
+{
+    IMAGE_LIBRARY_TIMED_SCOPE("write_binary_samples");
+    using size_type = typename ImageType::size_type;
+    using Pixel     = typename ImageType::value_type;
+
+    constexpr auto        max_value = std::numeric_limits<Sample>::max();
+    constexpr std::size_t channels  = channel_count_v<Pixel>;
+
+    const size_type           nx = img.width();
+    const size_type           ny = img.height();
+    std::vector<std::uint8_t> row(std::size_t{ nx } * channels * sizeof(Sample));
+
+    for (size_type r = 0; r < ny; ++r) {
+        std::uint8_t* out = row.data();
+        for (size_type x = 0; x < nx; ++x) {
+            const Pixel& p = img(x, ny - 1 - r);
+            for (std::uint32_t c = 0; c < channels; ++c) {
+                float unit = std::clamp(channel_to_unit(pixel_channel(p, c)), 0.0f, 1.0f);
+                if (is_color_pixel_v<Pixel> && channels >= 3 && c < 3) {
+                    unit = rgb_to_srgb(unit);
+                }
+                const auto v = static_cast<Sample>(max_value * unit + 0.5f);
+                if constexpr (sizeof(Sample) == 2) {
+                    *out++ = static_cast<std::uint8_t>(v >> 8u);
+                }
+                *out++ = static_cast<std::uint8_t>(v);
+            }
+        }
+        outs.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+    }
+    IMAGE_LIBRARY_COUNT(pixels_converted, std::uint64_t{ nx } * ny);
+    IMAGE_LIBRARY_COUNT(bytes_written, std::uint64_t{ ny } * row.size());
+}
+
+template <typename Sample, typename ImageType>
+void write_pgm(std::ostream& outs, const ImageType& img)
+{
+    static_assert(channel_count_v<typename ImageType::value_type> == 1, "PGM holds single-channel images");
+    outs << "P5\n" << img.width() << ' ' << img.height() << '\n' << +std::numeric_limits<Sample>::max() << '\n';
+    write_binary_samples<Sample>(outs, img);
+}
+
+template <typename Sample, typename ImageType>
+void write_pam(std::ostream& outs, const ImageType& img)
+{
+    using Pixel = typename ImageType::value_type;
+
+    constexpr std::size_t channels = channel_count_v<Pixel>;
+
+    outs << "P7\nWIDTH " << img.width() << "\nHEIGHT " << img.height() << "\nDEPTH " << channels << "\nMAXVAL "
+         << +std::numeric_limits<Sample>::max() << '\n';
+    if constexpr (is_color_pixel_v<Pixel>) {
+        outs << "TUPLTYPE " << ((channels == 1) ? "GRAYSCALE" : (channels == 3) ? "RGB" : "RGB_ALPHA") << '\n';
+    }
+    outs << "ENDHDR\n";
+    write_binary_samples<Sample>(outs, img);
+}
+
+template <typename Function>
+void write_file(const std::filesystem::path& file, Function write)
+{
+    std::ofstream outs(file, std::ios_base::binary | std::ios_base::out);
+    if (!outs) {
+        throw ImageError("Unable to open " + file.string());
+    }
+    write(outs);
+}
+} // namespace pnm_detail
+
+// Single-channel images as binary PGM (P5).
 template <typename ImageType>
-requires !is_floating_point_image_v<ImageType>
-inline ImageType read_ppm_8(std::istream & ins)
+inline void write_pgm_8(std::ostream& outs, const ImageType& img)
 {
-    constexpr auto max_value = std::numeric_limits<std::uint8_t>::max();
+    pnm_detail::write_pgm<std::uint8_t>(outs, img);
+}
 
-    using ColorType = typename ImageType::value_type;
+template <typename ImageType>
+inline void write_pgm_16(std::ostream& outs, const ImageType& img)
+{
+    pnm_detail::write_pgm<std::uint16_t>(outs, img);
+}
 
-    const auto header = read_pnm_header(ins);
+// Gray, RGB or RGBA images as PAM (P7). Unlike PPM, this keeps alpha.
+template <typename ImageType>
+inline void write_pam_8(std::ostream& outs, const ImageType& img)
+{
+    pnm_detail::write_pam<std::uint8_t>(outs, img);
+}
 
-    if (header.format != ImageFormat::PPM_binary) {
-        throw ImageError("Unexpected format");
+template <typename ImageType>
+inline void write_pam_16(std::ostream& outs, const ImageType& img)
+{
+    pnm_detail::write_pam<std::uint16_t>(outs, img);
+}
+
+template <typename ImageType>
+inline void write_pgm_8(const std::filesystem::path& file, const ImageType& img)
+{
+    pnm_detail::write_file(file, [&img](std::ostream& outs) { write_pgm_8(outs, img); });
+}
+
+template <typename ImageType>
+inline void write_pgm_16(const std::filesystem::path& file, const ImageType& img)
+{
+    pnm_detail::write_file(file, [&img](std::ostream& outs) { write_pgm_16(outs, img); });
+}
+
+template <typename ImageType>
+inline void write_pam_8(const std::filesystem::path& file, const ImageType& img)
+{
+    pnm_detail::write_file(file, [&img](std::ostream& outs) { write_pam_8(outs, img); });
+}
+
+template <typename ImageType>
+inline void write_pam_16(const std::filesystem::path& file, const ImageType& img)
+{
+    pnm_detail::write_file(file, [&img](std::ostream& outs) { write_pam_16(outs, img); });
+}
+
+namespace pnm_detail {
+// Reads from the current position to the end of the stream.
+inline std::vector<char> read_remaining(std::istream& ins)
+{
+    constexpr std::size_t k_block_size = 1 << 20;
+
+    std::vector<char> bytes;
+    while (ins) {
+        const std::size_t old_size = bytes.size();
+        bytes.resize(old_size + k_block_size);
+        ins.read(bytes.data() + old_size, k_block_size);
+        bytes.resize(old_size + static_cast<std::size_t>(ins.gcount()));
     }
+    return bytes;
+}
 
-    if (header.max_color > max_value) {
-        throw ImageError("Unexpected color depth");
+// Counts whitespace-separated tokens, or, for ASCII bitmaps, where samples need not be separated, digits.
+inline std::size_t count_samples(const char* first, const char* last, bool bitmap) noexcept
+{
+    std::size_t count    = 0;
+    bool        in_space = true;
+    for (; first != last; ++first) {
+        const bool space = is_space(*first);
+        count += !space && (in_space || bitmap);
+        in_space = space;
     }
+    return count;
+}
 
-    ImageType img(header.width, header.height);
+// Splits [0, size) into count chunks whose boundaries fall on whitespace, so that no token straddles two chunks.
+inline std::vector<std::size_t> whitespace_chunks(std::span<const char> bytes, std::size_t count)
+{
+    std::vector<std::size_t> bounds(count + 1);
+    bounds[0]     = 0;
+    bounds[count] = bytes.size();
+    for (std::size_t c = 1; c < count; ++c) {
+        std::size_t b = std::max(bytes.size() * c / count, bounds[c - 1]);
+        while (b < bytes.size() && !is_space(bytes[b])) {
+            ++b;
+        }
+        bounds[c] = b;
+    }
+    return bounds;
+}
 
-    for (int j = header.height - 1; j >= 0; --j) {
-        for (int i = 0; i < header.width; ++i) {
-            std::uint8_t r;
-            std::uint8_t g;
-            std::uint8_t b;
-            ins.read(reinterpret_cast<char*>(&r), sizeof(std::uint8_t));
-            ins.read(reinterpret_cast<char*>(&g), sizeof(std::uint8_t));
-            ins.read(reinterpret_cast<char*>(&b), sizeof(std::uint8_t));
+// The channel value of every possible sample, rounded to nearest. RGB samples are sRGB encoded and decoded to linear;
+// gray and alpha are linear.
+template <typename Channel>
+std::vector<Channel> sample_table(std::uint32_t max_color, bool srgb)
+{
+    std::vector<Channel> table(std::size_t{ max_color } + 1);
+    for (std::size_t v = 0; v < table.size(); ++v) {
+        float unit = static_cast<float>(v) / max_color;
+        if (srgb) {
+            unit = srgb_to_rgb(unit);
+        }
+        if constexpr (is_floating_point_channel_v<Channel>) {
+            table[v] = static_cast<Channel>(unit);
+        } else {
+            table[v] = static_cast<Channel>(unit * std::numeric_limits<Channel>::max() + 0.5f);
+        }
+    }
+    return table;
+}
 
-            // Use the straight RGB8 type here, because we don't need anything extra.
-            const auto fc = srgb_to_rgb(to_float(RGB8{ r, g, b }));
-            r             = static_cast<uint8_t>(fc.r * max_value);
-            g             = static_cast<uint8_t>(fc.g * max_value);
-            b             = static_cast<uint8_t>(fc.b * max_value);
+// Maps the samples of one pixel in the file to a destination pixel: gray is replicated into color, color cannot be
+// stored as gray, and alpha is dropped if the destination has none, or opaque if the file has none. Generic pixels
+// (Pixel<T, N>) take the samples in order and linearly, and leave any extra channels zero.
+template <std::uint32_t src_channels, typename P>
+void store_pixel(P& p, const std::uint32_t* s, const channel_type_t<P>* color, const channel_type_t<P>* linear)
+{
+    constexpr std::size_t dst_channels = channel_count_v<P>;
 
-            img(i, j) = ColorType(r, g, b);
+    if constexpr (!is_color_pixel_v<P>) {
+        for (std::uint32_t c = 0; c < dst_channels; ++c) {
+            p[c] = (c < src_channels) ? linear[s[c]] : channel_type_t<P>{};
+        }
+    } else if constexpr (dst_channels == 1) {
+        p = color[s[0]];
+    } else {
+        constexpr bool src_gray = src_channels <= 2;
+        p.r                     = color[s[0]];
+        p.g                     = color[s[src_gray ? 0 : 1]];
+        p.b                     = color[s[src_gray ? 0 : 2]];
+        if constexpr (has_alpha_v<P> && (src_channels == 2 || src_channels == 4)) {
+            p.a = linear[s[src_channels - 1]];
         }
     }
+}
+
+// Stores the image a row at a time, in parallel. sample_at(r, k) is sample k of file row r; file rows run from the
+// top of the image.
+template <std::uint32_t src_channels, typename ExecutionPolicy, typename ImageType, typename SampleAt>
+void store_rows(ExecutionPolicy&& policy, ImageType& img, const PNM_header& header, SampleAt sample_at)
+{
+    using Pixel   = typename ImageType::value_type;
+    using Channel = channel_type_t<Pixel>;
 
+    if constexpr (is_color_pixel_v<Pixel> && channel_count_v<Pixel> == 1) {
+        if (src_channels > 2) {
+            throw ImageError("Unable to store color as a single channel");
+        }
+    }
+
+    IMAGE_LIBRARY_TIMED_SCOPE("store_rows");
+    const bool bitmap = header.format == ImageFormat::PBM_ascii || header.format == ImageFormat::PBM_binary;
+    const auto color  = sample_table<Channel>(header.max_color, !bitmap && src_channels > 2);
+    const auto linear = sample_table<Channel>(header.max_color, false);
+
+    // Stores file row r at out.
+    const auto store_row = [&](std::uint32_t r, Pixel* out) {
+        for (std::uint32_t x = 0; x < header.width; ++x) {
+            std::uint32_t s[src_channels];
+            for (std::uint32_t c = 0; c < src_channels; ++c) {
+                s[c] = sample_at(r, x * src_channels + c);
+                if (s[c] > header.max_color) {
+                    throw ImageError("Sample out of range");
+                }
+            }
+            store_pixel<src_channels>(out[x], s, color.data(), linear.data());
+        }
+    };
+
+    if constexpr (is_tiled_image_v<ImageType>) {
+        // A tile row at a time: its rows are stored into a row-major band, which is then transcoded into the tiles.
+        constexpr std::uint32_t tile_height = ImageType::tile_height;
+        const std::uint32_t     tile_rows   = (header.height + tile_height - 1) / tile_height;
+        for_each_index(policy, std::uint32_t{ 0 }, tile_rows, [&](std::uint32_t tile_y) {
+            const std::uint32_t y0   = tile_y * tile_height;
+            const std::uint32_t rows = std::min(tile_height, header.height - y0);
+            Array2D<Pixel>      band(header.width, rows);
+            for (std::uint32_t i = 0; i < rows; ++i) {
+                store_row(header.height - 1 - (y0 + i), &band(0, i));
+            }
+            blit(crop(img, 0, y0, header.width, rows), band);
+        });
+    } else {
+        for_each_index(policy, std::uint32_t{ 0 }, header.height, [&](std::uint32_t r) {
+            const std::uint32_t y = header.height - 1 - r;
+            store_row(r, &img(0, y));
+        });
+    }
+    IMAGE_LIBRARY_COUNT(pixels_converted, std::uint64_t{ header.width } * header.height);
+}
+
+template <typename ExecutionPolicy, typename ImageType, typename SampleAt>
+void store_rows(ExecutionPolicy&& policy, ImageType& img, const PNM_header& header, SampleAt sample_at)
+{
+    switch (header.channels) {
+    case 1:
+        store_rows<1>(policy, img, header, sample_at);
+        break;
+    case 2:
+        store_rows<2>(policy, img, header, sample_at);
+        break;
+    case 3:
+        store_rows<3>(policy, img, header, sample_at);
+        break;
+    case 4:
+        store_rows<4>(policy, img, header, sample_at);
+        break;
+    default:
+        // Wider PAM files are only read into generic pixels of the same depth.
+        if constexpr (!is_color_pixel_v<typename ImageType::value_type>) {
+            constexpr std::uint32_t channels = channel_count_v<typename ImageType::value_type>;
+            if (channels > 4 && header.channels == channels) {
+                store_rows<channels>(policy, img, header, sample_at);
+                break;
+            }
+        }
+        throw ImageError("Unsupported number of channels");
+    }
+}
+
+// P4, P5, P6 and P7: packed bits (most significant first, 1 is black), bytes, or big-endian 16-bit samples.
+template <typename ExecutionPolicy, typename ImageType>
+void decode_binary(ExecutionPolicy&& policy, ImageType& img, const PNM_header& header, std::span<const char> payload)
+{
+    const auto* const bytes  = reinterpret_cast<const std::uint8_t*>(payload.data());
+    const std::size_t width  = header.width;
+    const bool        bitmap = header.format == ImageFormat::PBM_binary;
+    const bool        wide   = header.max_color > std::numeric_limits<std::uint8_t>::max();
+
+    const std::size_t row_size = bitmap ? (width + 7) / 8 : width * header.channels * (wide ? 2 : 1);
+    if (payload.size() < row_size * header.height) {
+        throw ImageError("Truncated image data");
+    }
+
+    if (bitmap) {
+        store_rows(policy, img, header, [=](std::uint32_t r, std::size_t k) -> std::uint32_t {
+            return 1u - ((bytes[r * row_size + k / 8] >> (7u - k % 8u)) & 1u);
+        });
+    } else if (wide) {
+        store_rows(policy, img, header, [=](std::uint32_t r, std::size_t k) -> std::uint32_t {
+            const std::uint8_t* const p = bytes + r * row_size + 2 * k;
+            return (std::uint32_t{ p[0] } << 8u) | p[1];
+        });
+    } else {
+        store_rows(policy, img, header, [=](std::uint32_t r, std::size_t k) -> std::uint32_t {
+            return bytes[r * row_size + k];
+        });
+    }
+}
+
+// P1, P2 and P3. The payload is split into chunks at whitespace, the chunks' samples are counted to find where each
+// chunk starts in the image, and then the chunks are parsed in parallel.
+template <typename ExecutionPolicy, typename ImageType>
+void decode_ascii(ExecutionPolicy&& policy, ImageType& img, const PNM_header& header, std::span<const char> payload)
+{
+    const bool        bitmap      = header.format == ImageFormat::PBM_ascii;
+    const std::size_t chunk_count = is_parallel_policy_v<ExecutionPolicy> ? 4 * hardware_thread_count() : 1;
+    const auto        bounds      = whitespace_chunks(payload, chunk_count);
+
+    std::vector<std::size_t> first_sample(chunk_count + 1);
+    for_each_index(policy, std::size_t{ 0 }, chunk_count, [&](std::size_t c) {
+        first_sample[c + 1] = count_samples(payload.data() + bounds[c], payload.data() + bounds[c + 1], bitmap);
+    });
+    for (std::size_t c = 0; c < chunk_count; ++c) {
+        first_sample[c + 1] += first_sample[c];
+    }
+
+    const std::size_t row_samples = std::size_t{ header.width } * header.channels;
+    if (first_sample[chunk_count] != row_samples * header.height) {
+        throw ImageError("Unexpected number of samples");
+    }
+
+    std::vector<std::uint16_t> samples(first_sample[chunk_count]);
+    for_each_index(policy, std::size_t{ 0 }, chunk_count, [&](std::size_t c) {
+        const char*       p    = payload.data() + bounds[c];
+        const char* const last = payload.data() + bounds[c + 1];
+        for (std::size_t k = first_sample[c]; k < first_sample[c + 1]; ++k) {
+            while (is_space(*p)) {
+                ++p;
+            }
+            if (bitmap) {
+                if (*p != '0' && *p != '1') {
+                    throw ImageError("Malformed sample");
+                }
+                samples[k] = static_cast<std::uint16_t>(*p++ == '0');
+                continue;
+            }
+            std::uint16_t value;
+            const auto [end, error] = std::from_chars(p, last, value);
+            if (error != std::errc{} || (end != last && !is_space(*end))) {
+                throw ImageError("Malformed sample");
+            }
+            samples[k] = value;
+            p          = end;
+        }
+    });
+
+    store_rows(policy, img, header, [&samples, row_samples](std::uint32_t r, std::size_t k) -> std::uint32_t {
+        return samples[r * row_samples + k];
+    });
+}
+
+template <typename ExecutionPolicy, typename ImageType>
+void decode_pnm(ExecutionPolicy&& policy, ImageType& img, const PNM_header& header, std::istream& ins)
+{
+    IMAGE_LIBRARY_TIMED_SCOPE("decode_pnm");
+    const std::vector<char> payload = read_remaining(ins);
+    IMAGE_LIBRARY_COUNT(bytes_read, payload.size());
+    switch (header.format) {
+    case ImageFormat::PBM_ascii:
+    case ImageFormat::PGM_ascii:
+    case ImageFormat::PPM_ascii:
+        decode_ascii(policy, img, header, payload);
+        break;
+    case ImageFormat::PBM_binary:
+    case ImageFormat::PGM_binary:
+    case ImageFormat::PPM_binary:
+    case ImageFormat::PAM:
+        decode_binary(policy, img, header, payload);
+        break;
+    default:
+        throw ImageError("Unexpected format");
+    }
+}
+} // namespace pnm_detail
+
+// Reads binary PPM with 8-bit samples, decoding sRGB to linear.
+template <typename ImageType, typename ExecutionPolicy>
+requires(!is_floating_point_image_v<ImageType> && is_execution_policy_v<ExecutionPolicy>)
+inline ImageType read_ppm_8(ExecutionPolicy&& policy, std::istream& ins)
+{
+    const auto header = read_pnm_header(ins);
+
+    if (header.format != ImageFormat::PPM_binary) {
+        throw ImageError("Unexpected format");
+    }
+
+    if (header.max_color > std::numeric_limits<std::uint8_t>::max()) {
+        throw ImageError("Unexpected color depth");
+    }
+
+    ImageType img(header.width, header.height);
+    pnm_detail::decode_pnm(policy, img, header, ins);
     return img;
 }
 
 template <typename ImageType>
-requires !is_floating_point_image_v<ImageType>
+requires(!is_floating_point_image_v<ImageType>)
+inline ImageType read_ppm_8(std::istream& ins)
+{
+    return read_ppm_8<ImageType>(std::execution::seq, ins);
+}
+
+template <typename ImageType>
+requires(!is_floating_point_image_v<ImageType>)
 inline ImageType read_ppm_8(const std::filesystem::path& file)
 {
     std::ifstream ins(file, std::ios_base::binary | std::ios_base::in);
@@ -357,67 +1170,91 @@ inline ImageType read_ppm_8(const std::filesystem::path& file)
     return read_ppm_8<ImageType>(ins);
 }
 
-// This would work with floating-point images if we simply changed the conversion function to [0, 1]
-template <typename ImageType>
-requires !is_floating_point_image_v<ImageType>
-inline ImageType read_ppm_16(std::istream& ins)
+// Reads binary PPM with 16-bit samples, decoding sRGB to linear.
+template <typename ImageType, typename ExecutionPolicy>
+requires(!is_floating_point_image_v<ImageType> && is_execution_policy_v<ExecutionPolicy>)
+inline ImageType read_ppm_16(ExecutionPolicy&& policy, std::istream& ins)
 {
-    constexpr auto max_value = std::numeric_limits<std::uint16_t>::max();
-
-    using ColorType = typename ImageType::value_type;
-
     const auto header = read_pnm_header(ins);
 
     if (header.format != ImageFormat::PPM_binary) {
         throw ImageError("Unexpected format");
     }
 
-    if (header.max_color <= std::numeric_limits<std::uint8_t>::max() || header.max_color > max_value) {
+    if (header.max_color <= std::numeric_limits<std::uint8_t>::max()) {
         throw ImageError("Unexpected color depth");
     }
 
     ImageType img(header.width, header.height);
+    pnm_detail::decode_pnm(policy, img, header, ins);
+    return img;
+}
 
-    for (int j = header.height - 1; j >= 0; --j) {
-        for (int i = 0; i < header.width; ++i) {
-            std::uint16_t r;
-            std::uint16_t g;
-            std::uint16_t b;
-            ins.read(reinterpret_cast<char*>(&r), sizeof(std::uint16_t));
-            ins.read(reinterpret_cast<char*>(&g), sizeof(std::uint16_t));
-            ins.read(reinterpret_cast<char*>(&b), sizeof(std::uint16_t));
-
-            r = big_to_native_endian(r);
-            g = big_to_native_endian(g);
-            b = big_to_native_endian(b);
+template <typename ImageType>
+requires(!is_floating_point_image_v<ImageType>)
+inline ImageType read_ppm_16(std::istream& ins)
+{
+    return read_ppm_16<ImageType>(std::execution::seq, ins);
+}
 
-            // Use the straight RGB16 type here, because we don't need anything extra.
-            const auto fc = srgb_to_rgb(to_float(RGB16{ r, g, b }));
-            r             = static_cast<uint16_t>(fc.r * max_value);
-            g             = static_cast<uint16_t>(fc.g * max_value);
-            b             = static_cast<uint16_t>(fc.b * max_value);
+template <typename ImageType>
+requires(!is_floating_point_image_v<ImageType>)
+inline ImageType read_ppm_16(const std::filesystem::path& file)
+{
+    std::ifstream ins(file, std::ios_base::binary | std::ios_base::in);
+    if (!ins) {
+        throw ImageError("Unable to open " + file.string());
+    }
+    return read_ppm_16<ImageType>(ins);
+}
 
-            img(i, j) = ColorType(r, g, b);
-        }
+// Reads ASCII PPM (P3). Samples are sRGB encoded: they are decoded to linear as with read_ppm_8.
+template <typename ImageType, typename ExecutionPolicy>
+requires is_execution_policy_v<ExecutionPolicy>
+inline ImageType read_plain_ppm(ExecutionPolicy&& policy, std::istream& ins)
+{
+    const auto header = read_pnm_header(ins);
+    if (header.format != ImageFormat::PPM_ascii) {
+        throw ImageError("Unexpected format");
+    }
+    if (header.max_color == 0) {
+        throw ImageError("Unexpected color depth");
     }
 
+    ImageType img(header.width, header.height);
+    pnm_detail::decode_pnm(policy, img, header, ins);
     return img;
 }
 
 template <typename ImageType>
-requires !is_floating_point_image_v<ImageType>
-inline ImageType read_ppm_16(const std::filesystem::path& file)
+inline ImageType read_plain_ppm(std::istream& ins)
+{
+    return read_plain_ppm<ImageType>(std::execution::seq, ins);
+}
+
+template <typename ImageType, typename ExecutionPolicy>
+requires is_execution_policy_v<ExecutionPolicy>
+inline ImageType read_plain_ppm(ExecutionPolicy&& policy, const std::filesystem::path& file)
 {
     std::ifstream ins(file, std::ios_base::binary | std::ios_base::in);
     if (!ins) {
         throw ImageError("Unable to open " + file.string());
     }
-    return read_ppm_16<ImageType>(ins);
+    return read_plain_ppm<ImageType>(policy, ins);
 }
 
-// TODO: this should also work with space-filling version
-inline Image_RGBf read_pfm(std::istream& ins)
+template <typename ImageType>
+inline ImageType read_plain_ppm(const std::filesystem::path& file)
 {
+    return read_plain_ppm<ImageType>(std::execution::seq, file);
+}
+
+// Reads into row-major images directly, and into tiled ones a tile row at a time through a row-major band.
+template <typename ImageType>
+requires is_floating_point_image_v<ImageType>
+inline ImageType read_pfm(std::istream& ins)
+{
+    IMAGE_LIBRARY_TIMED_SCOPE("read_pfm");
     const auto header = read_pnm_header(ins);
     if (header.format != ImageFormat::PFM) {
         throw ImageError("Unexpected format");
@@ -429,39 +1266,135 @@ inline Image_RGBf read_pfm(std::istream& ins)
     const ConvertFunction le      = &little_endian;
     const ConvertFunction convert = (header.byte_order == std::endian::big) ? be : le;
 
-    Image_RGBf img(header.width, header.height);
+    using ColorType = typename ImageType::value_type;
+    using Channel   = channel_type_t<ColorType>;
 
-    for (int j = header.height - 1; j >= 0; --j) {
-        for (int i = 0; i < header.width; ++i) {
-            std::uint32_t r;
-            std::uint32_t g;
-            std::uint32_t b;
-            ins.read(reinterpret_cast<char*>(&r), sizeof(std::uint32_t));
-            ins.read(reinterpret_cast<char*>(&g), sizeof(std::uint32_t));
-            ins.read(reinterpret_cast<char*>(&b), sizeof(std::uint32_t));
+    // Gray files go into color images as gray, but color files do not go into gray images.
+    constexpr bool gray_image = channel_count_v<ColorType> == 1;
+    if (gray_image && header.channels != 1) {
+        throw ImageError("Unexpected format");
+    }
+
+    ImageType img(header.width, header.height);
 
-            r = convert(r);
-            g = convert(g);
-            b = convert(b);
+    std::vector<std::uint32_t> scanline(std::size_t{ header.channels } * header.width);
+    std::vector<float>         values(scanline.size());
 
-            const float fr = *reinterpret_cast<float*>(&r);
-            const float fg = *reinterpret_cast<float*>(&g);
-            const float fb = *reinterpret_cast<float*>(&b);
+    // Decodes the next row of the file, which runs from the bottom of the image, into out.
+    const auto read_row = [&](ColorType* out) {
+        ins.read(reinterpret_cast<char*>(scanline.data()), scanline.size() * sizeof(std::uint32_t));
+        for (std::size_t k = 0; k < scanline.size(); ++k) {
+            values[k] = std::bit_cast<float>(convert(scanline[k]));
+        }
 
-            img(i, j) = RGB(fr, fg, fb);
+        if constexpr (std::is_same_v<ColorType, RGBh>) {
+            if (header.channels == 3) {
+                convert_float_to_half(values.data(), &out->r, values.size());
+                return;
+            }
+        }
+        // A gray sample is repeated into the color channels.
+        const std::uint32_t step = (header.channels == 1) ? 0 : 1;
+        for (std::uint32_t i = 0; i < header.width; ++i) {
+            const float* const v = values.data() + std::size_t{ header.channels } * i;
+            if constexpr (gray_image) {
+                out[i] = static_cast<Channel>(v[0]);
+            } else {
+                out[i] = ColorType(static_cast<Channel>(v[0]),
+                                   static_cast<Channel>(v[step]),
+                                   static_cast<Channel>(v[2 * step]));
+            }
+        }
+    };
+
+    if constexpr (is_tiled_image_v<ImageType>) {
+        constexpr std::uint32_t tile_height = ImageType::tile_height;
+        Array2D<ColorType>      band(header.width, tile_height);
+        for (std::uint32_t tile_y = img.num_tiles_height(); tile_y-- > 0;) {
+            const std::uint32_t y0   = tile_y * tile_height;
+            const std::uint32_t rows = std::min(tile_height, header.height - y0);
+            for (std::uint32_t i = rows; i-- > 0;) {
+                read_row(&band(0, i));
+            }
+            blit(crop(img, 0, y0, header.width, rows), crop(band, 0, 0, header.width, rows));
+        }
+    } else {
+        for (std::uint32_t j = header.height; j-- > 0;) {
+            read_row(&img(0, j));
         }
     }
+    IMAGE_LIBRARY_COUNT(pixels_converted, std::uint64_t{ header.width } * header.height);
+    IMAGE_LIBRARY_COUNT(bytes_read,
+                        std::uint64_t{ header.width } * header.height * header.channels * sizeof(float));
 
     return img;
 }
 
+inline Image_RGBf read_pfm(std::istream& ins)
+{
+    return read_pfm<Image_RGBf>(ins);
+}
+
+template <typename ImageType>
+requires is_floating_point_image_v<ImageType>
+inline ImageType read_pfm(const std::filesystem::path& file)
+{
+    std::ifstream ins(file, std::ios_base::binary | std::ios_base::in);
+    if (!ins) {
+        throw ImageError("Unable to open " + file.string());
+    }
+    return read_pfm<ImageType>(ins);
+}
+
 inline Image_RGBf read_pfm(const std::filesystem::path& file)
+{
+    return read_pfm<Image_RGBf>(file);
+}
+
+// Reads any of P1 to P7, and PFM into floating-point images. Gray files can be read into color images, and
+// files with alpha into images without, but not color into gray.
+template <typename ImageType, typename ExecutionPolicy>
+requires is_execution_policy_v<ExecutionPolicy>
+inline ImageType read_pnm(ExecutionPolicy&& policy, std::istream& ins)
+{
+    const auto header = read_pnm_header(ins);
+    if (header.format == ImageFormat::PFM) {
+        if constexpr (is_floating_point_image_v<ImageType>) {
+            return read_pfm<ImageType>(ins);
+        } else {
+            throw ImageError("Unexpected format");
+        }
+    }
+    if (header.max_color == 0) {
+        throw ImageError("Unexpected color depth");
+    }
+
+    ImageType img(header.width, header.height);
+    pnm_detail::decode_pnm(policy, img, header, ins);
+    return img;
+}
+
+template <typename ImageType>
+inline ImageType read_pnm(std::istream& ins)
+{
+    return read_pnm<ImageType>(std::execution::seq, ins);
+}
+
+template <typename ImageType, typename ExecutionPolicy>
+requires is_execution_policy_v<ExecutionPolicy>
+inline ImageType read_pnm(ExecutionPolicy&& policy, const std::filesystem::path& file)
 {
     std::ifstream ins(file, std::ios_base::binary | std::ios_base::in);
     if (!ins) {
         throw ImageError("Unable to open " + file.string());
     }
-    return read_pfm(ins);
+    return read_pnm<ImageType>(policy, ins);
+}
+
+template <typename ImageType>
+inline ImageType read_pnm(const std::filesystem::path& file)
+{
+    return read_pnm<ImageType>(std::execution::seq, file);
 }
 
 constexpr float k_max_less_than_one = 0x1.fffffe0000000p-1f;
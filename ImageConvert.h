@@ -0,0 +1,492 @@
+#pragma once
+
+#include "Image.h"
+#include "ImageExpression.h"
+#include "ImageView.h"
+#include "Parallel.h"
+#include "PixelTraits.h"
+
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <execution>
+#include <limits>
+#include <type_traits>
+
+// Whole-image conversion between any two of the RGB/RGBA pixel types (8, 16 and 32-bit unsigned integer, half and float
+// channels), e.g.:
+//     const auto img8 = convert_image<Image_RGBA8>(img_f, { .transfer = TransferFunction::linear_to_srgb,
+//                                                           .dither   = Dither::ordered });
+//
+// Integer channels are normalized to [0, 1]. Conversions round to the nearest representable value; integer-to-integer
+// conversions are done in exact integer arithmetic. Floating-point values are clamped to [0, 1] only when converted to
+// integers. Adding an alpha channel sets it to opaque; removing one drops it.
+//
+// Each combination of options is its own instantiation of the per-pixel kernel, so the inner loops are free of
+// run-time branches. Images of the same layout are converted in storage order.
+
+enum class TransferFunction
+{
+    none,
+    linear_to_srgb,
+    srgb_to_linear
+};
+
+enum class AlphaOperation
+{
+    none,
+    premultiply,
+    unpremultiply
+};
+
+enum class Dither
+{
+    none,
+    ordered // 4x4 Bayer matrix
+};
+
+struct ConversionOptions
+{
+    TransferFunction transfer{ TransferFunction::none };
+    AlphaOperation   alpha{ AlphaOperation::none };
+    Dither           dither{ Dither::none };
+};
+
+namespace detail {
+template <typename T>
+constexpr bool is_float_channel_v = is_floating_point_channel_v<T>;
+
+// Precise enough to hold every value of the channel type when quantizing.
+template <typename T>
+using quantize_float_t = std::conditional_t<(sizeof(T) >= 4), double, float>;
+
+template <typename T>
+inline float channel_to_unit(T v) noexcept
+{
+    if constexpr (is_float_channel_v<T>) {
+        return static_cast<float>(v);
+    } else {
+        constexpr float maxf = static_cast<float>(std::numeric_limits<T>::max());
+        return static_cast<float>(v) / maxf;
+    }
+}
+
+// threshold is in [0, 1): 0.5 rounds to nearest, other values come from the dither matrix.
+template <typename T>
+inline T unit_to_channel(float v, float threshold) noexcept
+{
+    if constexpr (is_float_channel_v<T>) {
+        return static_cast<T>(v);
+    } else {
+        using F        = quantize_float_t<T>;
+        constexpr F mx = static_cast<F>(std::numeric_limits<T>::max());
+        // Written so that NaN ends up as zero.
+        const F c = (v > 0.0f) ? std::min(static_cast<F>(v), F(1)) : F(0);
+        return static_cast<T>(c * mx + static_cast<F>(threshold));
+    }
+}
+
+// Exact, correctly rounded rescaling between unsigned integer channels. The intermediate product fits into 64 bits
+// for all of our (at most 32-bit) channel types.
+template <typename Dst, typename Src>
+inline Dst rescale_channel(Src v) noexcept
+{
+    if constexpr (std::is_same_v<Dst, Src>) {
+        return v;
+    } else if constexpr (is_float_channel_v<Dst> || is_float_channel_v<Src>) {
+        return unit_to_channel<Dst>(channel_to_unit(v), 0.5f);
+    } else {
+        constexpr std::uint64_t src_max = std::numeric_limits<Src>::max();
+        constexpr std::uint64_t dst_max = std::numeric_limits<Dst>::max();
+        if constexpr (dst_max % src_max == 0) {
+            // Widening: e.g., 8 to 16 bits is a multiplication by 257.
+            return static_cast<Dst>(v * (dst_max / src_max));
+        } else {
+            return static_cast<Dst>((static_cast<std::uint64_t>(v) * dst_max + src_max / 2) / src_max);
+        }
+    }
+}
+
+inline const std::array<float, 256>& srgb_to_rgb_table_8() noexcept
+{
+    static const auto table = [] {
+        std::array<float, 256> t;
+        for (int i = 0; i < 256; ++i) {
+            t[i] = srgb_to_rgb(static_cast<float>(i) / 255.0f);
+        }
+        return t;
+    }();
+    return table;
+}
+
+// The 4x4 Bayer threshold matrix, in row-major order.
+inline constexpr std::array<std::uint8_t, 16> k_bayer_4x4 = { 0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5 };
+
+constexpr float bayer_threshold(std::uint32_t x, std::uint32_t y) noexcept
+{
+    return (k_bayer_4x4[(y & 3u) * 4u + (x & 3u)] + 0.5f) / 16.0f;
+}
+
+// The thresholds in Morton order. This is indexed with the low four bits of an Array2DSFC storage index, which are the
+// interleaved low two bits of x and y.
+inline constexpr std::array<float, 16> k_bayer_4x4_morton = [] {
+    std::array<float, 16> t{};
+    for (std::uint32_t m = 0; m < 16; ++m) {
+        const std::uint32_t x = (m & 1u) | ((m >> 1u) & 2u);
+        const std::uint32_t y = ((m >> 1u) & 1u) | ((m >> 2u) & 2u);
+        t[m]                  = bayer_threshold(x, y);
+    }
+    return t;
+}();
+} // namespace detail
+
+template <typename DstPixel,
+          typename SrcPixel,
+          TransferFunction transfer = TransferFunction::none,
+          AlphaOperation   alpha    = AlphaOperation::none,
+          bool             dither   = false>
+struct PixelConversion
+{
+    using src_channel = channel_type_t<SrcPixel>;
+    using dst_channel = channel_type_t<DstPixel>;
+
+    static constexpr bool k_exact = transfer == TransferFunction::none && alpha == AlphaOperation::none && !dither;
+
+    DstPixel operator()(const SrcPixel& c, float threshold = 0.5f) const noexcept
+    {
+        if constexpr (k_exact) {
+            if constexpr (has_alpha_v<DstPixel>) {
+                dst_channel a = k_default_alpha<dst_channel>;
+                if constexpr (has_alpha_v<SrcPixel>) {
+                    a = detail::rescale_channel<dst_channel>(c.a);
+                }
+                return DstPixel(detail::rescale_channel<dst_channel>(c.r),
+                                detail::rescale_channel<dst_channel>(c.g),
+                                detail::rescale_channel<dst_channel>(c.b),
+                                a);
+            } else {
+                return DstPixel(detail::rescale_channel<dst_channel>(c.r),
+                                detail::rescale_channel<dst_channel>(c.g),
+                                detail::rescale_channel<dst_channel>(c.b));
+            }
+        } else {
+            float r = decode(c.r);
+            float g = decode(c.g);
+            float b = decode(c.b);
+            float a = 1.0f;
+            if constexpr (has_alpha_v<SrcPixel>) {
+                a = detail::channel_to_unit(c.a);
+            }
+
+            // The transfer functions apply to straight (not premultiplied) color.
+            if constexpr (alpha == AlphaOperation::unpremultiply) {
+                if (a > 0.0f) {
+                    r /= a;
+                    g /= a;
+                    b /= a;
+                }
+            }
+
+            if constexpr (transfer == TransferFunction::linear_to_srgb) {
+                r = rgb_to_srgb(r);
+                g = rgb_to_srgb(g);
+                b = rgb_to_srgb(b);
+            } else if constexpr (transfer == TransferFunction::srgb_to_linear && !k_decode_table) {
+                r = srgb_to_rgb(r);
+                g = srgb_to_rgb(g);
+                b = srgb_to_rgb(b);
+            }
+
+            if constexpr (alpha == AlphaOperation::premultiply) {
+                r *= a;
+                g *= a;
+                b *= a;
+            }
+
+            const dst_channel dr = detail::unit_to_channel<dst_channel>(r, threshold);
+            const dst_channel dg = detail::unit_to_channel<dst_channel>(g, threshold);
+            const dst_channel db = detail::unit_to_channel<dst_channel>(b, threshold);
+            if constexpr (has_alpha_v<DstPixel>) {
+                // Alpha is never dithered: it would show up as noise in compositing.
+                return DstPixel(dr, dg, db, detail::unit_to_channel<dst_channel>(a, 0.5f));
+            } else {
+                return DstPixel(dr, dg, db);
+            }
+        }
+    }
+
+private:
+    // 8-bit sRGB decodes through a table, unless we have to unpremultiply first.
+    static constexpr bool k_decode_table = transfer == TransferFunction::srgb_to_linear &&
+                                           alpha != AlphaOperation::unpremultiply &&
+                                           std::is_same_v<src_channel, std::uint8_t>;
+
+    static float decode(src_channel v) noexcept
+    {
+        if constexpr (k_decode_table) {
+            return detail::srgb_to_rgb_table_8()[v];
+        } else {
+            return detail::channel_to_unit(v);
+        }
+    }
+};
+
+namespace detail {
+template <typename DstImage, typename SrcImage>
+constexpr bool same_layout_v = std::is_same_v<typename DstImage::layout_type, typename SrcImage::layout_type> &&
+                               !std::is_same_v<typename DstImage::layout_type, mixed_layout>;
+
+// Calls f(begin, count) for runs of storage slots that cover the pixels of tile row tile_y of a tiled image: the
+// complete tiles as one run, and the in-image slots of edge tiles one at a time. The padding slots of edge tiles are
+// never constructed, so they must not be read.
+template <typename ImageType, typename F>
+void for_each_storage_run(const ImageType& img, typename ImageType::size_type tile_y, F&& f)
+{
+    using size_type = typename ImageType::size_type;
+
+    const size_type begin = img.tile_storage_index(0, tile_y);
+    const size_type y0    = tile_y * ImageType::tile_height;
+    const size_type rows  = std::min<size_type>(ImageType::tile_height, img.height() - y0);
+    const size_type full  = (rows == ImageType::tile_height) ? img.width() / ImageType::tile_width : 0;
+    if (full > 0) {
+        f(begin, full * ImageType::tile_area);
+    }
+    for (size_type y = y0; y < y0 + rows; ++y) {
+        for (size_type x = full * ImageType::tile_width; x < img.width(); ++x) {
+            f(img.storage_index(x, y), size_type{ 1 });
+        }
+    }
+}
+
+template <typename ExecutionPolicy, typename DstImage, typename SrcImage>
+void copy_storage(ExecutionPolicy&& policy, DstImage& dst, const SrcImage& src)
+{
+    using size_type = typename DstImage::size_type;
+    using T         = typename DstImage::value_type;
+
+    if constexpr (std::is_same_v<typename DstImage::layout_type, row_major_layout>) {
+        const size_type width = dst.width();
+        for_each_index(policy, size_type{ 0 }, dst.height(), [&](size_type y) {
+            std::memcpy(dst.data() + y * width, src.data() + y * width, sizeof(T) * width);
+        });
+    } else {
+        for_each_index(policy, size_type{ 0 }, dst.num_tiles_height(), [&](size_type tile_y) {
+            for_each_storage_run(dst, tile_y, [&](size_type begin, size_type count) {
+                std::memcpy(dst.data() + begin, src.data() + begin, sizeof(T) * count);
+            });
+        });
+    }
+}
+
+// Pixel pairs such as RGBh and RGBf, whose storage is a flat array of channels that F16C converts in bulk.
+template <typename DstPixel, typename SrcPixel>
+constexpr bool is_half_float_pair_v =
+    (std::is_same_v<DstPixel, RGBh> && std::is_same_v<SrcPixel, RGBf>) ||
+    (std::is_same_v<DstPixel, RGBf> && std::is_same_v<SrcPixel, RGBh>) ||
+    (std::is_same_v<DstPixel, RGBAh> && std::is_same_v<SrcPixel, RGBAf>) ||
+    (std::is_same_v<DstPixel, RGBAf> && std::is_same_v<SrcPixel, RGBAh>);
+
+template <typename ExecutionPolicy, typename DstImage, typename SrcImage>
+void convert_half_float_storage(ExecutionPolicy&& policy, DstImage& dst, const SrcImage& src)
+{
+    using size_type   = typename DstImage::size_type;
+    using DstPixel    = typename DstImage::value_type;
+    using SrcPixel    = typename SrcImage::value_type;
+    using dst_channel = channel_type_t<DstPixel>;
+    using src_channel = channel_type_t<SrcPixel>;
+
+    constexpr std::size_t k_channels = sizeof(SrcPixel) / sizeof(src_channel);
+    static_assert(sizeof(DstPixel) == k_channels * sizeof(dst_channel), "Pixels have to be tightly packed");
+
+    auto convert = [](const src_channel* in, dst_channel* out, std::size_t n) {
+        if constexpr (std::is_same_v<src_channel, half>) {
+            convert_half_to_float(in, out, n);
+        } else {
+            convert_float_to_half(in, out, n);
+        }
+    };
+
+    // Both are arrays of structs of channels, so we can hand whole rows (or runs of complete tiles) to the bulk
+    // conversion.
+    if constexpr (std::is_same_v<typename DstImage::layout_type, row_major_layout>) {
+        const size_type width = dst.width();
+        for_each_index(policy, size_type{ 0 }, dst.height(), [&](size_type y) {
+            convert(reinterpret_cast<const src_channel*>(src.data() + y * width),
+                    reinterpret_cast<dst_channel*>(dst.data() + y * width),
+                    std::size_t{ width } * k_channels);
+        });
+    } else {
+        for_each_index(policy, size_type{ 0 }, dst.num_tiles_height(), [&](size_type tile_y) {
+            for_each_storage_run(dst, tile_y, [&](size_type begin, size_type count) {
+                convert(reinterpret_cast<const src_channel*>(src.data() + begin),
+                        reinterpret_cast<dst_channel*>(dst.data() + begin),
+                        std::size_t{ count } * k_channels);
+            });
+        });
+    }
+}
+
+template <typename Conversion, typename ExecutionPolicy, typename DstImage, typename SrcImage>
+void convert_dithered(ExecutionPolicy&& policy, DstImage& dst, const SrcImage& src)
+{
+    using size_type = typename DstImage::size_type;
+
+    const Conversion conv;
+
+    if constexpr (same_layout_v<DstImage, SrcImage> &&
+                  std::is_same_v<typename DstImage::layout_type, row_major_layout>) {
+        const size_type width = dst.width();
+        for_each_index(policy, size_type{ 0 }, dst.height(), [&](size_type y) {
+            auto* const       out = dst.data() + y * width;
+            const auto* const in  = src.data() + y * width;
+            for (size_type x = 0; x < width; ++x) {
+                out[x] = conv(in[x], bayer_threshold(x, y));
+            }
+        });
+    } else if constexpr (same_layout_v<DstImage, SrcImage>) {
+        static_assert(DstImage::tile_area >= 16, "The dither matrix has to fit into a tile");
+
+        const size_type num_tiles = dst.num_tiles_width() * dst.num_tiles_height();
+        for_each_index(policy, size_type{ 0 }, num_tiles, [&](size_type tile_index) {
+            const size_type tile_x = tile_index % dst.num_tiles_width();
+            const size_type tile_y = tile_index / dst.num_tiles_width();
+            const size_type x0     = tile_x * DstImage::tile_width;
+            const size_type y0     = tile_y * DstImage::tile_height;
+
+            auto* const       out = dst.data();
+            const auto* const in  = src.data();
+
+            if (x0 + DstImage::tile_width <= dst.width() && y0 + DstImage::tile_height <= dst.height()) {
+                const size_type begin = dst.tile_storage_index(tile_x, tile_y);
+                const size_type end   = begin + DstImage::tile_area;
+                for (size_type i = begin; i < end; ++i) {
+                    out[i] = conv(in[i], k_bayer_4x4_morton[i & 15u]);
+                }
+            } else {
+                const size_type x1 = std::min(x0 + DstImage::tile_width, dst.width());
+                const size_type y1 = std::min(y0 + DstImage::tile_height, dst.height());
+                for (size_type y = y0; y < y1; ++y) {
+                    for (size_type x = x0; x < x1; ++x) {
+                        const size_type i = dst.storage_index(x, y);
+                        out[i]            = conv(in[i], bayer_threshold(x, y));
+                    }
+                }
+            }
+        });
+    } else {
+        for_each_index(policy, size_type{ 0 }, dst.height(), [&](size_type y) {
+            for (size_type x = 0; x < dst.width(); ++x) {
+                dst(x, y) = conv(src(x, y), bayer_threshold(x, y));
+            }
+        });
+    }
+}
+
+template <TransferFunction transfer,
+          AlphaOperation   alpha,
+          bool             dither,
+          typename ExecutionPolicy,
+          typename DstImage,
+          typename SrcImage>
+void convert_image(ExecutionPolicy&& policy, DstImage& dst, const SrcImage& src)
+{
+    using DstPixel   = typename DstImage::value_type;
+    using SrcPixel   = typename SrcImage::value_type;
+    using Conversion = PixelConversion<DstPixel, SrcPixel, transfer, alpha, dither>;
+
+    IMAGE_LIBRARY_TIMED_SCOPE("convert_image");
+    IMAGE_LIBRARY_COUNT(pixels_converted, std::uint64_t{ src.width() } * src.height());
+    if constexpr (dither) {
+        convert_dithered<Conversion>(policy, dst, src);
+    } else if constexpr (Conversion::k_exact && is_half_float_pair_v<DstPixel, SrcPixel> &&
+                         same_layout_v<DstImage, SrcImage>) {
+        convert_half_float_storage(policy, dst, src);
+    } else if constexpr (Conversion::k_exact && std::is_same_v<DstPixel, SrcPixel> &&
+                         std::is_trivially_copyable_v<DstPixel> && same_layout_v<DstImage, SrcImage>) {
+        copy_storage(policy, dst, src);
+    } else if constexpr (Conversion::k_exact && std::is_same_v<DstPixel, SrcPixel> &&
+                         std::is_trivially_copyable_v<DstPixel> && viewable_image<DstImage> &&
+                         viewable_image<const SrcImage>) {
+        // Views, and row-major to tiled or back: a row or a tile at a time where the layouts match, and transcoded a
+        // tile row at a time where they do not.
+        blit(policy, dst, src);
+    } else {
+        // The expression evaluator takes care of storage order for matching layouts.
+        assign(policy, dst, map(src, [conv = Conversion{}](const SrcPixel& c) { return conv(c); }));
+    }
+}
+
+template <TransferFunction transfer, AlphaOperation alpha, typename... Args>
+void convert_image(bool dither, Args&&... args)
+{
+    if (dither) {
+        convert_image<transfer, alpha, true>(std::forward<Args>(args)...);
+    } else {
+        convert_image<transfer, alpha, false>(std::forward<Args>(args)...);
+    }
+}
+
+template <TransferFunction transfer, typename... Args>
+void convert_image(AlphaOperation alpha, bool dither, Args&&... args)
+{
+    switch (alpha) {
+    case AlphaOperation::none:
+        convert_image<transfer, AlphaOperation::none>(dither, std::forward<Args>(args)...);
+        break;
+    case AlphaOperation::premultiply:
+        convert_image<transfer, AlphaOperation::premultiply>(dither, std::forward<Args>(args)...);
+        break;
+    case AlphaOperation::unpremultiply:
+        convert_image<transfer, AlphaOperation::unpremultiply>(dither, std::forward<Args>(args)...);
+        break;
+    }
+}
+} // namespace detail
+
+// Converts src into dst, which has to have the same dimensions. Dithering only applies when quantizing to integers.
+template <typename ExecutionPolicy, image_container DstImage, image_container SrcImage>
+requires is_execution_policy_v<ExecutionPolicy>
+void convert_image(ExecutionPolicy&& policy, DstImage& dst, const SrcImage& src, const ConversionOptions& options = {})
+{
+    assert(dst.width() == src.width());
+    assert(dst.height() == src.height());
+
+    using dst_channel = channel_type_t<typename DstImage::value_type>;
+
+    const bool dither = options.dither == Dither::ordered && !std::is_floating_point_v<dst_channel>;
+
+    switch (options.transfer) {
+    case TransferFunction::none:
+        detail::convert_image<TransferFunction::none>(options.alpha, dither, policy, dst, src);
+        break;
+    case TransferFunction::linear_to_srgb:
+        detail::convert_image<TransferFunction::linear_to_srgb>(options.alpha, dither, policy, dst, src);
+        break;
+    case TransferFunction::srgb_to_linear:
+        detail::convert_image<TransferFunction::srgb_to_linear>(options.alpha, dither, policy, dst, src);
+        break;
+    }
+}
+
+template <image_container DstImage, image_container SrcImage>
+void convert_image(DstImage& dst, const SrcImage& src, const ConversionOptions& options = {})
+{
+    convert_image(std::execution::seq, dst, src, options);
+}
+
+template <image_container DstImage, typename ExecutionPolicy, image_container SrcImage>
+requires is_execution_policy_v<ExecutionPolicy>
+DstImage convert_image(ExecutionPolicy&& policy, const SrcImage& src, const ConversionOptions& options = {})
+{
+    DstImage dst(src.width(), src.height());
+    convert_image(policy, dst, src, options);
+    return dst;
+}
+
+template <image_container DstImage, image_container SrcImage>
+DstImage convert_image(const SrcImage& src, const ConversionOptions& options = {})
+{
+    return convert_image<DstImage>(std::execution::seq, src, options);
+}
@@ -0,0 +1,621 @@
+#pragma once
+
+#include "Array2D.h"
+#include "Parallel.h"
+#include "PixelTraits.h"
+#include "RGB.h"
+#include "RGBA.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <execution>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+// Lazily evaluated whole-image arithmetic.
+//
+// Writing
+//     assign(out, clamp(exposure * img + bias));
+// builds a small tree of expression nodes that holds references to its operands, and evaluates it in a single pass
+// over memory without any temporary images. When every image in the expression has the same layout as the destination
+// (all Array2D, or all Array2DSFC with the same tile size), evaluation walks the storage linearly: row-major for
+// Array2D and tile-by-tile in Morton order for Array2DSFC. The inner loops are then plain indexed loops over the
+// underlying arrays that the compiler can vectorize. Otherwise, we fall back to evaluating through operator()(x, y).
+//
+// All operations are pixel-wise, so the destination may also appear in the expression (e.g., assign(img, img * 2.0f)).
+// Expression nodes hold references: do not keep them around longer than the images they refer to.
+
+// Used when the operands of an expression do not share a storage layout.
+struct mixed_layout
+{
+};
+
+// Used by scalar terminals: they fit into any layout.
+struct any_layout
+{
+};
+
+template <typename A, typename B>
+struct common_layout
+{
+    using type = mixed_layout;
+};
+
+template <typename A>
+struct common_layout<A, A>
+{
+    using type = A;
+};
+
+template <typename A>
+struct common_layout<A, any_layout>
+{
+    using type = A;
+};
+
+template <typename B>
+struct common_layout<any_layout, B>
+{
+    using type = B;
+};
+
+template <>
+struct common_layout<any_layout, any_layout>
+{
+    using type = any_layout;
+};
+
+template <typename A, typename B>
+using common_layout_t = typename common_layout<A, B>::type;
+
+template <typename T>
+concept image_container = requires(const T& t, typename T::size_type i) {
+    typename T::value_type;
+    typename T::layout_type;
+    { t.width() } -> std::convertible_to<typename T::size_type>;
+    { t.height() } -> std::convertible_to<typename T::size_type>;
+    { t(i, i) } -> std::convertible_to<typename T::value_type>;
+    t.data();
+};
+
+template <typename T>
+struct is_image_expression : std::false_type
+{
+};
+
+template <typename T>
+inline constexpr bool is_image_expression_v = is_image_expression<std::remove_cvref_t<T>>::value;
+
+template <typename T>
+concept image_operand = image_container<std::remove_cvref_t<T>> || is_image_expression_v<T>;
+
+template <typename ImageType>
+class ImageTerminal
+{
+public:
+    using size_type   = typename ImageType::size_type;
+    using value_type  = typename ImageType::value_type;
+    using layout_type = typename ImageType::layout_type;
+
+    explicit ImageTerminal(const ImageType& img) noexcept
+    : m_img(std::addressof(img))
+    , m_data(img.data())
+    {
+    }
+
+    size_type width() const noexcept
+    {
+        return m_img->width();
+    }
+
+    size_type height() const noexcept
+    {
+        return m_img->height();
+    }
+
+    const value_type& operator()(size_type x, size_type y) const noexcept
+    {
+        return (*m_img)(x, y);
+    }
+
+    const value_type& at_storage(size_type idx) const noexcept
+    {
+        return m_data[idx];
+    }
+
+private:
+    const ImageType*  m_img;
+    const value_type* m_data;
+};
+
+template <typename T>
+class ScalarTerminal
+{
+public:
+    using size_type   = std::uint32_t;
+    using value_type  = T;
+    using layout_type = any_layout;
+
+    explicit ScalarTerminal(const T& value) noexcept
+    : m_value(value)
+    {
+    }
+
+    const value_type& operator()(size_type, size_type) const noexcept
+    {
+        return m_value;
+    }
+
+    const value_type& at_storage(size_type) const noexcept
+    {
+        return m_value;
+    }
+
+private:
+    T m_value;
+};
+
+template <typename Op, typename Expression>
+class UnaryExpression
+{
+public:
+    using size_type   = typename Expression::size_type;
+    using value_type  = std::remove_cvref_t<std::invoke_result_t<const Op&, typename Expression::value_type>>;
+    using layout_type = typename Expression::layout_type;
+
+    UnaryExpression(Op op, Expression e) noexcept
+    : m_op(std::move(op))
+    , m_e(std::move(e))
+    {
+    }
+
+    size_type width() const noexcept
+    {
+        return m_e.width();
+    }
+
+    size_type height() const noexcept
+    {
+        return m_e.height();
+    }
+
+    value_type operator()(size_type x, size_type y) const
+    {
+        return m_op(m_e(x, y));
+    }
+
+    value_type at_storage(size_type idx) const
+    {
+        return m_op(m_e.at_storage(idx));
+    }
+
+private:
+    Op         m_op;
+    Expression m_e;
+};
+
+template <typename Op, typename Left, typename Right>
+class BinaryExpression
+{
+    static constexpr bool k_left_scalar  = std::is_same_v<typename Left::layout_type, any_layout>;
+    static constexpr bool k_right_scalar = std::is_same_v<typename Right::layout_type, any_layout>;
+
+    static_assert(!(k_left_scalar && k_right_scalar), "An image expression needs at least one image");
+
+public:
+    using size_type   = std::conditional_t<k_left_scalar, typename Right::size_type, typename Left::size_type>;
+    using value_type  = std::remove_cvref_t<
+        std::invoke_result_t<const Op&, typename Left::value_type, typename Right::value_type>>;
+    using layout_type = common_layout_t<typename Left::layout_type, typename Right::layout_type>;
+
+    BinaryExpression(Op op, Left left, Right right) noexcept
+    : m_op(std::move(op))
+    , m_left(std::move(left))
+    , m_right(std::move(right))
+    {
+        if constexpr (!k_left_scalar && !k_right_scalar) {
+            assert(m_left.width() == m_right.width());
+            assert(m_left.height() == m_right.height());
+        }
+    }
+
+    size_type width() const noexcept
+    {
+        if constexpr (k_left_scalar) {
+            return m_right.width();
+        } else {
+            return m_left.width();
+        }
+    }
+
+    size_type height() const noexcept
+    {
+        if constexpr (k_left_scalar) {
+            return m_right.height();
+        } else {
+            return m_left.height();
+        }
+    }
+
+    value_type operator()(size_type x, size_type y) const
+    {
+        return m_op(m_left(x, y), m_right(x, y));
+    }
+
+    value_type at_storage(size_type idx) const
+    {
+        return m_op(m_left.at_storage(idx), m_right.at_storage(idx));
+    }
+
+private:
+    Op    m_op;
+    Left  m_left;
+    Right m_right;
+};
+
+template <typename ImageType>
+struct is_image_expression<ImageTerminal<ImageType>> : std::true_type
+{
+};
+
+template <typename Op, typename Expression>
+struct is_image_expression<UnaryExpression<Op, Expression>> : std::true_type
+{
+};
+
+template <typename Op, typename Left, typename Right>
+struct is_image_expression<BinaryExpression<Op, Left, Right>> : std::true_type
+{
+};
+
+// Wrap images in terminals; expression nodes are stored by value.
+template <image_operand T>
+auto make_expression(const T& t) noexcept
+{
+    if constexpr (is_image_expression_v<T>) {
+        return t;
+    } else {
+        return ImageTerminal<T>(t);
+    }
+}
+
+template <typename T>
+using expression_t = decltype(make_expression(std::declval<const T&>()));
+
+// Scalars are converted to the type arithmetic is done in for the image they are combined with: float for 8-bit, 16-bit
+// and half images, so that, e.g., img * 1.5f scales an RGB8 image by 1.5 rather than by 1. Whole pixel values (e.g., an
+// RGBf offset) are passed through as is.
+template <typename Pixel, typename S>
+auto make_scalar(const S& s) noexcept
+{
+    using channel = promoted_channel_t<channel_type_t<Pixel>>;
+    if constexpr (std::is_arithmetic_v<S> && !std::is_same_v<S, channel>) {
+        return ScalarTerminal<channel>(static_cast<channel>(s));
+    } else {
+        return ScalarTerminal<S>(s);
+    }
+}
+
+namespace expression_ops {
+// Half and integer pixels take part in arithmetic as float pixels, so that they can be mixed with float images and
+// scalars. assign rounds and clamps the result when it stores it into an integer image.
+template <typename T>
+decltype(auto) promote(const T& t) noexcept
+{
+    using channel  = channel_type_t<T>;
+    using promoted = promoted_channel_t<channel>;
+    if constexpr (std::is_same_v<channel, promoted>) {
+        return t;
+    } else {
+        return static_cast<rebind_channel_t<T, promoted>>(t);
+    }
+}
+
+struct plus
+{
+    template <typename A, typename B>
+    auto operator()(const A& a, const B& b) const noexcept
+    {
+        return promote(a) + promote(b);
+    }
+};
+
+struct minus
+{
+    template <typename A, typename B>
+    auto operator()(const A& a, const B& b) const noexcept
+    {
+        return promote(a) - promote(b);
+    }
+};
+
+struct multiplies
+{
+    template <typename A, typename B>
+    auto operator()(const A& a, const B& b) const noexcept
+    {
+        return promote(a) * promote(b);
+    }
+};
+
+struct divides
+{
+    template <typename A, typename B>
+    auto operator()(const A& a, const B& b) const noexcept
+    {
+        return promote(a) / promote(b);
+    }
+};
+
+struct negate
+{
+    template <typename A>
+    auto operator()(const A& a) const noexcept
+    {
+        return -promote(a);
+    }
+};
+
+struct clamp_unit
+{
+    template <typename A>
+    auto operator()(const A& a) const noexcept
+    {
+        return clamp(a);
+    }
+};
+
+template <typename T>
+struct clamp_range
+{
+    template <typename A>
+    auto operator()(const A& a) const noexcept
+    {
+        return clamp(a, lo, hi);
+    }
+
+    T lo;
+    T hi;
+};
+} // namespace expression_ops
+
+template <typename Op, image_operand L, image_operand R>
+auto make_binary_expression(Op op, const L& l, const R& r) noexcept
+{
+    return BinaryExpression<Op, expression_t<L>, expression_t<R>>(op, make_expression(l), make_expression(r));
+}
+
+template <typename Op, image_operand L, typename S>
+auto make_binary_expression(Op op, const L& l, const S& s) noexcept
+{
+    using Left   = expression_t<L>;
+    auto scalar  = make_scalar<typename Left::value_type>(s);
+    using Scalar = decltype(scalar);
+    return BinaryExpression<Op, Left, Scalar>(op, make_expression(l), scalar);
+}
+
+template <typename Op, typename S, image_operand R>
+auto make_binary_expression(Op op, const S& s, const R& r) noexcept
+{
+    using Right  = expression_t<R>;
+    auto scalar  = make_scalar<typename Right::value_type>(s);
+    using Scalar = decltype(scalar);
+    return BinaryExpression<Op, Scalar, Right>(op, scalar, make_expression(r));
+}
+
+// At least one side of each operator has to be an image or an expression so that we do not hijack pixel arithmetic.
+template <typename L, typename R>
+concept image_operands = image_operand<L> || image_operand<R>;
+
+template <typename L, typename R>
+requires image_operands<L, R>
+auto operator+(const L& l, const R& r) noexcept
+{
+    return make_binary_expression(expression_ops::plus{}, l, r);
+}
+
+template <typename L, typename R>
+requires image_operands<L, R>
+auto operator-(const L& l, const R& r) noexcept
+{
+    return make_binary_expression(expression_ops::minus{}, l, r);
+}
+
+template <typename L, typename R>
+requires image_operands<L, R>
+auto operator*(const L& l, const R& r) noexcept
+{
+    return make_binary_expression(expression_ops::multiplies{}, l, r);
+}
+
+template <typename L, typename R>
+requires image_operands<L, R>
+auto operator/(const L& l, const R& r) noexcept
+{
+    return make_binary_expression(expression_ops::divides{}, l, r);
+}
+
+template <image_operand E>
+auto operator-(const E& e) noexcept
+{
+    return UnaryExpression<expression_ops::negate, expression_t<E>>({}, make_expression(e));
+}
+
+// Applies an arbitrary pixel function, e.g. map(img, [](const RGBf& c) { return rgb_to_srgb(c); }).
+template <image_operand E, typename Function>
+auto map(const E& e, Function f) noexcept
+{
+    return UnaryExpression<Function, expression_t<E>>(std::move(f), make_expression(e));
+}
+
+// Clamps each channel to [0, 1]. This requires a clamp(pixel) overload, which exists for RGBf and RGBAf.
+template <image_operand E>
+auto clamp(const E& e) noexcept
+{
+    return UnaryExpression<expression_ops::clamp_unit, expression_t<E>>({}, make_expression(e));
+}
+
+template <image_operand E, typename T>
+auto clamp(const E& e, T lo, T hi) noexcept
+{
+    using channel = channel_type_t<typename expression_t<E>::value_type>;
+    using Op      = expression_ops::clamp_range<channel>;
+    return UnaryExpression<Op, expression_t<E>>(Op{ static_cast<channel>(lo), static_cast<channel>(hi) },
+                                                make_expression(e));
+}
+
+namespace detail {
+// Arithmetic on integer images is done in float: round to nearest and clamp to the channel range when storing.
+template <typename Channel>
+Channel store_channel(float v) noexcept
+{
+    constexpr double k_lo = static_cast<double>(std::numeric_limits<Channel>::lowest());
+    constexpr double k_hi = static_cast<double>(std::numeric_limits<Channel>::max());
+
+    const double r = std::floor(static_cast<double>(v) + 0.5);
+    if (!(r > k_lo)) {
+        return std::numeric_limits<Channel>::lowest();
+    }
+    if (!(r < k_hi)) {
+        return std::numeric_limits<Channel>::max();
+    }
+    return static_cast<Channel>(r);
+}
+
+template <typename Dst, typename Src>
+Dst store_pixel(const Src& v) noexcept
+{
+    using dst_channel = channel_type_t<Dst>;
+    using src_channel = channel_type_t<Src>;
+    if constexpr (std::is_integral_v<dst_channel> && std::is_floating_point_v<src_channel>) {
+        static_assert(channel_count_v<Dst> == channel_count_v<Src>, "The channel counts have to match");
+        Dst out;
+        for (std::uint32_t c = 0; c < channel_count_v<Dst>; ++c) {
+            pixel_channel(out, c) = store_channel<dst_channel>(static_cast<float>(pixel_channel(v, c)));
+        }
+        return out;
+    } else {
+        return static_cast<Dst>(v);
+    }
+}
+
+template <typename ImageType, typename Expression>
+void assign_row(ImageType& dst, const Expression& e, typename ImageType::size_type y)
+{
+    using size_type = typename ImageType::size_type;
+
+    for (size_type x = 0; x < dst.width(); ++x) {
+        dst(x, y) = store_pixel<typename ImageType::value_type>(e(x, y));
+    }
+}
+
+template <typename ImageType, typename Expression>
+void assign_storage_row_major(ImageType& dst, const Expression& e, typename ImageType::size_type y)
+{
+    using size_type  = typename ImageType::size_type;
+    using value_type = typename ImageType::value_type;
+
+    auto* const     out   = dst.data();
+    const size_type width = dst.width();
+    const size_type begin = y * width;
+    const size_type end   = begin + width;
+    for (size_type i = begin; i < end; ++i) {
+        out[i] = store_pixel<value_type>(e.at_storage(i));
+    }
+}
+
+template <typename ImageType, typename Expression>
+void assign_storage_tile(ImageType& dst, const Expression& e, typename ImageType::size_type tile_index)
+{
+    using size_type  = typename ImageType::size_type;
+    using value_type = typename ImageType::value_type;
+
+    const size_type tile_x = tile_index % dst.num_tiles_width();
+    const size_type tile_y = tile_index / dst.num_tiles_width();
+    const size_type x0     = tile_x * ImageType::tile_width;
+    const size_type y0     = tile_y * ImageType::tile_height;
+
+    auto* const out = dst.data();
+
+    if (x0 + ImageType::tile_width <= dst.width() && y0 + ImageType::tile_height <= dst.height()) {
+        // Interior tile: every slot is an element, so this is one contiguous run.
+        const size_type begin = dst.tile_storage_index(tile_x, tile_y);
+        const size_type end   = begin + ImageType::tile_area;
+        for (size_type i = begin; i < end; ++i) {
+            out[i] = store_pixel<value_type>(e.at_storage(i));
+        }
+    } else {
+        // Edge tile: skip the padding slots, which are not constructed.
+        const size_type x1 = std::min(x0 + ImageType::tile_width, dst.width());
+        const size_type y1 = std::min(y0 + ImageType::tile_height, dst.height());
+        for (size_type y = y0; y < y1; ++y) {
+            for (size_type x = x0; x < x1; ++x) {
+                const size_type i = dst.storage_index(x, y);
+                out[i]            = store_pixel<value_type>(e.at_storage(i));
+            }
+        }
+    }
+}
+
+// Images of mixed_layout (views, for instance) have no storage order of their own, even among themselves.
+template <typename ImageType, typename Expression>
+constexpr bool storage_order_evaluable_v =
+    std::is_same_v<typename ImageType::layout_type, typename Expression::layout_type> &&
+    !std::is_same_v<typename ImageType::layout_type, mixed_layout>;
+} // namespace detail
+
+// Evaluates e into dst, which has to have the same dimensions as the images in e. The result is cast channel-wise to the
+// destination's pixel type: float results are rounded back to half for half images, and rounded and clamped to the
+// channel range for integer images. Rows (Array2D) or tiles (Array2DSFC) are distributed over threads when called with
+// std::execution::par.
+template <typename ExecutionPolicy, image_container ImageType, image_operand E>
+requires is_execution_policy_v<ExecutionPolicy>
+void assign(ExecutionPolicy&& policy, ImageType& dst, const E& expression)
+{
+    using size_type  = typename ImageType::size_type;
+    using Expression = expression_t<E>;
+
+    const Expression e = make_expression(expression);
+    assert(dst.width() == e.width());
+    assert(dst.height() == e.height());
+
+    if constexpr (!detail::storage_order_evaluable_v<ImageType, Expression>) {
+        for_each_index(policy, size_type{ 0 }, dst.height(), [&](size_type y) { detail::assign_row(dst, e, y); });
+    } else if constexpr (std::is_same_v<typename ImageType::layout_type, row_major_layout>) {
+        for_each_index(policy, size_type{ 0 }, dst.height(), [&](size_type y) {
+            detail::assign_storage_row_major(dst, e, y);
+        });
+    } else {
+        const size_type num_tiles = dst.num_tiles_width() * dst.num_tiles_height();
+        for_each_index(policy, size_type{ 0 }, num_tiles, [&](size_type tile_index) {
+            detail::assign_storage_tile(dst, e, tile_index);
+        });
+    }
+}
+
+template <image_container ImageType, image_operand E>
+void assign(ImageType& dst, const E& expression)
+{
+    assign(std::execution::seq, dst, expression);
+}
+
+// Evaluates an expression into a new image of the requested type.
+template <image_container ImageType, typename ExecutionPolicy, image_operand E>
+requires is_execution_policy_v<ExecutionPolicy>
+ImageType evaluate(ExecutionPolicy&& policy, const E& expression)
+{
+    const auto e = make_expression(expression);
+    ImageType  result(e.width(), e.height());
+    assign(policy, result, e);
+    return result;
+}
+
+template <image_container ImageType, image_operand E>
+ImageType evaluate(const E& expression)
+{
+    return evaluate<ImageType>(std::execution::seq, expression);
+}
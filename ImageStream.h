@@ -0,0 +1,722 @@
+#pragma once
+
+#include "Endian.h"
+#include "Image.h"
+#include "ImageConvert.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Streaming processing of images that do not have to fit into memory. A pipeline is a chain of stages that pass bands
+// of scanlines downstream. The consumer pulls: a stage's next() pulls as much as it needs from the stage it wraps.
+// Only a few bands are alive at any one time, so memory use is proportional to the band size, not the image size.
+//     auto source  = threaded(PfmBandReader("in.pfm"));
+//     auto resized = threaded(resize_stream(std::move(source), 1920, 1080));
+//     auto convert = threaded(convert_stream<RGB8>(std::move(resized), { .transfer = TransferFunction::linear_to_srgb,
+//                                                                        .dither   = Dither::ordered }));
+//     write_ppm_stream(convert, "out.ppm");
+//
+// Bands are in file order: the first band holds the top of the image, which is the row with the largest y in an
+// Image. Stages carry the values that are stored in the file. Unlike read_ppm_8 and write_ppm_8, the PPM stages do not
+// apply the sRGB transfer function: add a ConvertStage for that.
+//
+// A stage wrapped by threaded() runs on its own thread, and hands its bands over through a bounded queue. Exceptions
+// thrown on the worker thread are re-thrown by next() on the consuming thread.
+
+constexpr std::uint32_t k_default_band_rows = 64;
+
+template <typename Pixel>
+struct Band
+{
+    std::uint32_t      first_row{ 0 }; // Counted from the top of the image.
+    std::uint32_t      width{ 0 };
+    std::uint32_t      rows{ 0 };
+    std::vector<Pixel> pixels;
+
+    Band() = default;
+
+    Band(std::uint32_t first_row_, std::uint32_t width_, std::uint32_t rows_)
+    : first_row(first_row_)
+    , width(width_)
+    , rows(rows_)
+    , pixels(std::size_t{ width_ } * rows_)
+    {
+    }
+
+    Pixel* row(std::uint32_t r) noexcept
+    {
+        return pixels.data() + std::size_t{ r } * width;
+    }
+
+    const Pixel* row(std::uint32_t r) const noexcept
+    {
+        return pixels.data() + std::size_t{ r } * width;
+    }
+};
+
+template <typename Stage>
+concept band_source = requires(Stage& s) {
+    typename Stage::pixel_type;
+    { s.width() } -> std::convertible_to<std::uint32_t>;
+    { s.height() } -> std::convertible_to<std::uint32_t>;
+    { s.next() } -> std::same_as<std::optional<Band<typename Stage::pixel_type>>>;
+};
+
+// A fixed-capacity ring buffer between one producer and one consumer thread.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(std::size_t capacity)
+    : m_slots(std::max<std::size_t>(capacity, 1))
+    {
+    }
+
+    // Blocks while the queue is full. Returns false if the consumer has gone away.
+    bool push(T value)
+    {
+        std::unique_lock lock(m_mutex);
+        m_not_full.wait(lock, [this] { return m_count < m_slots.size() || m_cancelled; });
+        if (m_cancelled) {
+            return false;
+        }
+        m_slots[(m_head + m_count) % m_slots.size()] = std::move(value);
+        ++m_count;
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    // Blocks while the queue is empty. Returns an empty optional at the end of the stream, and re-throws the exception
+    // the producer closed the queue with, if any.
+    std::optional<T> pop()
+    {
+        std::unique_lock lock(m_mutex);
+        m_not_empty.wait(lock, [this] { return m_count > 0 || m_closed; });
+        if (m_count == 0) {
+            if (m_exception) {
+                std::rethrow_exception(m_exception);
+            }
+            return std::nullopt;
+        }
+        std::optional<T> value = std::move(m_slots[m_head]);
+        m_slots[m_head].reset();
+        m_head = (m_head + 1) % m_slots.size();
+        --m_count;
+        m_not_full.notify_one();
+        return value;
+    }
+
+    // Called by the producer: no more values will be pushed.
+    void close(std::exception_ptr exception = nullptr)
+    {
+        std::scoped_lock lock(m_mutex);
+        m_closed    = true;
+        m_exception = std::move(exception);
+        m_not_empty.notify_all();
+    }
+
+    // Called by the consumer: no more values will be popped.
+    void cancel()
+    {
+        std::scoped_lock lock(m_mutex);
+        m_cancelled = true;
+        m_not_full.notify_all();
+    }
+
+private:
+    std::mutex                    m_mutex;
+    std::condition_variable       m_not_empty;
+    std::condition_variable       m_not_full;
+    std::vector<std::optional<T>> m_slots;
+    std::size_t                   m_head{ 0 };
+    std::size_t                   m_count{ 0 };
+    bool                          m_closed{ false };
+    bool                          m_cancelled{ false };
+    std::exception_ptr            m_exception;
+};
+
+// Runs the wrapped stage on its own thread, at most capacity bands ahead of the consumer.
+template <band_source Upstream>
+class ThreadedStage
+{
+public:
+    using pixel_type = typename Upstream::pixel_type;
+
+    ThreadedStage(Upstream upstream, std::size_t capacity)
+    : m_width(upstream.width())
+    , m_height(upstream.height())
+    , m_shared(std::make_unique<Shared>(std::move(upstream), capacity))
+    {
+    }
+
+    std::uint32_t width() const noexcept
+    {
+        return m_width;
+    }
+
+    std::uint32_t height() const noexcept
+    {
+        return m_height;
+    }
+
+    std::optional<Band<pixel_type>> next()
+    {
+        return m_shared->queue.pop();
+    }
+
+private:
+    // The worker refers to this, so it lives on the heap where moving the stage does not disturb it.
+    struct Shared
+    {
+        Shared(Upstream upstream_, std::size_t capacity)
+        : upstream(std::move(upstream_))
+        , queue(capacity)
+        , worker([this] { run(); })
+        {
+        }
+
+        // Unblock the worker before the jthread joins it.
+        ~Shared()
+        {
+            queue.cancel();
+        }
+
+        void run()
+        {
+            try {
+                while (auto band = upstream.next()) {
+                    if (!queue.push(std::move(*band))) {
+                        return;
+                    }
+                }
+                queue.close();
+            } catch (...) {
+                queue.close(std::current_exception());
+            }
+        }
+
+        Upstream                       upstream;
+        BoundedQueue<Band<pixel_type>> queue;
+        std::jthread                   worker;
+    };
+
+    std::uint32_t           m_width;
+    std::uint32_t           m_height;
+    std::unique_ptr<Shared> m_shared;
+};
+
+template <band_source Upstream>
+ThreadedStage<Upstream> threaded(Upstream upstream, std::size_t capacity = 2)
+{
+    return ThreadedStage<Upstream>(std::move(upstream), capacity);
+}
+
+// -------------------------------------------------------------------------------------------------------------------
+// Readers
+// -------------------------------------------------------------------------------------------------------------------
+
+namespace stream_detail {
+inline std::ifstream open_input(const std::filesystem::path& file)
+{
+    std::ifstream ins(file, std::ios_base::binary | std::ios_base::in);
+    if (!ins) {
+        throw ImageError("Unable to open " + file.string());
+    }
+    return ins;
+}
+
+inline std::ofstream open_output(const std::filesystem::path& file)
+{
+    std::ofstream outs(file, std::ios_base::binary | std::ios_base::out);
+    if (!outs) {
+        throw ImageError("Unable to open " + file.string());
+    }
+    return outs;
+}
+
+template <typename Pixel>
+using float_pixel_t = std::conditional_t<has_alpha_v<Pixel>, RGBAf, RGBf>;
+
+// Default-constructed RGBA pixels are opaque.
+template <typename Pixel>
+constexpr Pixel zero_pixel() noexcept
+{
+    if constexpr (has_alpha_v<Pixel>) {
+        return Pixel(0, 0, 0, 0);
+    } else {
+        return Pixel(0);
+    }
+}
+} // namespace stream_detail
+
+// Binary PPM as RGB8 or RGB16, depending on the maximum color value.
+template <typename Pixel>
+class PpmBandReader
+{
+    static_assert(std::is_same_v<Pixel, RGB8> || std::is_same_v<Pixel, RGB16>);
+
+    using channel = channel_type_t<Pixel>;
+
+public:
+    using pixel_type = Pixel;
+
+    explicit PpmBandReader(const std::filesystem::path& file, std::uint32_t band_rows = k_default_band_rows)
+    : m_ins(stream_detail::open_input(file))
+    , m_header(read_pnm_header(m_ins))
+    , m_band_rows(std::max(band_rows, 1u))
+    {
+        if (m_header.format != ImageFormat::PPM_binary) {
+            throw ImageError("Unexpected format");
+        }
+        const bool wide = m_header.max_color > std::numeric_limits<std::uint8_t>::max();
+        if (wide != std::is_same_v<channel, std::uint16_t>) {
+            throw ImageError("Unexpected color depth");
+        }
+    }
+
+    std::uint32_t width() const noexcept
+    {
+        return m_header.width;
+    }
+
+    std::uint32_t height() const noexcept
+    {
+        return m_header.height;
+    }
+
+    std::optional<Band<Pixel>> next()
+    {
+        if (m_next_row >= m_header.height) {
+            return std::nullopt;
+        }
+
+        Band<Pixel> band(m_next_row, m_header.width, std::min(m_band_rows, m_header.height - m_next_row));
+        static_assert(sizeof(Pixel) == 3 * sizeof(channel));
+        m_ins.read(reinterpret_cast<char*>(band.pixels.data()),
+                   static_cast<std::streamsize>(band.pixels.size() * sizeof(Pixel)));
+        if (!m_ins) {
+            throw ImageError("Truncated image data");
+        }
+        if constexpr (sizeof(channel) > 1) {
+            for (auto& c : band.pixels) {
+                c = Pixel(big_to_native_endian(c.r), big_to_native_endian(c.g), big_to_native_endian(c.b));
+            }
+        }
+        m_next_row += band.rows;
+        return band;
+    }
+
+private:
+    std::ifstream m_ins;
+    PNM_header    m_header;
+    std::uint32_t m_band_rows;
+    std::uint32_t m_next_row{ 0 };
+};
+
+class PfmBandReader
+{
+public:
+    using pixel_type = RGBf;
+
+    explicit PfmBandReader(const std::filesystem::path& file, std::uint32_t band_rows = k_default_band_rows)
+    : m_ins(stream_detail::open_input(file))
+    , m_header(read_pnm_header(m_ins))
+    , m_band_rows(std::max(band_rows, 1u))
+    {
+        if (m_header.format != ImageFormat::PFM) {
+            throw ImageError("Unexpected format");
+        }
+    }
+
+    std::uint32_t width() const noexcept
+    {
+        return m_header.width;
+    }
+
+    std::uint32_t height() const noexcept
+    {
+        return m_header.height;
+    }
+
+    std::optional<Band<RGBf>> next()
+    {
+        if (m_next_row >= m_header.height) {
+            return std::nullopt;
+        }
+
+        Band<RGBf> band(m_next_row, m_header.width, std::min(m_band_rows, m_header.height - m_next_row));
+        static_assert(sizeof(RGBf) == 3 * sizeof(float));
+        auto* const values = reinterpret_cast<std::uint32_t*>(band.pixels.data());
+        m_ins.read(reinterpret_cast<char*>(values), static_cast<std::streamsize>(band.pixels.size() * sizeof(RGBf)));
+        if (!m_ins) {
+            throw ImageError("Truncated image data");
+        }
+        if (m_header.byte_order != std::endian::native) {
+            for (std::size_t k = 0; k < 3 * band.pixels.size(); ++k) {
+                values[k] = std::byteswap(values[k]);
+            }
+        }
+        m_next_row += band.rows;
+        return band;
+    }
+
+private:
+    std::ifstream m_ins;
+    PNM_header    m_header;
+    std::uint32_t m_band_rows;
+    std::uint32_t m_next_row{ 0 };
+};
+
+// -------------------------------------------------------------------------------------------------------------------
+// Operators
+// -------------------------------------------------------------------------------------------------------------------
+
+namespace stream_detail {
+template <typename Dst, typename Src>
+using RowConversion = void (*)(const Src*, Dst*, std::uint32_t width, std::uint32_t y);
+
+// y is the row in Image coordinates, so that dithering matches convert_image on the whole image.
+template <typename Dst, typename Src, TransferFunction transfer, AlphaOperation alpha, bool dither>
+void convert_row(const Src* in, Dst* out, std::uint32_t width, std::uint32_t y)
+{
+    const PixelConversion<Dst, Src, transfer, alpha, dither> conv;
+    for (std::uint32_t x = 0; x < width; ++x) {
+        if constexpr (dither) {
+            out[x] = conv(in[x], detail::bayer_threshold(x, y));
+        } else {
+            out[x] = conv(in[x]);
+        }
+    }
+}
+
+template <typename Dst, typename Src, TransferFunction transfer>
+RowConversion<Dst, Src> select_row_conversion(AlphaOperation alpha, bool dither)
+{
+    switch (alpha) {
+    case AlphaOperation::premultiply:
+        return dither ? &convert_row<Dst, Src, transfer, AlphaOperation::premultiply, true>
+                      : &convert_row<Dst, Src, transfer, AlphaOperation::premultiply, false>;
+    case AlphaOperation::unpremultiply:
+        return dither ? &convert_row<Dst, Src, transfer, AlphaOperation::unpremultiply, true>
+                      : &convert_row<Dst, Src, transfer, AlphaOperation::unpremultiply, false>;
+    case AlphaOperation::none:
+    default:
+        return dither ? &convert_row<Dst, Src, transfer, AlphaOperation::none, true>
+                      : &convert_row<Dst, Src, transfer, AlphaOperation::none, false>;
+    }
+}
+
+template <typename Dst, typename Src>
+RowConversion<Dst, Src> select_row_conversion(const ConversionOptions& options)
+{
+    const bool dither = options.dither == Dither::ordered && !is_floating_point_channel_v<channel_type_t<Dst>>;
+
+    switch (options.transfer) {
+    case TransferFunction::linear_to_srgb:
+        return select_row_conversion<Dst, Src, TransferFunction::linear_to_srgb>(options.alpha, dither);
+    case TransferFunction::srgb_to_linear:
+        return select_row_conversion<Dst, Src, TransferFunction::srgb_to_linear>(options.alpha, dither);
+    case TransferFunction::none:
+    default:
+        return select_row_conversion<Dst, Src, TransferFunction::none>(options.alpha, dither);
+    }
+}
+} // namespace stream_detail
+
+// Pixel format conversion, transfer functions and alpha operations with the same semantics as convert_image.
+template <typename DstPixel, band_source Upstream>
+class ConvertStage
+{
+    using src_pixel = typename Upstream::pixel_type;
+
+public:
+    using pixel_type = DstPixel;
+
+    explicit ConvertStage(Upstream upstream, const ConversionOptions& options = {})
+    : m_upstream(std::move(upstream))
+    , m_convert(stream_detail::select_row_conversion<DstPixel, src_pixel>(options))
+    {
+    }
+
+    std::uint32_t width() const noexcept
+    {
+        return m_upstream.width();
+    }
+
+    std::uint32_t height() const noexcept
+    {
+        return m_upstream.height();
+    }
+
+    std::optional<Band<DstPixel>> next()
+    {
+        const auto in = m_upstream.next();
+        if (!in) {
+            return std::nullopt;
+        }
+
+        Band<DstPixel> out(in->first_row, in->width, in->rows);
+        for (std::uint32_t r = 0; r < in->rows; ++r) {
+            m_convert(in->row(r), out.row(r), in->width, height() - 1 - (in->first_row + r));
+        }
+        return out;
+    }
+
+private:
+    Upstream                                          m_upstream;
+    stream_detail::RowConversion<DstPixel, src_pixel> m_convert;
+};
+
+template <typename DstPixel, band_source Upstream>
+ConvertStage<DstPixel, Upstream> convert_stream(Upstream upstream, const ConversionOptions& options = {})
+{
+    return ConvertStage<DstPixel, Upstream>(std::move(upstream), options);
+}
+
+namespace stream_detail {
+// The source pixels that contribute to one destination pixel along one axis, with normalized weights.
+struct Contribution
+{
+    std::uint32_t      first{ 0 };
+    std::vector<float> weights;
+};
+
+// A tent filter that widens with the reduction factor when shrinking, so that every source pixel contributes. Samples
+// beyond the edges are clamped to the edge pixels.
+inline std::vector<Contribution> resize_contributions(std::uint32_t src_size, std::uint32_t dst_size)
+{
+    const double scale   = static_cast<double>(src_size) / dst_size;
+    const double support = std::max(1.0, scale);
+
+    std::vector<Contribution> contributions(dst_size);
+    for (std::uint32_t i = 0; i < dst_size; ++i) {
+        const double center = (i + 0.5) * scale - 0.5;
+        const auto   lo     = static_cast<std::int64_t>(std::ceil(center - support));
+        const auto   hi     = static_cast<std::int64_t>(std::floor(center + support));
+        const auto   first  = std::clamp<std::int64_t>(lo, 0, src_size - 1);
+        const auto   last   = std::clamp<std::int64_t>(hi, 0, src_size - 1);
+
+        auto& c = contributions[i];
+        c.first = static_cast<std::uint32_t>(first);
+        c.weights.assign(static_cast<std::size_t>(last - first + 1), 0.0f);
+
+        double sum = 0.0;
+        for (std::int64_t j = lo; j <= hi; ++j) {
+            const double w = std::max(0.0, 1.0 - std::abs(j - center) / support);
+            c.weights[static_cast<std::size_t>(std::clamp<std::int64_t>(j, first, last) - first)] +=
+                static_cast<float>(w);
+            sum += w;
+        }
+        for (auto& w : c.weights) {
+            w = static_cast<float>(w / sum);
+        }
+    }
+    return contributions;
+}
+} // namespace stream_detail
+
+// Separable resizing. Each source row is resized horizontally once, and the vertical filter works on a sliding window
+// of those rows, so only the rows under the filter footprint are kept. Resizing is only meaningful on linear values:
+// the pixels have to have floating-point channels.
+template <band_source Upstream>
+class ResizeStage
+{
+    using accumulator = stream_detail::float_pixel_t<typename Upstream::pixel_type>;
+
+public:
+    using pixel_type = typename Upstream::pixel_type;
+
+    static_assert(is_floating_point_channel_v<channel_type_t<pixel_type>>, "Convert to floating point to resize");
+
+    ResizeStage(Upstream      upstream,
+                std::uint32_t width,
+                std::uint32_t height,
+                std::uint32_t band_rows = k_default_band_rows)
+    : m_upstream(std::move(upstream))
+    , m_width(width)
+    , m_height(height)
+    , m_band_rows(std::max(band_rows, 1u))
+    , m_horizontal(stream_detail::resize_contributions(m_upstream.width(), width))
+    , m_vertical(stream_detail::resize_contributions(m_upstream.height(), height))
+    {
+        if (width == 0 || height == 0 || m_upstream.width() == 0 || m_upstream.height() == 0) {
+            throw ImageError("Unable to resize an empty image");
+        }
+    }
+
+    std::uint32_t width() const noexcept
+    {
+        return m_width;
+    }
+
+    std::uint32_t height() const noexcept
+    {
+        return m_height;
+    }
+
+    std::optional<Band<pixel_type>> next()
+    {
+        if (m_next_row >= m_height) {
+            return std::nullopt;
+        }
+
+        Band<pixel_type> out(m_next_row, m_width, std::min(m_band_rows, m_height - m_next_row));
+        for (std::uint32_t r = 0; r < out.rows; ++r) {
+            const auto& c = m_vertical[out.first_row + r];
+            slide_window(c.first, c.first + static_cast<std::uint32_t>(c.weights.size()));
+
+            pixel_type* const dst = out.row(r);
+            for (std::uint32_t x = 0; x < m_width; ++x) {
+                auto sum = stream_detail::zero_pixel<accumulator>();
+                for (std::size_t k = 0; k < c.weights.size(); ++k) {
+                    sum += c.weights[k] * m_window[c.first - m_window_first + k][x];
+                }
+                dst[x] = pixel_type(sum);
+            }
+        }
+        m_next_row += out.rows;
+        return out;
+    }
+
+private:
+    // Makes the window hold exactly the horizontally resized source rows [first, last).
+    void slide_window(std::uint32_t first, std::uint32_t last)
+    {
+        while (m_window_first < first && !m_window.empty()) {
+            m_window.pop_front();
+            ++m_window_first;
+        }
+        while (m_window_first + m_window.size() < last) {
+            if (!m_input || m_input_row == m_input->rows) {
+                m_input     = m_upstream.next();
+                m_input_row = 0;
+                if (!m_input) {
+                    throw ImageError("Truncated image data");
+                }
+            }
+            m_window.push_back(resize_row(m_input->row(m_input_row++)));
+        }
+    }
+
+    std::vector<accumulator> resize_row(const pixel_type* src) const
+    {
+        std::vector<accumulator> row(m_width, stream_detail::zero_pixel<accumulator>());
+        for (std::uint32_t x = 0; x < m_width; ++x) {
+            const auto& c = m_horizontal[x];
+            for (std::size_t k = 0; k < c.weights.size(); ++k) {
+                row[x] += c.weights[k] * accumulator(src[c.first + k]);
+            }
+        }
+        return row;
+    }
+
+    Upstream                                 m_upstream;
+    std::uint32_t                            m_width;
+    std::uint32_t                            m_height;
+    std::uint32_t                            m_band_rows;
+    std::vector<stream_detail::Contribution> m_horizontal;
+    std::vector<stream_detail::Contribution> m_vertical;
+    std::deque<std::vector<accumulator>>     m_window;
+    std::uint32_t                            m_window_first{ 0 };
+    std::optional<Band<pixel_type>>          m_input;
+    std::uint32_t                            m_input_row{ 0 };
+    std::uint32_t                            m_next_row{ 0 };
+};
+
+template <band_source Upstream>
+ResizeStage<Upstream> resize_stream(Upstream      upstream,
+                                    std::uint32_t width,
+                                    std::uint32_t height,
+                                    std::uint32_t band_rows = k_default_band_rows)
+{
+    return ResizeStage<Upstream>(std::move(upstream), width, height, band_rows);
+}
+
+// -------------------------------------------------------------------------------------------------------------------
+// Writers
+// -------------------------------------------------------------------------------------------------------------------
+
+// Binary PPM from RGB8 or RGB16 bands.
+template <band_source Source>
+void write_ppm_stream(Source& source, std::ostream& outs)
+{
+    using Pixel   = typename Source::pixel_type;
+    using channel = channel_type_t<Pixel>;
+    static_assert(std::is_same_v<Pixel, RGB8> || std::is_same_v<Pixel, RGB16>);
+
+    outs << "P6\n" << source.width() << ' ' << source.height() << '\n' << +std::numeric_limits<channel>::max() << '\n';
+
+    std::vector<Pixel> scanline;
+    while (auto band = source.next()) {
+        if constexpr (sizeof(channel) > 1) {
+            scanline.resize(band->pixels.size());
+            std::transform(band->pixels.begin(), band->pixels.end(), scanline.begin(), [](const Pixel& c) {
+                return Pixel(big_endian(c.r), big_endian(c.g), big_endian(c.b));
+            });
+            outs.write(reinterpret_cast<const char*>(scanline.data()),
+                       static_cast<std::streamsize>(scanline.size() * sizeof(Pixel)));
+        } else {
+            outs.write(reinterpret_cast<const char*>(band->pixels.data()),
+                       static_cast<std::streamsize>(band->pixels.size() * sizeof(Pixel)));
+        }
+    }
+    if (!outs) {
+        throw ImageError("Unable to write image data");
+    }
+}
+
+template <band_source Source>
+void write_ppm_stream(Source& source, const std::filesystem::path& file)
+{
+    auto outs = stream_detail::open_output(file);
+    write_ppm_stream(source, outs);
+}
+
+// PFM from RGBf or RGBh bands.
+template <band_source Source>
+void write_pfm_stream(Source& source, std::ostream& outs)
+{
+    using Pixel = typename Source::pixel_type;
+    static_assert(std::is_same_v<Pixel, RGBf> || std::is_same_v<Pixel, RGBh>);
+
+    constexpr int byte_order = (std::endian::native == std::endian::little) ? -1 : +1;
+    outs << "PF\n" << source.width() << ' ' << source.height() << '\n' << byte_order << '\n';
+
+    std::vector<float> values;
+    while (auto band = source.next()) {
+        if constexpr (std::is_same_v<Pixel, RGBh>) {
+            values.resize(3 * band->pixels.size());
+            convert_half_to_float(&band->pixels.data()->r, values.data(), values.size());
+            outs.write(reinterpret_cast<const char*>(values.data()),
+                       static_cast<std::streamsize>(values.size() * sizeof(float)));
+        } else {
+            outs.write(reinterpret_cast<const char*>(band->pixels.data()),
+                       static_cast<std::streamsize>(band->pixels.size() * sizeof(Pixel)));
+        }
+    }
+    if (!outs) {
+        throw ImageError("Unable to write image data");
+    }
+}
+
+template <band_source Source>
+void write_pfm_stream(Source& source, const std::filesystem::path& file)
+{
+    auto outs = stream_detail::open_output(file);
+    write_pfm_stream(source, outs);
+}
@@ -0,0 +1,415 @@
+#pragma once
+
+#include "Array2D.h"
+#include "ImageExpression.h"
+#include "Morton.h"
+#include "Parallel.h"
+#include "Transcode.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <execution>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+// Non-owning views of a rectangle of an image, for cropping, padding, and compositing without copying.
+//     Array2D<RGBf> canvas(1920, 1080);
+//     blit(std::execution::par, crop(canvas, 100, 50, 640, 480), view(photo));
+//
+// ImageView is row-major with a stride, and views any rectangle of an Array2D. TiledImageView views a tile-aligned
+// rectangle of an Array2DSFC: its origin is on a tile corner, so each of its tiles is one of the array's tiles, still
+// contiguous and in Morton order. A view of const T is read-only (ConstImageView, ConstTiledImageView).
+//
+// Views are cheap to copy and, like std::span, do not propagate const: a const ImageView<T> still writes. They satisfy
+// image_container, so expressions, convert_image, the samplers and the writers take them, but since a view's storage
+// index depends on its parent, their layout_type is mixed_layout and they are read through operator(). blit() is the
+// fast path between views: a memcpy per row or per tile where the layouts match, and a transcode between row-major
+// and tiled.
+//
+// A view must not outlive the image it refers to, nor an operation that reallocates it.
+
+template <typename T, typename index_t = std::uint32_t>
+class ImageView
+{
+public:
+    using size_type       = index_t;
+    using value_type      = std::remove_const_t<T>;
+    using element_type    = T;
+    using reference       = T&;
+    using const_reference = const T&;
+    using pointer         = T*;
+    using layout_type     = mixed_layout;
+
+    ImageView() noexcept = default;
+
+    // stride is the distance between rows, in elements.
+    ImageView(pointer data, size_type width, size_type height, size_type stride) noexcept
+    : m_data(data)
+    , m_width(width)
+    , m_height(height)
+    , m_stride(stride)
+    {
+        assert(stride >= width);
+    }
+
+    // A view of T converts to a view of const T.
+    template <typename U>
+    requires std::is_convertible_v<U (*)[], T (*)[]>
+    ImageView(const ImageView<U, index_t>& other) noexcept
+    : ImageView(other.data(), other.width(), other.height(), other.stride())
+    {
+    }
+
+    size_type width() const noexcept
+    {
+        return m_width;
+    }
+
+    size_type height() const noexcept
+    {
+        return m_height;
+    }
+
+    size_type stride() const noexcept
+    {
+        return m_stride;
+    }
+
+    reference operator()(size_type x, size_type y) const noexcept
+    {
+        assert(x < m_width && y < m_height);
+        return m_data[std::size_t{ y } * m_stride + x];
+    }
+
+    pointer row(size_type y) const noexcept
+    {
+        assert(y < m_height);
+        return m_data + std::size_t{ y } * m_stride;
+    }
+
+    // The element at (0, 0).
+    pointer data() const noexcept
+    {
+        return m_data;
+    }
+
+    // Rows are contiguous with each other: the whole view is one run of width * height elements.
+    bool contiguous() const noexcept
+    {
+        return m_stride == m_width || m_height <= 1;
+    }
+
+    ImageView subview(size_type x, size_type y, size_type width, size_type height) const noexcept
+    {
+        assert(x + width <= m_width && y + height <= m_height);
+        return ImageView(m_data + std::size_t{ y } * m_stride + x, width, height, m_stride);
+    }
+
+private:
+    pointer   m_data{ nullptr };
+    size_type m_width{ 0 };
+    size_type m_height{ 0 };
+    size_type m_stride{ 0 };
+};
+
+template <typename T, typename index_t = std::uint32_t>
+using ConstImageView = ImageView<const T, index_t>;
+
+template <typename T, std::uint32_t log_tile_size = 4, typename index_t = std::uint32_t>
+class TiledImageView
+{
+    static constexpr int k_tile_width  = 1 << log_tile_size;
+    static constexpr int k_tile_height = 1 << log_tile_size;
+
+public:
+    using size_type       = index_t;
+    using value_type      = std::remove_const_t<T>;
+    using element_type    = T;
+    using reference       = T&;
+    using const_reference = const T&;
+    using pointer         = T*;
+    using layout_type     = mixed_layout;
+
+    static constexpr size_type tile_width  = k_tile_width;
+    static constexpr size_type tile_height = k_tile_height;
+    static constexpr size_type tile_area   = k_tile_width * k_tile_height;
+
+    TiledImageView() noexcept = default;
+
+    // data is the first slot of the view's top-left tile, and tile_row_stride the distance between vertically adjacent
+    // tiles, in elements: tile_area times the tiles per row of the parent.
+    TiledImageView(pointer data, size_type width, size_type height, size_type tile_row_stride) noexcept
+    : m_data(data)
+    , m_width(width)
+    , m_height(height)
+    , m_tile_row_stride(tile_row_stride)
+    {
+    }
+
+    template <typename U>
+    requires std::is_convertible_v<U (*)[], T (*)[]>
+    TiledImageView(const TiledImageView<U, log_tile_size, index_t>& other) noexcept
+    : TiledImageView(other.data(), other.width(), other.height(), other.tile_row_stride())
+    {
+    }
+
+    size_type width() const noexcept
+    {
+        return m_width;
+    }
+
+    size_type height() const noexcept
+    {
+        return m_height;
+    }
+
+    size_type tile_row_stride() const noexcept
+    {
+        return m_tile_row_stride;
+    }
+
+    size_type num_tiles_width() const noexcept
+    {
+        return (m_width + k_tile_width - 1) >> log_tile_size;
+    }
+
+    size_type num_tiles_height() const noexcept
+    {
+        return (m_height + k_tile_height - 1) >> log_tile_size;
+    }
+
+    reference operator()(size_type x, size_type y) const noexcept
+    {
+        assert(x < m_width && y < m_height);
+        return tile_data(x >> log_tile_size, y >> log_tile_size)[morton_tile_index<log_tile_size>(
+            static_cast<std::uint32_t>(x & (k_tile_width - 1)), static_cast<std::uint32_t>(y & (k_tile_height - 1)))];
+    }
+
+    // The tile's tile_area slots in Morton order. Tiles at the right and bottom edges of the view may hold elements
+    // of the parent outside the view, or the parent's padding.
+    pointer tile_data(size_type tile_x, size_type tile_y) const noexcept
+    {
+        return m_data + std::size_t{ tile_y } * m_tile_row_stride + (std::size_t{ tile_x } << (2 * log_tile_size));
+    }
+
+    pointer data() const noexcept
+    {
+        return m_data;
+    }
+
+    // A tile-aligned rectangle of this view: x and y are multiples of the tile size.
+    TiledImageView subview(size_type x, size_type y, size_type width, size_type height) const noexcept
+    {
+        assert(x % k_tile_width == 0 && y % k_tile_height == 0);
+        assert(x + width <= m_width && y + height <= m_height);
+        return TiledImageView(tile_data(x >> log_tile_size, y >> log_tile_size), width, height, m_tile_row_stride);
+    }
+
+private:
+    pointer   m_data{ nullptr };
+    size_type m_width{ 0 };
+    size_type m_height{ 0 };
+    size_type m_tile_row_stride{ 0 };
+};
+
+template <typename T, std::uint32_t log_tile_size = 4, typename index_t = std::uint32_t>
+using ConstTiledImageView = TiledImageView<const T, log_tile_size, index_t>;
+
+template <typename T>
+struct is_image_view : std::false_type
+{
+};
+
+template <typename T, typename index_t>
+struct is_image_view<ImageView<T, index_t>> : std::true_type
+{
+};
+
+template <typename T, std::uint32_t log_tile_size, typename index_t>
+struct is_image_view<TiledImageView<T, log_tile_size, index_t>> : std::true_type
+{
+};
+
+template <typename T>
+inline constexpr bool is_image_view_v = is_image_view<std::remove_cvref_t<T>>::value;
+
+// Views of whole images. A view of a view is the view itself.
+template <typename T, typename allocator_t, typename index_t>
+ImageView<T, index_t> view(Array2D<T, allocator_t, index_t>& img) noexcept
+{
+    return ImageView<T, index_t>(std::to_address(img.data()), img.width(), img.height(), img.width());
+}
+
+template <typename T, typename allocator_t, typename index_t>
+ConstImageView<T, index_t> view(const Array2D<T, allocator_t, index_t>& img) noexcept
+{
+    return ConstImageView<T, index_t>(std::to_address(img.data()), img.width(), img.height(), img.width());
+}
+
+template <typename T, std::uint32_t log_tile_size, typename allocator_t, typename index_t>
+TiledImageView<T, log_tile_size, index_t> view(Array2DSFC<T, log_tile_size, allocator_t, index_t>& img) noexcept
+{
+    return TiledImageView<T, log_tile_size, index_t>(
+        std::to_address(img.data()), img.width(), img.height(), img.num_tiles_width() * img.tile_area);
+}
+
+template <typename T, std::uint32_t log_tile_size, typename allocator_t, typename index_t>
+ConstTiledImageView<T, log_tile_size, index_t> view(
+    const Array2DSFC<T, log_tile_size, allocator_t, index_t>& img) noexcept
+{
+    return ConstTiledImageView<T, log_tile_size, index_t>(
+        std::to_address(img.data()), img.width(), img.height(), img.num_tiles_width() * img.tile_area);
+}
+
+template <typename View>
+requires is_image_view_v<View>
+View view(View v) noexcept
+{
+    return v;
+}
+
+// Images that view() takes: Array2D, Array2DSFC, and the views themselves.
+template <typename Image>
+concept viewable_image = requires(Image& img) { view(img); };
+
+namespace view_detail {
+template <typename T>
+inline constexpr bool is_row_major_view_v = false;
+
+template <typename T, typename index_t>
+inline constexpr bool is_row_major_view_v<ImageView<T, index_t>> = true;
+
+template <typename T>
+inline constexpr bool is_tiled_view_v = false;
+
+template <typename T, std::uint32_t log_tile_size, typename index_t>
+inline constexpr bool is_tiled_view_v<TiledImageView<T, log_tile_size, index_t>> = true;
+
+template <typename Image>
+void check_crop(const Image&                  img,
+                typename Image::size_type x,
+                typename Image::size_type y,
+                typename Image::size_type width,
+                typename Image::size_type height)
+{
+    if (x > img.width() || width > img.width() - x || y > img.height() || height > img.height() - y) {
+        throw std::out_of_range("Crop rectangle outside the image");
+    }
+}
+
+template <typename Image>
+void check_tile_aligned(typename Image::size_type x, typename Image::size_type y)
+{
+    if (x % Image::tile_width != 0 || y % Image::tile_height != 0) {
+        throw std::invalid_argument("Crops of tiled images have to start on a tile corner");
+    }
+}
+} // namespace view_detail
+
+// Images whose view is a TiledImageView: those that readers and transcoders fill a band of rows at a time.
+template <typename Image>
+inline constexpr bool is_tiled_image_v = false;
+
+template <viewable_image Image>
+inline constexpr bool is_tiled_image_v<Image> =
+    view_detail::is_tiled_view_v<std::remove_const_t<decltype(view(std::declval<Image&>()))>>;
+
+// A view of the rectangle at (x, y) of an image or view. Throws std::out_of_range if the rectangle is not inside it,
+// and for tiled images, std::invalid_argument if (x, y) is not a tile corner.
+template <typename Image>
+auto crop(Image&& img,
+          typename std::remove_cvref_t<Image>::size_type x,
+          typename std::remove_cvref_t<Image>::size_type y,
+          typename std::remove_cvref_t<Image>::size_type width,
+          typename std::remove_cvref_t<Image>::size_type height)
+{
+    const auto v = view(img);
+    view_detail::check_crop(v, x, y, width, height);
+    if constexpr (view_detail::is_tiled_view_v<std::remove_const_t<decltype(v)>>) {
+        view_detail::check_tile_aligned<std::remove_const_t<decltype(v)>>(x, y);
+    }
+    return v.subview(x, y, width, height);
+}
+
+// Copies src into dst, which has to have the same dimensions; they may be views or images. Same layouts copy with a
+// memcpy per row (ImageView) or per tile (TiledImageView, interior tiles) when the element type is trivially copyable,
+// and a row-major and a tiled layout are transcoded a tile row at a time (see Transcode.h); anything else is assigned
+// element by element. Rows or tiles are distributed over threads with std::execution::par.
+// The two must not overlap.
+template <typename ExecutionPolicy, typename DstImage, typename SrcImage>
+requires is_execution_policy_v<ExecutionPolicy>
+void blit(ExecutionPolicy&& policy, DstImage&& dst_image, const SrcImage& src_image)
+{
+    const auto dst = view(dst_image);
+    const auto src = view(src_image);
+
+    using Dst       = std::remove_const_t<decltype(dst)>;
+    using Src       = std::remove_const_t<decltype(src)>;
+    using size_type = typename Dst::size_type;
+    using T         = typename Dst::value_type;
+
+    static_assert(!std::is_const_v<typename Dst::element_type>, "Cannot blit into a view of const");
+    assert(dst.width() == src.width() && dst.height() == src.height());
+
+    constexpr bool k_memcpy = std::is_same_v<T, typename Src::value_type> && std::is_trivially_copyable_v<T>;
+
+    const auto assign_rows = [&] {
+        for_each_index(policy, size_type{ 0 }, dst.height(), [&](size_type y) {
+            for (size_type x = 0; x < dst.width(); ++x) {
+                dst(x, y) = static_cast<T>(src(x, y));
+            }
+        });
+    };
+
+    if constexpr (k_memcpy && view_detail::is_row_major_view_v<Dst> && view_detail::is_row_major_view_v<Src>) {
+        if (dst.contiguous() && src.contiguous()) {
+            std::memcpy(dst.data(), src.data(), sizeof(T) * std::size_t{ dst.width() } * dst.height());
+            return;
+        }
+        for_each_index(policy, size_type{ 0 }, dst.height(), [&](size_type y) {
+            std::memcpy(dst.row(y), src.row(y), sizeof(T) * dst.width());
+        });
+    } else if constexpr (k_memcpy && view_detail::is_tiled_view_v<Dst> && view_detail::is_tiled_view_v<Src>) {
+        if constexpr (Dst::tile_area == Src::tile_area) {
+            const size_type tiles_x = dst.num_tiles_width();
+            const size_type tiles   = tiles_x * dst.num_tiles_height();
+            for_each_index(policy, size_type{ 0 }, tiles, [&](size_type tile_index) {
+                const size_type tile_x = tile_index % tiles_x;
+                const size_type tile_y = tile_index / tiles_x;
+                const size_type x0     = tile_x * Dst::tile_width;
+                const size_type y0     = tile_y * Dst::tile_height;
+                if (x0 + Dst::tile_width <= dst.width() && y0 + Dst::tile_height <= dst.height()) {
+                    std::memcpy(dst.tile_data(tile_x, tile_y),
+                                src.tile_data(tile_x, tile_y),
+                                sizeof(T) * Dst::tile_area);
+                    return;
+                }
+                // Edge tile of the view: its other slots belong to the rest of the parent, or are its padding.
+                const size_type x1 = std::min<size_type>(x0 + Dst::tile_width, dst.width());
+                const size_type y1 = std::min<size_type>(y0 + Dst::tile_height, dst.height());
+                for (size_type y = y0; y < y1; ++y) {
+                    for (size_type x = x0; x < x1; ++x) {
+                        dst(x, y) = src(x, y);
+                    }
+                }
+            });
+        } else {
+            assign_rows();
+        }
+    } else if constexpr (k_memcpy && view_detail::is_tiled_view_v<Dst> && view_detail::is_row_major_view_v<Src>) {
+        transcode_detail::rows_to_tiles(policy, dst, src);
+    } else if constexpr (k_memcpy && view_detail::is_row_major_view_v<Dst> && view_detail::is_tiled_view_v<Src>) {
+        transcode_detail::tiles_to_rows(policy, dst, src);
+    } else {
+        assign_rows();
+    }
+}
+
+template <typename DstImage, typename SrcImage>
+void blit(DstImage&& dst, const SrcImage& src)
+{
+    blit(std::execution::seq, std::forward<DstImage>(dst), src);
+}
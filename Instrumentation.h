@@ -0,0 +1,337 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+#if defined(IMAGE_LIBRARY_INSTRUMENTATION)
+    #include <algorithm>
+    #include <atomic>
+    #include <chrono>
+    #include <iomanip>
+    #include <map>
+    #include <memory>
+    #include <mutex>
+    #include <vector>
+#endif
+
+// Timers and counters for the library's hot paths: where the time of a read goes (header parsing, payload decoding,
+// sample conversion) and how many bytes, pixels and allocations it took.
+//     IMAGE_LIBRARY_TIMED_SCOPE("read_ppm_8");
+//     IMAGE_LIBRARY_COUNT(bytes_read, payload.size());
+//
+// Everything compiles away unless IMAGE_LIBRARY_INSTRUMENTATION is defined; the macros do not even evaluate their
+// arguments. When enabled, each thread records into its own log, without locks or allocations: a thread takes a lock
+// once, to get a log, and hands it back for reuse when it exits. A log holds a thread's most recent events; the summary
+// says how many older ones were dropped. Timer names have to be string literals.
+//
+// write_summary() and write_chrome_trace() (for chrome://tracing or Perfetto) read every thread's log, so call them,
+// and reset(), while no instrumented work is running.
+
+namespace instrumentation {
+enum class Counter
+{
+    bytes_read,
+    bytes_written,
+    pixels_converted,
+    allocations,
+    bytes_allocated,
+    cache_hits,
+    cache_misses
+};
+
+inline constexpr std::array<std::string_view, 7> k_counter_names{ "bytes_read",       "bytes_written",
+                                                                   "pixels_converted", "allocations",
+                                                                   "bytes_allocated",  "cache_hits",
+                                                                   "cache_misses" };
+
+#if defined(IMAGE_LIBRARY_INSTRUMENTATION)
+namespace detail {
+using clock = std::chrono::steady_clock;
+
+struct Event
+{
+    const char*  name;
+    std::int64_t begin_ns;
+    std::int64_t end_ns;
+};
+
+// The last k_capacity events of a thread, in a ring: a long-running process keeps a fixed amount per thread, and
+// recording never allocates. Older events are overwritten and counted as dropped.
+struct ThreadLog
+{
+    static constexpr std::size_t k_capacity = std::size_t{ 1 } << 14;
+
+    explicit ThreadLog(std::uint32_t id)
+    : thread_id(id)
+    , events(std::make_unique<Event[]>(k_capacity))
+    {
+    }
+
+    void record(const Event& e) noexcept
+    {
+        const std::uint64_t n = recorded.load(std::memory_order_relaxed);
+        events[n % k_capacity] = e;
+        recorded.store(n + 1, std::memory_order_release);
+    }
+
+    std::uint64_t dropped() const noexcept
+    {
+        const std::uint64_t n = recorded.load(std::memory_order_acquire);
+        return (n > k_capacity) ? n - k_capacity : 0;
+    }
+
+    // Oldest first.
+    template <typename Function>
+    void for_each_event(Function f) const
+    {
+        const std::uint64_t n = recorded.load(std::memory_order_acquire);
+        for (std::uint64_t i = n - std::min<std::uint64_t>(n, k_capacity); i < n; ++i) {
+            f(events[i % k_capacity]);
+        }
+    }
+
+    void clear() noexcept
+    {
+        recorded.store(0, std::memory_order_relaxed);
+    }
+
+    std::uint32_t                                                  thread_id;
+    std::unique_ptr<Event[]>                                       events;
+    std::atomic<std::uint64_t>                                     recorded{ 0 };
+    std::atomic<bool>                                              in_use{ true };
+    std::array<std::atomic<std::uint64_t>, k_counter_names.size()> counters{};
+};
+
+class Registry
+{
+public:
+    // Never destroyed: threads of static pools (TaskScheduler::global()) may still exit, and hand back their logs,
+    // during static destruction.
+    static Registry& instance()
+    {
+        static Registry& registry = *new Registry;
+        return registry;
+    }
+
+    // The calling thread's log, or nullptr if one could not be allocated, in which case nothing is recorded.
+    ThreadLog* local() noexcept
+    {
+        thread_local const Lease lease(*this);
+        return lease.log;
+    }
+
+    std::int64_t now_ns() const noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - m_epoch).count();
+    }
+
+    template <typename Function>
+    void for_each_log(Function f)
+    {
+        std::scoped_lock lock(m_mutex);
+        for (const auto& log : m_logs) {
+            f(*log);
+        }
+    }
+
+private:
+    // Hands a log back when its thread exits. The log keeps its events, so they are still written, until a new thread
+    // takes it over: there are only ever as many logs as threads were running at once.
+    struct Lease
+    {
+        explicit Lease(Registry& registry) noexcept
+        : log(registry.acquire())
+        {
+        }
+
+        ~Lease()
+        {
+            if (log) {
+                log->in_use.store(false, std::memory_order_release);
+            }
+        }
+
+        ThreadLog* log;
+    };
+
+    ThreadLog* acquire() noexcept
+    {
+        try {
+            std::scoped_lock lock(m_mutex);
+            for (const auto& log : m_logs) {
+                bool expected = false;
+                if (log->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                    return log.get();
+                }
+            }
+            m_logs.push_back(std::make_unique<ThreadLog>(static_cast<std::uint32_t>(m_logs.size())));
+            return m_logs.back().get();
+        } catch (...) {
+            return nullptr;
+        }
+    }
+
+    clock::time_point                       m_epoch{ clock::now() };
+    std::mutex                              m_mutex;
+    std::vector<std::unique_ptr<ThreadLog>> m_logs;
+};
+} // namespace detail
+
+inline void add(Counter counter, std::uint64_t n) noexcept
+{
+    if (auto* const log = detail::Registry::instance().local()) {
+        log->counters[static_cast<std::size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+    }
+}
+
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(const char* name) noexcept
+    : m_name(name)
+    , m_begin_ns(detail::Registry::instance().now_ns())
+    {
+    }
+
+    ScopedTimer(const ScopedTimer&)            = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    ~ScopedTimer()
+    {
+        auto& registry = detail::Registry::instance();
+        if (auto* const log = registry.local()) {
+            log->record(detail::Event{ m_name, m_begin_ns, registry.now_ns() });
+        }
+    }
+
+private:
+    const char*  m_name;
+    std::int64_t m_begin_ns;
+};
+
+inline void reset()
+{
+    detail::Registry::instance().for_each_log([](detail::ThreadLog& log) {
+        log.clear();
+        for (auto& c : log.counters) {
+            c.store(0, std::memory_order_relaxed);
+        }
+    });
+}
+
+// Per timer: calls, total, mean and longest time; then the counter totals.
+inline void write_summary(std::ostream& outs)
+{
+    struct Stats
+    {
+        std::uint64_t calls{ 0 };
+        std::int64_t  total_ns{ 0 };
+        std::int64_t  max_ns{ 0 };
+    };
+
+    std::map<std::string_view, Stats>                 timers;
+    std::array<std::uint64_t, k_counter_names.size()> counters{};
+    std::uint64_t                                     dropped = 0;
+    detail::Registry::instance().for_each_log([&](const detail::ThreadLog& log) {
+        log.for_each_event([&](const detail::Event& e) {
+            Stats& s = timers[e.name];
+            ++s.calls;
+            s.total_ns += e.end_ns - e.begin_ns;
+            s.max_ns = std::max(s.max_ns, e.end_ns - e.begin_ns);
+        });
+        dropped += log.dropped();
+        for (std::size_t c = 0; c < counters.size(); ++c) {
+            counters[c] += log.counters[c].load(std::memory_order_relaxed);
+        }
+    });
+
+    const auto ms = [](std::int64_t ns) { return static_cast<double>(ns) / 1e6; };
+    outs << std::left << std::setw(40) << "timer" << std::right << std::setw(10) << "calls" << std::setw(14)
+         << "total ms" << std::setw(14) << "mean ms" << std::setw(14) << "max ms" << '\n';
+    for (const auto& [name, s] : timers) {
+        outs << std::left << std::setw(40) << name << std::right << std::setw(10) << s.calls << std::fixed
+             << std::setprecision(3) << std::setw(14) << ms(s.total_ns) << std::setw(14)
+             << ms(s.total_ns) / static_cast<double>(s.calls) << std::setw(14) << ms(s.max_ns) << '\n';
+    }
+    outs << '\n';
+    for (std::size_t c = 0; c < counters.size(); ++c) {
+        outs << std::left << std::setw(40) << k_counter_names[c] << std::right << std::setw(10) << counters[c]
+             << '\n';
+    }
+    if (dropped > 0) {
+        outs << std::left << std::setw(40) << "events dropped" << std::right << std::setw(10) << dropped << '\n';
+    }
+    outs << std::defaultfloat;
+}
+
+// The Chrome trace event format: one complete ("X") event per timed scope, on the thread that ran it, and the counter
+// totals as a counter ("C") event at the end.
+inline void write_chrome_trace(std::ostream& outs)
+{
+    const auto us = [](std::int64_t ns) { return static_cast<double>(ns) / 1e3; };
+
+    std::int64_t                                      last_ns = 0;
+    std::array<std::uint64_t, k_counter_names.size()> counters{};
+    bool                                              first   = true;
+
+    outs << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+    detail::Registry::instance().for_each_log([&](const detail::ThreadLog& log) {
+        log.for_each_event([&](const detail::Event& e) {
+            outs << (first ? "" : ",\n") << R"({"name":")" << e.name << R"(","ph":"X","pid":1,"tid":)"
+                 << log.thread_id << ",\"ts\":" << us(e.begin_ns) << ",\"dur\":" << us(e.end_ns - e.begin_ns)
+                 << '}';
+            first   = false;
+            last_ns = std::max(last_ns, e.end_ns);
+        });
+        for (std::size_t c = 0; c < counters.size(); ++c) {
+            counters[c] += log.counters[c].load(std::memory_order_relaxed);
+        }
+    });
+    outs << (first ? "" : ",\n") << R"({"name":"counters","ph":"C","pid":1,"ts":)" << us(last_ns) << ",\"args\":{";
+    for (std::size_t c = 0; c < counters.size(); ++c) {
+        outs << (c ? "," : "") << '"' << k_counter_names[c] << "\":" << counters[c];
+    }
+    outs << "}}\n],\"displayTimeUnit\":\"ms\"}\n" << std::defaultfloat;
+}
+#else
+inline void add(Counter, std::uint64_t) noexcept
+{
+}
+
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(const char*) noexcept
+    {
+    }
+};
+
+inline void reset()
+{
+}
+
+inline void write_summary(std::ostream&)
+{
+}
+
+inline void write_chrome_trace(std::ostream&)
+{
+}
+#endif
+} // namespace instrumentation
+
+#define IMAGE_LIBRARY_INSTRUMENTATION_CONCAT_(a, b) a##b
+#define IMAGE_LIBRARY_INSTRUMENTATION_CONCAT(a, b) IMAGE_LIBRARY_INSTRUMENTATION_CONCAT_(a, b)
+
+#if defined(IMAGE_LIBRARY_INSTRUMENTATION)
+    #define IMAGE_LIBRARY_TIMED_SCOPE(name)                                                                            \
+        const ::instrumentation::ScopedTimer IMAGE_LIBRARY_INSTRUMENTATION_CONCAT(instrumentation_timer_, __LINE__)(   \
+            name)
+    #define IMAGE_LIBRARY_COUNT(counter, n) ::instrumentation::add(::instrumentation::Counter::counter, (n))
+#else
+    #define IMAGE_LIBRARY_TIMED_SCOPE(name) static_cast<void>(0)
+    #define IMAGE_LIBRARY_COUNT(counter, n) static_cast<void>(0)
+#endif
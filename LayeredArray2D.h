@@ -0,0 +1,421 @@
+#pragma once
+
+#include "Array2D.h"
+#include "Morton.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Layer layout tags for LayeredArray2DSFC.
+//
+// interleaved_layers: each tile holds the tile's block of every layer, one after another. Touching all of the layers
+// of a pixel stays within one tile's worth of memory.
+//
+// planar_layers: each layer is a separate plane with the same storage order as Array2DSFC<T, log_tile_size>. Passes
+// that only touch one layer stream through that plane alone.
+struct interleaved_layers
+{
+};
+
+struct planar_layers
+{
+};
+
+// Several images of the same size, e.g., the beauty, normal, depth, and albedo outputs of a renderer, stored with one
+// tiled Morton index shared by every layer. The tile and Morton offsets of (x, y) are computed once, and every layer's
+// element is found from them with a multiply-add.
+//     using AOVs = LayeredArray2DSFC<interleaved_layers, 4, RGBf, RGBf, float, RGBf>;
+//     AOVs aovs(width, height);
+//     auto [beauty, normal, depth, albedo] = aovs(x, y);
+//
+// Layers are plain pixel data: they must be trivially copyable and destructible. Every slot, including the padding
+// of the edge tiles, is value-initialized.
+template <typename LayerLayout, std::uint32_t log_tile_size, typename... Ts>
+class LayeredArray2DSFC
+{
+    static_assert(sizeof...(Ts) > 0, "A layered array needs at least one layer");
+    static_assert((std::is_trivially_copyable_v<Ts> && ...), "Layers must be trivially copyable");
+    static_assert((std::is_trivially_destructible_v<Ts> && ...), "Layers must be trivially destructible");
+    static_assert(std::is_same_v<LayerLayout, interleaved_layers> || std::is_same_v<LayerLayout, planar_layers>,
+                  "Unknown layer layout");
+
+    static constexpr int k_tile_width  = 1 << log_tile_size;
+    static constexpr int k_tile_height = 1 << log_tile_size;
+
+    // Tiles and planes start on cache lines.
+    static constexpr std::size_t k_alignment = std::max({ std::size_t{ 64 }, alignof(Ts)... });
+
+public:
+    using size_type    = std::uint32_t;
+    using layout_type  = morton_tiled_layout<log_tile_size>;
+    using layer_layout = LayerLayout;
+
+    template <std::size_t L>
+    using layer_type = std::tuple_element_t<L, std::tuple<Ts...>>;
+
+    using reference       = std::tuple<Ts&...>;
+    using const_reference = std::tuple<const Ts&...>;
+
+    static constexpr std::size_t layer_count = sizeof...(Ts);
+    static constexpr size_type   tile_width  = k_tile_width;
+    static constexpr size_type   tile_height = k_tile_height;
+    static constexpr size_type   tile_area   = k_tile_width * k_tile_height;
+
+    // The shared part of an element's address: which tile, and where in the tile's Morton order.
+    struct Location
+    {
+        size_type tile_index;
+        size_type index_in_tile;
+    };
+
+    LayeredArray2DSFC() noexcept = default;
+
+    LayeredArray2DSFC(size_type width, size_type height)
+    : m_width(width)
+    , m_height(height)
+    , m_data(allocate(memory_bytes(width, height)))
+    {
+        construct(std::make_index_sequence<layer_count>{}, Ts{}...);
+    }
+
+    LayeredArray2DSFC(size_type width, size_type height, const Ts&... values)
+    : m_width(width)
+    , m_height(height)
+    , m_data(allocate(memory_bytes(width, height)))
+    {
+        construct(std::make_index_sequence<layer_count>{}, values...);
+    }
+
+    LayeredArray2DSFC(const LayeredArray2DSFC& other)
+    : m_width(other.m_width)
+    , m_height(other.m_height)
+    , m_data(allocate(memory_bytes(m_width, m_height)))
+    , m_plane_offsets(other.m_plane_offsets)
+    {
+        if (m_data) {
+            std::memcpy(m_data.get(), other.m_data.get(), memory_bytes(m_width, m_height));
+        }
+    }
+
+    LayeredArray2DSFC(LayeredArray2DSFC&& other) noexcept
+    : m_width(std::exchange(other.m_width, 0))
+    , m_height(std::exchange(other.m_height, 0))
+    , m_data(std::move(other.m_data))
+    , m_plane_offsets(other.m_plane_offsets)
+    {
+    }
+
+    LayeredArray2DSFC& operator=(const LayeredArray2DSFC& other)
+    {
+        if (this != &other) {
+            LayeredArray2DSFC copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    LayeredArray2DSFC& operator=(LayeredArray2DSFC&& other) noexcept
+    {
+        LayeredArray2DSFC moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    void swap(LayeredArray2DSFC& other) noexcept
+    {
+        using std::swap; // Allow ADL
+        swap(m_width, other.m_width);
+        swap(m_height, other.m_height);
+        swap(m_data, other.m_data);
+        swap(m_plane_offsets, other.m_plane_offsets);
+    }
+
+    size_type width() const noexcept
+    {
+        return m_width;
+    }
+
+    size_type height() const noexcept
+    {
+        return m_height;
+    }
+
+    size_type num_tiles_width() const noexcept
+    {
+        return num_tiles_width(m_width);
+    }
+
+    size_type num_tiles_height() const noexcept
+    {
+        return num_tiles_height(m_height);
+    }
+
+    // This is the only place the Morton code is computed.
+    Location locate(size_type x, size_type y) const noexcept
+    {
+        assert(x < m_width && y < m_height);
+        const size_type tile_x = x >> log_tile_size;
+        const size_type tile_y = y >> log_tile_size;
+        return { tile_y * num_tiles_width(m_width) + tile_x,
+                 morton_tile_index<log_tile_size>(x & (k_tile_width - 1), y & (k_tile_height - 1)) };
+    }
+
+    // Matches Array2DSFC<T, log_tile_size>::storage_index for an array of the same size.
+    static size_type storage_index(const Location& loc) noexcept
+    {
+        return loc.tile_index * tile_area + loc.index_in_tile;
+    }
+
+    template <std::size_t L>
+    layer_type<L>& layer(const Location& loc) noexcept
+    {
+        return *std::launder(reinterpret_cast<layer_type<L>*>(m_data.get() + byte_offset<L>(loc)));
+    }
+
+    template <std::size_t L>
+    const layer_type<L>& layer(const Location& loc) const noexcept
+    {
+        return *std::launder(reinterpret_cast<const layer_type<L>*>(m_data.get() + byte_offset<L>(loc)));
+    }
+
+    template <std::size_t L>
+    layer_type<L>& layer(size_type x, size_type y) noexcept
+    {
+        return layer<L>(locate(x, y));
+    }
+
+    template <std::size_t L>
+    const layer_type<L>& layer(size_type x, size_type y) const noexcept
+    {
+        return layer<L>(locate(x, y));
+    }
+
+    // Every layer of one element.
+    reference operator()(const Location& loc) noexcept
+    {
+        return elements(loc, std::make_index_sequence<layer_count>{});
+    }
+
+    const_reference operator()(const Location& loc) const noexcept
+    {
+        return elements(loc, std::make_index_sequence<layer_count>{});
+    }
+
+    reference operator()(size_type x, size_type y) noexcept
+    {
+        return (*this)(locate(x, y));
+    }
+
+    const_reference operator()(size_type x, size_type y) const noexcept
+    {
+        return (*this)(locate(x, y));
+    }
+
+    // The tile_area elements of layer L in tile (tile_x, tile_y), in Morton order. Both layouts keep a tile's block of
+    // a layer contiguous.
+    template <std::size_t L>
+    layer_type<L>* tile_data(size_type tile_x, size_type tile_y) noexcept
+    {
+        return &layer<L>(Location{ tile_y * num_tiles_width() + tile_x, 0 });
+    }
+
+    template <std::size_t L>
+    const layer_type<L>* tile_data(size_type tile_x, size_type tile_y) const noexcept
+    {
+        return &layer<L>(Location{ tile_y * num_tiles_width() + tile_x, 0 });
+    }
+
+    // Calls f(x, y, layers...) for every element, a tile at a time, with tiles spread over the policy's threads. Each
+    // tile is walked in storage order, so the index is advanced rather than recomputed.
+    template <typename ExecutionPolicy, typename Function>
+    void for_each(ExecutionPolicy&& policy, Function f)
+    {
+        const size_type ntx = num_tiles_width();
+        for_each_index(policy, size_type{ 0 }, ntx * num_tiles_height(), [&](size_type tile_index) {
+            const size_type x0 = (tile_index % ntx) * k_tile_width;
+            const size_type y0 = (tile_index / ntx) * k_tile_height;
+            std::uint32_t ox = 0;
+            std::uint32_t oy = 0;
+            for (size_type i = 0; i < tile_area; next_in_tile(i++, ox, oy)) {
+                const size_type x = x0 + ox;
+                const size_type y = y0 + oy;
+                if (x < m_width && y < m_height) {
+                    std::apply([&](auto&... layers) { f(x, y, layers...); }, (*this)(Location{ tile_index, i }));
+                }
+            }
+        });
+    }
+
+    // A copy of one layer as a stand-alone array, e.g., to write it out. The storage orders match, so this is a copy
+    // a tile at a time with no index computation.
+    template <std::size_t L>
+    Array2DSFC<layer_type<L>, log_tile_size> extract_layer() const
+    {
+        Array2DSFC<layer_type<L>, log_tile_size> result(m_width, m_height);
+        const size_type                           ntx = num_tiles_width();
+        const size_type                           nty = num_tiles_height();
+        for (size_type tile_y = 0; tile_y < nty; ++tile_y) {
+            for (size_type tile_x = 0; tile_x < ntx; ++tile_x) {
+                const layer_type<L>* const src = tile_data<L>(tile_x, tile_y);
+                layer_type<L>* const       dst = result.data() + result.tile_storage_index(tile_x, tile_y);
+                std::uint32_t ox = 0;
+                std::uint32_t oy = 0;
+                for (size_type i = 0; i < tile_area; next_in_tile(i++, ox, oy)) {
+                    if (tile_x * k_tile_width + ox < m_width && tile_y * k_tile_height + oy < m_height) {
+                        dst[i] = src[i];
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+private:
+    // Steps (x, y) from Morton index i to i + 1. The increment clears the trailing ones of i, which alternate between
+    // x and y bits starting with x, and sets the bit above them: that coordinate goes up by one, the other loses the
+    // low bits that were cleared.
+    static void next_in_tile(std::uint32_t i, std::uint32_t& x, std::uint32_t& y) noexcept
+    {
+        const auto ones = static_cast<std::uint32_t>(std::countr_one(i));
+        if (ones % 2 == 0) {
+            ++x;
+            y &= ~((1u << (ones / 2)) - 1u);
+        } else {
+            ++y;
+            x &= ~((2u << (ones / 2)) - 1u);
+        }
+    }
+
+    struct Deleter
+    {
+        void operator()(std::byte* p) const noexcept
+        {
+            ::operator delete(p, std::align_val_t{ k_alignment });
+        }
+    };
+
+    using Storage = std::unique_ptr<std::byte[], Deleter>;
+
+    static constexpr std::size_t round_up(std::size_t n, std::size_t alignment) noexcept
+    {
+        return (n + alignment - 1) / alignment * alignment;
+    }
+
+    static constexpr std::array<std::size_t, layer_count> k_layer_sizes{ sizeof(Ts)... };
+    static constexpr std::array<std::size_t, layer_count> k_layer_alignments{ alignof(Ts)... };
+
+    // Interleaved: the offset of each layer's block within a tile.
+    static constexpr std::array<std::size_t, layer_count> k_tile_layer_offsets = [] {
+        std::array<std::size_t, layer_count> offsets{};
+        std::size_t                          offset = 0;
+        for (std::size_t l = 0; l < layer_count; ++l) {
+            offset     = round_up(offset, k_layer_alignments[l]);
+            offsets[l] = offset;
+            offset += tile_area * k_layer_sizes[l];
+        }
+        return offsets;
+    }();
+
+    static constexpr std::size_t k_tile_bytes =
+        round_up(k_tile_layer_offsets[layer_count - 1] + tile_area * k_layer_sizes[layer_count - 1], k_alignment);
+
+    static constexpr size_type num_tiles_width(size_type width) noexcept
+    {
+        return (width + k_tile_width - 1) / k_tile_width;
+    }
+
+    static constexpr size_type num_tiles_height(size_type height) noexcept
+    {
+        return (height + k_tile_height - 1) / k_tile_height;
+    }
+
+    static constexpr std::size_t plane_bytes(std::size_t l, size_type width, size_type height) noexcept
+    {
+        const std::size_t slots = std::size_t{ num_tiles_width(width) } * num_tiles_height(height) * tile_area;
+        return round_up(slots * k_layer_sizes[l], k_alignment);
+    }
+
+    static constexpr std::size_t memory_bytes(size_type width, size_type height) noexcept
+    {
+        if constexpr (std::is_same_v<LayerLayout, interleaved_layers>) {
+            return std::size_t{ num_tiles_width(width) } * num_tiles_height(height) * k_tile_bytes;
+        } else {
+            std::size_t bytes = 0;
+            for (std::size_t l = 0; l < layer_count; ++l) {
+                bytes += plane_bytes(l, width, height);
+            }
+            return bytes;
+        }
+    }
+
+    static Storage allocate(std::size_t bytes)
+    {
+        if (bytes == 0) {
+            return nullptr;
+        }
+        return Storage(static_cast<std::byte*>(::operator new(bytes, std::align_val_t{ k_alignment })));
+    }
+
+    template <std::size_t L>
+    std::size_t byte_offset(const Location& loc) const noexcept
+    {
+        if constexpr (std::is_same_v<LayerLayout, interleaved_layers>) {
+            return loc.tile_index * k_tile_bytes + k_tile_layer_offsets[L] + loc.index_in_tile * sizeof(layer_type<L>);
+        } else {
+            return m_plane_offsets[L] + storage_index(loc) * sizeof(layer_type<L>);
+        }
+    }
+
+    template <std::size_t... L>
+    reference elements(const Location& loc, std::index_sequence<L...>) noexcept
+    {
+        return reference(layer<L>(loc)...);
+    }
+
+    template <std::size_t... L>
+    const_reference elements(const Location& loc, std::index_sequence<L...>) const noexcept
+    {
+        return const_reference(layer<L>(loc)...);
+    }
+
+    template <std::size_t... L>
+    void construct(std::index_sequence<L...>, const Ts&... values)
+    {
+        if constexpr (std::is_same_v<LayerLayout, planar_layers>) {
+            std::size_t offset = 0;
+            for (std::size_t l = 0; l < layer_count; ++l) {
+                m_plane_offsets[l] = offset;
+                offset += plane_bytes(l, m_width, m_height);
+            }
+        }
+
+        const size_type ntiles = num_tiles_width() * num_tiles_height();
+        for (size_type t = 0; t < ntiles; ++t) {
+            (std::uninitialized_fill_n(tile_data_of<L>(t), tile_area, values), ...);
+        }
+    }
+
+    template <std::size_t L>
+    layer_type<L>* tile_data_of(size_type tile_index) noexcept
+    {
+        return reinterpret_cast<layer_type<L>*>(m_data.get() + byte_offset<L>(Location{ tile_index, 0 }));
+    }
+
+    size_type m_width{ 0 };
+    size_type m_height{ 0 };
+    Storage   m_data;
+
+    // Planar: the byte offset of each plane. Unused when interleaved.
+    std::array<std::size_t, layer_count> m_plane_offsets{};
+};
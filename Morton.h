@@ -4,7 +4,9 @@
 
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <type_traits>
 
 inline std::uint64_t morton_encode(std::uint32_t x, std::uint32_t y) noexcept
 {
@@ -43,7 +45,7 @@ inline void morton_decode(std::uint64_t d, std::uint32_t& x, std::uint32_t& y) n
     y = morton_decode_1(d >> 1ull);
 }
 
-inline std::uint32_t morton_encode(std::uint16_t x, std::uint16_t y) noexcept
+constexpr std::uint32_t morton_encode(std::uint16_t x, std::uint16_t y) noexcept
 {
     std::uint32_t a(x);
     a = (a | (a << 8ul)) & 0x00FF00FFul;
@@ -87,3 +89,55 @@ inline void morton_decode(std::uint32_t d, std::uint16_t& x, std::uint16_t& y) n
     y = morton_decode_y(d);
 }
 
+// The Morton index of a position inside a square tile of side 2^log_size, for the fixed tile geometries of Array2DSFC.
+// Up to 16x16 tiles one table, of at most 256 bytes, holds the index of every position; up to 256x256 tiles the index
+// is put together from one table of spread bits for both axes; larger tiles compute it.
+namespace morton_detail {
+constexpr std::uint32_t k_max_log_position_table = 4;
+constexpr std::uint32_t k_max_log_spread_table   = 8;
+
+template <std::uint32_t log_size>
+using tile_index_t = std::conditional_t<(log_size <= 4), std::uint8_t, std::uint16_t>;
+
+// Indexed with (y << log_size) | x.
+template <std::uint32_t log_size>
+inline constexpr auto k_position_table = [] {
+    constexpr std::uint32_t                                        size = 1u << log_size;
+    std::array<tile_index_t<log_size>, std::size_t{ size } * size> t{};
+    for (std::uint32_t y = 0; y < size; ++y) {
+        for (std::uint32_t x = 0; x < size; ++x) {
+            t[(y << log_size) | x] = static_cast<tile_index_t<log_size>>(
+                morton_encode(static_cast<std::uint16_t>(x), static_cast<std::uint16_t>(y)));
+        }
+    }
+    return t;
+}();
+
+// The bits of v moved to the even positions: the x part of a Morton index; shifted left by one, the y part.
+template <std::uint32_t log_size>
+inline constexpr auto k_spread_table = [] {
+    std::array<std::uint16_t, std::size_t{ 1 } << log_size> t{};
+    for (std::uint32_t v = 0; v < t.size(); ++v) {
+        t[v] = static_cast<std::uint16_t>(morton_encode(static_cast<std::uint16_t>(v), std::uint16_t{ 0 }));
+    }
+    return t;
+}();
+} // namespace morton_detail
+
+// x and y have to be less than 2^log_size.
+template <std::uint32_t log_size>
+constexpr std::uint32_t morton_tile_index(std::uint32_t x, std::uint32_t y) noexcept
+{
+    static_assert(log_size <= 16, "Tiles are at most 65536 on a side");
+    if constexpr (log_size <= morton_detail::k_max_log_position_table) {
+        return morton_detail::k_position_table<log_size>[(y << log_size) | x];
+    } else if constexpr (log_size <= morton_detail::k_max_log_spread_table) {
+        return morton_detail::k_spread_table<log_size>[x] | (morton_detail::k_spread_table<log_size>[y] << 1u);
+    } else {
+        return morton_encode(static_cast<std::uint16_t>(x), static_cast<std::uint16_t>(y));
+    }
+}
+
+static_assert(morton_tile_index<2>(3, 1) == 0b0111);
+static_assert(morton_tile_index<4>(15, 15) == 255);
+static_assert(morton_tile_index<6>(5, 9) == morton_encode(std::uint16_t{ 5 }, std::uint16_t{ 9 }));
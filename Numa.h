@@ -0,0 +1,321 @@
+#pragma once
+
+#include "Array2D.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#if defined(IMAGE_LIBRARY_NUMA)
+    #include <numa.h>
+    #include <numaif.h>
+    #include <sched.h>
+    #include <unistd.h>
+#endif
+
+// NUMA placement of Array2DSFC storage on multi-socket hosts.
+//     using Image = Array2DSFC<RGBf, 4, NumaAllocator<RGBf>>;
+//     Image img(std::execution::par, width, height, NumaAllocator<RGBf>(NumaPlacement::block));
+//     numa_for_each_tile(img, [&](std::uint32_t tile_index) { ... });
+//
+// first_touch leaves placement to the kernel: a page lands on the node of the thread that first writes it.
+// interleave spreads the pages round-robin over the nodes, which balances bandwidth but gives no locality.
+// block splits the storage into one contiguous range per node. Tiles are stored contiguously in row-major tile order,
+// so each node owns a band of tiles, and numa_for_each_tile runs each band on threads bound to its node.
+//
+// Built without IMAGE_LIBRARY_NUMA (Linux, libnuma), or on a host without NUMA support, there is one node and the
+// allocator behaves like std::allocator.
+
+enum class NumaPlacement
+{
+    first_touch,
+    interleave,
+    block
+};
+
+namespace numa_detail {
+inline bool available() noexcept
+{
+#if defined(IMAGE_LIBRARY_NUMA)
+    static const bool available = numa_available() >= 0;
+    return available;
+#else
+    return false;
+#endif
+}
+
+inline std::size_t page_size() noexcept
+{
+#if defined(IMAGE_LIBRARY_NUMA)
+    static const auto size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    return size;
+#else
+    return 4096;
+#endif
+}
+
+// Block placement: page p of an allocation of page_count pages belongs to node p * nodes / page_count.
+inline unsigned block_node_of_page(std::size_t page, std::size_t page_count, unsigned nodes) noexcept
+{
+    return static_cast<unsigned>(page * nodes / page_count);
+}
+
+inline std::size_t block_first_page(unsigned node, std::size_t page_count, unsigned nodes) noexcept
+{
+    return (node * page_count + nodes - 1) / nodes;
+}
+
+#if defined(IMAGE_LIBRARY_NUMA)
+template <typename Index>
+struct Chunk
+{
+    unsigned node;
+    Index    begin;
+    Index    end;
+};
+
+// Runs the calling thread (a worker of the shared pool, or the thread that is waiting on it) on the CPUs of a node for
+// the binding's lifetime, and then puts back the nodes it ran on before.
+class NodeBinding
+{
+public:
+    explicit NodeBinding(unsigned node) noexcept
+    : m_previous(numa_get_run_node_mask())
+    {
+        numa_run_on_node(static_cast<int>(node));
+    }
+
+    NodeBinding(const NodeBinding&)            = delete;
+    NodeBinding& operator=(const NodeBinding&) = delete;
+
+    ~NodeBinding()
+    {
+        if (m_previous) {
+            numa_run_on_node_mask(m_previous);
+            numa_free_nodemask(m_previous);
+        }
+    }
+
+private:
+    struct bitmask* m_previous;
+};
+#endif
+} // namespace numa_detail
+
+inline unsigned numa_node_count() noexcept
+{
+#if defined(IMAGE_LIBRARY_NUMA)
+    if (numa_detail::available()) {
+        return static_cast<unsigned>(std::max(numa_num_configured_nodes(), 1));
+    }
+#endif
+    return 1;
+}
+
+// The node the calling thread is running on.
+inline unsigned numa_current_node() noexcept
+{
+#if defined(IMAGE_LIBRARY_NUMA)
+    if (numa_detail::available()) {
+        const int cpu = sched_getcpu();
+        if (cpu >= 0) {
+            return static_cast<unsigned>(std::max(numa_node_of_cpu(cpu), 0));
+        }
+    }
+#endif
+    return 0;
+}
+
+// The node that the page holding p currently lives on, or -1 if the page has not been touched or the query fails.
+inline int numa_node_of_address(const void* p) noexcept
+{
+#if defined(IMAGE_LIBRARY_NUMA)
+    if (numa_detail::available()) {
+        const auto page   = reinterpret_cast<std::uintptr_t>(p) & ~(numa_detail::page_size() - 1);
+        void*      pages  = reinterpret_cast<void*>(page);
+        int        status = -1;
+        if (move_pages(0, 1, &pages, nullptr, &status, 0) == 0 && status >= 0) {
+            return status;
+        }
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+// An allocator whose memory is placed over the NUMA nodes according to a NumaPlacement. Allocations are whole pages.
+template <typename T>
+class NumaAllocator
+{
+public:
+    using value_type = T;
+
+    // Copies made by Array2DSFC keep the placement of the source.
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap            = std::true_type;
+
+    explicit NumaAllocator(NumaPlacement placement = NumaPlacement::block) noexcept
+    : m_placement(placement)
+    {
+    }
+
+    template <typename U>
+    NumaAllocator(const NumaAllocator<U>& other) noexcept
+    : m_placement(other.placement())
+    {
+    }
+
+    NumaPlacement placement() const noexcept
+    {
+        return m_placement;
+    }
+
+    T* allocate(std::size_t n)
+    {
+        const std::size_t bytes = n * sizeof(T);
+#if defined(IMAGE_LIBRARY_NUMA)
+        if (numa_detail::available()) {
+            void* p = (m_placement == NumaPlacement::interleave) ? numa_alloc_interleaved(bytes) : numa_alloc(bytes);
+            if (!p) {
+                throw std::bad_alloc();
+            }
+            if (m_placement == NumaPlacement::block) {
+                bind_blocks(static_cast<std::byte*>(p), bytes);
+            }
+            return static_cast<T*>(p);
+        }
+#endif
+        return static_cast<T*>(::operator new(bytes, std::align_val_t{ alignof(T) }));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+#if defined(IMAGE_LIBRARY_NUMA)
+        if (numa_detail::available()) {
+            numa_free(p, n * sizeof(T));
+            return;
+        }
+#endif
+        ::operator delete(p, n * sizeof(T), std::align_val_t{ alignof(T) });
+    }
+
+    // The node that this allocator's placement puts byte offset of an allocation of the given size on, or -1 if the
+    // placement does not decide (first_touch and interleave).
+    int node_of_offset(std::size_t offset, std::size_t bytes) const noexcept
+    {
+        if (m_placement != NumaPlacement::block) {
+            return -1;
+        }
+        const std::size_t page_count = (bytes + numa_detail::page_size() - 1) / numa_detail::page_size();
+        return static_cast<int>(
+            numa_detail::block_node_of_page(offset / numa_detail::page_size(), page_count, numa_node_count()));
+    }
+
+    friend bool operator==(const NumaAllocator& a, const NumaAllocator& b) noexcept
+    {
+        return a.m_placement == b.m_placement;
+    }
+
+private:
+#if defined(IMAGE_LIBRARY_NUMA)
+    static void bind_blocks(std::byte* p, std::size_t bytes) noexcept
+    {
+        const std::size_t page       = numa_detail::page_size();
+        const std::size_t page_count = (bytes + page - 1) / page;
+        const unsigned    nodes      = numa_node_count();
+        for (unsigned node = 0; node < nodes; ++node) {
+            const std::size_t first = numa_detail::block_first_page(node, page_count, nodes);
+            const std::size_t last  = numa_detail::block_first_page(node + 1, page_count, nodes);
+            if (first < last) {
+                numa_tonode_memory(p + first * page, (last - first) * page, static_cast<int>(node));
+            }
+        }
+    }
+#endif
+
+    NumaPlacement m_placement;
+};
+
+// The scheduling hint: the node that owns the tile (the node of its first byte), or -1 if the image's placement does
+// not assign tiles to nodes.
+template <typename T, std::uint32_t log_tile_size, typename allocator_t, typename index_t>
+int numa_tile_node(const Array2DSFC<T, log_tile_size, allocator_t, index_t>& img,
+                   std::type_identity_t<index_t>                            tile_index) noexcept
+{
+    if constexpr (std::is_same_v<allocator_t, NumaAllocator<T>>) {
+        using ImageType = Array2DSFC<T, log_tile_size, allocator_t, index_t>;
+        return img.get_allocator().node_of_offset(std::size_t{ tile_index } * ImageType::tile_area * sizeof(T),
+                                                  std::size_t{ img.storage_size() } * sizeof(T));
+    } else {
+        return -1;
+    }
+}
+
+// Calls f(tile_index) for every tile of the image, in parallel on the shared TaskScheduler pool. When the image's tiles
+// are assigned to nodes, each node's tiles are split into chunks, and the thread that runs a chunk is bound to the
+// chunk's node while it does, so that the pass reads and writes local memory only. Otherwise this is parallel_for over
+// the tiles.
+template <typename T, std::uint32_t log_tile_size, typename allocator_t, typename index_t, typename Function>
+void numa_for_each_tile(const Array2DSFC<T, log_tile_size, allocator_t, index_t>& img, Function f)
+{
+    const index_t  tiles = img.num_tiles_width() * img.num_tiles_height();
+    const unsigned nodes = numa_node_count();
+
+    if (nodes == 1 || tiles == 0 || numa_tile_node(img, 0) < 0) {
+        parallel_for(index_t{ 0 }, tiles, f);
+        return;
+    }
+
+#if defined(IMAGE_LIBRARY_NUMA)
+    // Block placement gives every node a contiguous range of tiles.
+    std::vector<index_t> node_begin(nodes + 1, tiles);
+    for (index_t t = tiles; t-- > 0;) {
+        node_begin[static_cast<unsigned>(numa_tile_node(img, t))] = t;
+    }
+    for (unsigned node = nodes; node-- > 0;) {
+        node_begin[node] = std::min(node_begin[node], node_begin[node + 1]);
+    }
+
+    // About as many chunks per node as it has CPUs, each a task of its own on the shared pool.
+    std::vector<numa_detail::Chunk<index_t>> chunks;
+    for (unsigned node = 0; node < nodes; ++node) {
+        const index_t begin = node_begin[node];
+        const index_t end   = node_begin[node + 1];
+        if (begin == end) {
+            continue;
+        }
+
+        struct bitmask* cpus = numa_allocate_cpumask();
+        numa_node_to_cpus(static_cast<int>(node), cpus);
+        const auto workers = static_cast<unsigned>(
+            std::clamp<index_t>(static_cast<index_t>(numa_bitmask_weight(cpus)), 1u, end - begin));
+        numa_free_cpumask(cpus);
+
+        for (unsigned w = 0; w < workers; ++w) {
+            const std::uint64_t count = end - begin;
+            chunks.push_back({ node,
+                               begin + static_cast<index_t>(count * w / workers),
+                               begin + static_cast<index_t>(count * (w + 1) / workers) });
+        }
+    }
+
+    ParallelOptions options;
+    options.grain = 1;
+    TaskScheduler::global().parallel_for(
+        std::size_t{ 0 },
+        chunks.size(),
+        [&](std::size_t c) {
+            const auto&                    chunk = chunks[c];
+            const numa_detail::NodeBinding binding(chunk.node);
+            for (index_t t = chunk.begin; t < chunk.end; ++t) {
+                f(t);
+            }
+        },
+        options);
+#endif
+}
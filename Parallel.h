@@ -0,0 +1,48 @@
+#pragma once
+
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+// We use the standard execution policy objects as tags to select between the serial and the threaded versions of our
+// bulk operations. We do not call the standard parallel algorithms: their support varies wildly between standard
+// library implementations.
+template <typename ExecutionPolicy>
+inline constexpr bool is_parallel_policy_v =
+    std::is_same_v<std::remove_cvref_t<ExecutionPolicy>, std::execution::parallel_policy> ||
+    std::is_same_v<std::remove_cvref_t<ExecutionPolicy>, std::execution::parallel_unsequenced_policy>;
+
+template <typename ExecutionPolicy>
+inline constexpr bool is_execution_policy_v = std::is_execution_policy_v<std::remove_cvref_t<ExecutionPolicy>>;
+
+inline unsigned hardware_thread_count() noexcept
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Calls f(i) for every i in [begin, end) on the shared TaskScheduler pool. The range is split into contiguous runs of
+// indices, so that each task walks memory in order. The first exception thrown by f is re-thrown on the calling thread
+// after all of the running tasks have finished.
+template <typename Index, typename Function>
+void parallel_for(Index begin, Index end, Function f)
+{
+    TaskScheduler::global().parallel_for(begin, end, std::move(f));
+}
+
+template <typename ExecutionPolicy, typename Index, typename Function>
+requires is_execution_policy_v<ExecutionPolicy>
+void for_each_index(ExecutionPolicy&&, Index begin, Index end, Function f)
+{
+    if constexpr (is_parallel_policy_v<ExecutionPolicy>) {
+        parallel_for(begin, end, std::move(f));
+    } else {
+        for (Index i = begin; i < end; ++i) {
+            f(i);
+        }
+    }
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include "Half.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// A pixel of N channels of type T: masks and depth (N = 1), two-channel data such as motion vectors, up to arbitrary
+// output variables of up to 16 channels. The channels are a plain array, and every operation is a loop of fixed trip
+// count over it, which the compiler unrolls and vectorizes.
+template <typename T, std::size_t N>
+struct Pixel
+{
+    static_assert(N >= 1 && N <= 16, "Pixels have between 1 and 16 channels");
+
+    using value_type = T;
+    using size_type  = std::uint32_t;
+
+    static constexpr size_type k_channels = N;
+
+    constexpr Pixel() noexcept
+    : v{}
+    {
+    }
+
+    explicit constexpr Pixel(T i) noexcept
+    {
+        for (std::size_t c = 0; c < N; ++c) {
+            v[c] = i;
+        }
+    }
+
+    // One value per channel, e.g., Pixel<float, 2>(dx, dy).
+    template <typename... Ts>
+    requires(sizeof...(Ts) == N && N > 1)
+    constexpr Pixel(Ts... values) noexcept
+    : v{ static_cast<T>(values)... }
+    {
+    }
+
+    // Channel-wise cast. This does not rescale integer channels.
+    template <typename U>
+    explicit constexpr Pixel(const Pixel<U, N>& o) noexcept
+    {
+        for (std::size_t c = 0; c < N; ++c) {
+            v[c] = static_cast<T>(o.v[c]);
+        }
+    }
+
+    constexpr T& operator[](size_type idx) noexcept
+    {
+        assert(idx < N);
+        return v[idx];
+    }
+
+    constexpr T operator[](size_type idx) const noexcept
+    {
+        assert(idx < N);
+        return v[idx];
+    }
+
+    T v[N];
+};
+
+template <typename T, std::size_t N>
+constexpr bool operator==(const Pixel<T, N>& a, const Pixel<T, N>& b) noexcept
+{
+    return std::equal(a.v, a.v + N, b.v);
+}
+
+template <typename T, std::size_t N>
+constexpr Pixel<T, N>& operator+=(Pixel<T, N>& a, const Pixel<T, N>& b) noexcept
+{
+    for (std::size_t c = 0; c < N; ++c) {
+        a.v[c] += b.v[c];
+    }
+    return a;
+}
+
+template <typename T, std::size_t N>
+constexpr Pixel<T, N>& operator-=(Pixel<T, N>& a, const Pixel<T, N>& b) noexcept
+{
+    for (std::size_t c = 0; c < N; ++c) {
+        a.v[c] -= b.v[c];
+    }
+    return a;
+}
+
+// Component-wise
+template <typename T, std::size_t N>
+constexpr Pixel<T, N>& operator*=(Pixel<T, N>& a, const Pixel<T, N>& b) noexcept
+{
+    for (std::size_t c = 0; c < N; ++c) {
+        a.v[c] *= b.v[c];
+    }
+    return a;
+}
+
+// Component-wise
+template <typename T, std::size_t N>
+constexpr Pixel<T, N>& operator/=(Pixel<T, N>& a, const Pixel<T, N>& b) noexcept
+{
+    for (std::size_t c = 0; c < N; ++c) {
+        a.v[c] /= b.v[c];
+    }
+    return a;
+}
+
+template <typename T, std::size_t N>
+constexpr Pixel<T, N>& operator*=(Pixel<T, N>& a, T b) noexcept
+{
+    for (std::size_t c = 0; c < N; ++c) {
+        a.v[c] *= b;
+    }
+    return a;
+}
+
+template <typename T, std::size_t N>
+constexpr Pixel<T, N>& operator/=(Pixel<T, N>& a, T b) noexcept
+{
+    for (std::size_t c = 0; c < N; ++c) {
+        a.v[c] /= b;
+    }
+    return a;
+}
+
+// Pass-by-value on purpose
+template <typename T, std::size_t N>
+constexpr Pixel<T, N> operator+(Pixel<T, N> a, const Pixel<T, N>& b) noexcept
+{
+    return a += b;
+}
+
+// Pass-by-value on purpose
+template <typename T, std::size_t N>
+constexpr Pixel<T, N> operator-(Pixel<T, N> a, const Pixel<T, N>& b) noexcept
+{
+    return a -= b;
+}
+
+// Pass-by-value on purpose
+template <typename T, std::size_t N>
+constexpr Pixel<T, N> operator*(Pixel<T, N> a, const Pixel<T, N>& b) noexcept
+{
+    return a *= b;
+}
+
+// Pass-by-value on purpose
+template <typename T, std::size_t N>
+constexpr Pixel<T, N> operator/(Pixel<T, N> a, const Pixel<T, N>& b) noexcept
+{
+    return a /= b;
+}
+
+template <typename T, std::size_t N>
+constexpr Pixel<T, N> operator-(Pixel<T, N> a) noexcept
+{
+    for (std::size_t c = 0; c < N; ++c) {
+        a.v[c] = static_cast<T>(-a.v[c]);
+    }
+    return a;
+}
+
+// Pass-by-value on purpose
+template <typename T, std::size_t N>
+constexpr Pixel<T, N> operator*(Pixel<T, N> a, T b) noexcept
+{
+    return a *= b;
+}
+
+// Pass-by-value on purpose
+template <typename T, std::size_t N>
+constexpr Pixel<T, N> operator*(T b, Pixel<T, N> a) noexcept
+{
+    return a *= b;
+}
+
+// Pass-by-value on purpose
+template <typename T, std::size_t N>
+constexpr Pixel<T, N> operator/(Pixel<T, N> a, T b) noexcept
+{
+    return a /= b;
+}
+
+template <typename T, std::size_t N>
+constexpr Pixel<T, N> clamp(Pixel<T, N> a, T lo, T hi) noexcept
+{
+    for (std::size_t c = 0; c < N; ++c) {
+        a.v[c] = std::clamp(a.v[c], lo, hi);
+    }
+    return a;
+}
+
+template <typename T, std::size_t N>
+constexpr Pixel<T, N> min(Pixel<T, N> a, const Pixel<T, N>& b) noexcept
+{
+    for (std::size_t c = 0; c < N; ++c) {
+        a.v[c] = std::min(a.v[c], b.v[c]);
+    }
+    return a;
+}
+
+template <typename T, std::size_t N>
+constexpr Pixel<T, N> max(Pixel<T, N> a, const Pixel<T, N>& b) noexcept
+{
+    for (std::size_t c = 0; c < N; ++c) {
+        a.v[c] = std::max(a.v[c], b.v[c]);
+    }
+    return a;
+}
+
+template <typename T, std::size_t N>
+inline std::ostream& operator<<(std::ostream& outs, const Pixel<T, N>& p)
+{
+    for (std::size_t c = 0; c < N; ++c) {
+        outs << (c ? " " : "") << +p.v[c];
+    }
+    return outs;
+}
+
+template <std::size_t N>
+using Pixel8 = Pixel<std::uint8_t, N>;
+
+template <std::size_t N>
+using Pixel16 = Pixel<std::uint16_t, N>;
+
+template <std::size_t N>
+using Pixelh = Pixel<half, N>;
+
+template <std::size_t N>
+using Pixelf = Pixel<float, N>;
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "Pixel.h"
+#include "RGB.h"
+#include "RGBA.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Compile-time properties of pixel types. Scalars (e.g., std::uint8_t or float) are single-channel pixels. Only RGBA
+// has a designated alpha channel: the channels of a Pixel<T, N> are generic.
+
+// The channel type of a pixel (e.g., float for RGBf), or the type itself for scalars.
+template <typename T>
+struct channel_type
+{
+    using type = T;
+};
+
+template <typename T>
+struct channel_type<RGB<T>>
+{
+    using type = T;
+};
+
+template <typename T>
+struct channel_type<RGBA<T>>
+{
+    using type = T;
+};
+
+template <typename T, std::size_t N>
+struct channel_type<Pixel<T, N>>
+{
+    using type = T;
+};
+
+template <typename T>
+using channel_type_t = typename channel_type<T>::type;
+
+template <typename T>
+struct channel_count : std::integral_constant<std::size_t, 1>
+{
+};
+
+template <typename T>
+struct channel_count<RGB<T>> : std::integral_constant<std::size_t, 3>
+{
+};
+
+template <typename T>
+struct channel_count<RGBA<T>> : std::integral_constant<std::size_t, 4>
+{
+};
+
+template <typename T, std::size_t N>
+struct channel_count<Pixel<T, N>> : std::integral_constant<std::size_t, N>
+{
+};
+
+template <typename T>
+inline constexpr std::size_t channel_count_v = channel_count<T>::value;
+
+// The same kind of pixel with channel type C, e.g., RGBf for RGB8 and float.
+template <typename P, typename C>
+struct rebind_channel
+{
+    using type = C;
+};
+
+template <typename T, typename C>
+struct rebind_channel<RGB<T>, C>
+{
+    using type = RGB<C>;
+};
+
+template <typename T, typename C>
+struct rebind_channel<RGBA<T>, C>
+{
+    using type = RGBA<C>;
+};
+
+template <typename T, std::size_t N, typename C>
+struct rebind_channel<Pixel<T, N>, C>
+{
+    using type = Pixel<C, N>;
+};
+
+template <typename P, typename C>
+using rebind_channel_t = typename rebind_channel<P, C>::type;
+
+template <typename P>
+struct has_alpha : std::false_type
+{
+};
+
+template <typename T>
+struct has_alpha<RGBA<T>> : std::true_type
+{
+};
+
+template <typename P>
+inline constexpr bool has_alpha_v = has_alpha<P>::value;
+
+// Whether the pixel is color (gray, RGB, or RGBA), as opposed to generic data such as the channels of a Pixel<T, N>.
+// Files store color sRGB encoded, and generic data linearly.
+template <typename P>
+struct is_color_pixel : std::true_type
+{
+};
+
+template <typename T, std::size_t N>
+struct is_color_pixel<Pixel<T, N>> : std::false_type
+{
+};
+
+template <typename P>
+inline constexpr bool is_color_pixel_v = is_color_pixel<P>::value;
+
+// Channel c of a pixel. For scalars, this is the value itself.
+template <typename P>
+constexpr channel_type_t<P>& pixel_channel(P& p, std::uint32_t c) noexcept
+{
+    if constexpr (requires { p[c]; }) {
+        return p[c];
+    } else {
+        return p;
+    }
+}
+
+template <typename P>
+constexpr channel_type_t<P> pixel_channel(const P& p, std::uint32_t c) noexcept
+{
+    if constexpr (requires { p[c]; }) {
+        return p[c];
+    } else {
+        return p;
+    }
+}
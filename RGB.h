@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include "Half.h"
+
 #include <algorithm>
 #include <cstdint>
 #include <ostream>
@@ -36,6 +38,15 @@ struct RGB
     {
     }
 
+    // Channel-wise cast, e.g., between RGB<half> and RGB<float>. This does not rescale integer channels: see to_float.
+    template <typename U>
+    explicit constexpr RGB(const RGB<U>& o) noexcept
+    : r(static_cast<T>(o.r))
+    , g(static_cast<T>(o.g))
+    , b(static_cast<T>(o.b))
+    {
+    }
+
     T& operator[](size_type idx) noexcept
     {
         switch (idx) {
@@ -98,6 +109,35 @@ RGB<T>& operator/=(RGB<T>& a, T b) noexcept
     return a;
 }
 
+template <typename T>
+RGB<T>& operator-=(RGB<T>& a, const RGB<T>& b) noexcept
+{
+    a.r -= b.r;
+    a.g -= b.g;
+    a.b -= b.b;
+    return a;
+}
+
+// Component-wise
+template <typename T>
+RGB<T>& operator*=(RGB<T>& a, const RGB<T>& b) noexcept
+{
+    a.r *= b.r;
+    a.g *= b.g;
+    a.b *= b.b;
+    return a;
+}
+
+// Component-wise
+template <typename T>
+RGB<T>& operator/=(RGB<T>& a, const RGB<T>& b) noexcept
+{
+    a.r /= b.r;
+    a.g /= b.g;
+    a.b /= b.b;
+    return a;
+}
+
 // Pass-by-value on purpose
 template <typename T>
 RGB<T> operator+(RGB<T> a, const RGB<T>& b) noexcept
@@ -105,6 +145,33 @@ RGB<T> operator+(RGB<T> a, const RGB<T>& b) noexcept
     return a += b;
 }
 
+// Pass-by-value on purpose
+template <typename T>
+RGB<T> operator-(RGB<T> a, const RGB<T>& b) noexcept
+{
+    return a -= b;
+}
+
+// Pass-by-value on purpose
+template <typename T>
+RGB<T> operator*(RGB<T> a, const RGB<T>& b) noexcept
+{
+    return a *= b;
+}
+
+// Pass-by-value on purpose
+template <typename T>
+RGB<T> operator/(RGB<T> a, const RGB<T>& b) noexcept
+{
+    return a /= b;
+}
+
+template <typename T>
+RGB<T> operator-(const RGB<T>& a) noexcept
+{
+    return { static_cast<T>(-a.r), static_cast<T>(-a.g), static_cast<T>(-a.b) };
+}
+
 // Pass-by-value on purpose
 template <typename T>
 RGB<T> operator*(RGB<T> a, T b) noexcept
@@ -137,6 +204,7 @@ using RGBf  = RGB<float>;
 using RGB8  = RGB<std::uint8_t>;
 using RGB16 = RGB<std::uint16_t>;
 using RGB32 = RGB<std::uint32_t>;
+using RGBh  = RGB<half>;
 
 template <typename T>
 inline RGBf to_float(const RGB<T>& c) noexcept
@@ -153,7 +221,56 @@ inline const RGBf& to_float(const RGBf& c) noexcept
     return c;
 }
 
+// Half channels are not normalized like the integer types: this only widens them.
+inline RGBf to_float(const RGBh& c) noexcept
+{
+    return { static_cast<float>(c.r), static_cast<float>(c.g), static_cast<float>(c.b) };
+}
+
+// Arithmetic on half pixels is done in float and returns float pixels; the result is rounded back to half only when it
+// is stored into a half pixel or image.
+inline RGBf operator+(const RGBh& a, const RGBh& b) noexcept
+{
+    return to_float(a) + to_float(b);
+}
+
+inline RGBf operator-(const RGBh& a, const RGBh& b) noexcept
+{
+    return to_float(a) - to_float(b);
+}
+
+inline RGBf operator*(const RGBh& a, const RGBh& b) noexcept
+{
+    return to_float(a) * to_float(b);
+}
+
+inline RGBf operator/(const RGBh& a, const RGBh& b) noexcept
+{
+    return to_float(a) / to_float(b);
+}
+
+inline RGBf operator*(const RGBh& a, float b) noexcept
+{
+    return to_float(a) * b;
+}
+
+inline RGBf operator*(float b, const RGBh& a) noexcept
+{
+    return b * to_float(a);
+}
+
+inline RGBf operator/(const RGBh& a, float b) noexcept
+{
+    return to_float(a) / b;
+}
+
 inline RGBf clamp(const RGBf& c) noexcept
 {
     return { std::clamp(c.r, 0.0f, 1.0f), std::clamp(c.g, 0.0f, 1.0f), std::clamp(c.b, 0.0f, 1.0f) };
 }
+
+template <typename T>
+inline RGB<T> clamp(const RGB<T>& c, T lo, T hi) noexcept
+{
+    return { std::clamp(c.r, lo, hi), std::clamp(c.g, lo, hi), std::clamp(c.b, lo, hi) };
+}
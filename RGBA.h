@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include "Half.h"
+
 #include <algorithm>
 #include <cstdint>
 #include <limits>
@@ -16,6 +18,9 @@ constexpr T k_default_alpha = std::numeric_limits<T>::max();
 template <>
 constexpr float k_default_alpha<float> = 1.0f;
 
+template <>
+constexpr half k_default_alpha<half> = static_cast<half>(1.0f);
+
 template <typename T>
 struct RGBA
 {
@@ -38,6 +43,16 @@ struct RGBA
     {
     }
 
+    // Channel-wise cast, e.g., between RGB<half> and RGB<float>. This does not rescale integer channels: see to_float.
+    template <typename U>
+    explicit constexpr RGBA(const RGBA<U>& o) noexcept
+    : r(static_cast<T>(o.r))
+    , g(static_cast<T>(o.g))
+    , b(static_cast<T>(o.b))
+    , a(static_cast<T>(o.a))
+    {
+    }
+
     T& operator[](size_type idx) noexcept
     {
         switch (idx) {
@@ -94,7 +109,7 @@ RGBA<T>& operator*=(RGBA<T>& a, T b) noexcept
     a.r *= b;
     a.g *= b;
     a.b *= b;
-    a.a *= a;
+    a.a *= b;
     return a;
 }
 
@@ -108,6 +123,38 @@ RGBA<T>& operator/=(RGBA<T>& a, T b) noexcept
     return a;
 }
 
+template <typename T>
+RGBA<T>& operator-=(RGBA<T>& a, const RGBA<T>& b) noexcept
+{
+    a.r -= b.r;
+    a.g -= b.g;
+    a.b -= b.b;
+    a.a -= b.a;
+    return a;
+}
+
+// Component-wise
+template <typename T>
+RGBA<T>& operator*=(RGBA<T>& a, const RGBA<T>& b) noexcept
+{
+    a.r *= b.r;
+    a.g *= b.g;
+    a.b *= b.b;
+    a.a *= b.a;
+    return a;
+}
+
+// Component-wise
+template <typename T>
+RGBA<T>& operator/=(RGBA<T>& a, const RGBA<T>& b) noexcept
+{
+    a.r /= b.r;
+    a.g /= b.g;
+    a.b /= b.b;
+    a.a /= b.a;
+    return a;
+}
+
 // Pass-by-value on purpose
 template <typename T>
 RGBA<T> operator+(RGBA<T> a, const RGBA<T>& b) noexcept
@@ -115,6 +162,33 @@ RGBA<T> operator+(RGBA<T> a, const RGBA<T>& b) noexcept
     return a += b;
 }
 
+// Pass-by-value on purpose
+template <typename T>
+RGBA<T> operator-(RGBA<T> a, const RGBA<T>& b) noexcept
+{
+    return a -= b;
+}
+
+// Pass-by-value on purpose
+template <typename T>
+RGBA<T> operator*(RGBA<T> a, const RGBA<T>& b) noexcept
+{
+    return a *= b;
+}
+
+// Pass-by-value on purpose
+template <typename T>
+RGBA<T> operator/(RGBA<T> a, const RGBA<T>& b) noexcept
+{
+    return a /= b;
+}
+
+template <typename T>
+RGBA<T> operator-(const RGBA<T>& a) noexcept
+{
+    return { static_cast<T>(-a.r), static_cast<T>(-a.g), static_cast<T>(-a.b), static_cast<T>(-a.a) };
+}
+
 // Pass-by-value on purpose
 template <typename T>
 RGBA<T> operator*(RGBA<T> a, T b) noexcept
@@ -147,6 +221,7 @@ using RGBAf  = RGBA<float>;
 using RGBA8  = RGBA<std::uint8_t>;
 using RGBA16 = RGBA<std::uint16_t>;
 using RGBA32 = RGBA<std::uint32_t>;
+using RGBAh  = RGBA<half>;
 
 template <typename T>
 inline RGBAf to_float(const RGBA<T>& c) noexcept
@@ -166,6 +241,49 @@ inline const RGBAf& to_float(const RGBAf& c) noexcept
     return c;
 }
 
+// Half channels are not normalized like the integer types: this only widens them.
+inline RGBAf to_float(const RGBAh& c) noexcept
+{
+    return { static_cast<float>(c.r), static_cast<float>(c.g), static_cast<float>(c.b), static_cast<float>(c.a) };
+}
+
+// Arithmetic on half pixels is done in float and returns float pixels; the result is rounded back to half only when it
+// is stored into a half pixel or image.
+inline RGBAf operator+(const RGBAh& a, const RGBAh& b) noexcept
+{
+    return to_float(a) + to_float(b);
+}
+
+inline RGBAf operator-(const RGBAh& a, const RGBAh& b) noexcept
+{
+    return to_float(a) - to_float(b);
+}
+
+inline RGBAf operator*(const RGBAh& a, const RGBAh& b) noexcept
+{
+    return to_float(a) * to_float(b);
+}
+
+inline RGBAf operator/(const RGBAh& a, const RGBAh& b) noexcept
+{
+    return to_float(a) / to_float(b);
+}
+
+inline RGBAf operator*(const RGBAh& a, float b) noexcept
+{
+    return to_float(a) * b;
+}
+
+inline RGBAf operator*(float b, const RGBAh& a) noexcept
+{
+    return b * to_float(a);
+}
+
+inline RGBAf operator/(const RGBAh& a, float b) noexcept
+{
+    return to_float(a) / b;
+}
+
 inline RGBAf clamp(const RGBAf& c) noexcept
 {
     return { std::clamp(c.r, 0.0f, 1.0f),
@@ -173,3 +291,12 @@ inline RGBAf clamp(const RGBAf& c) noexcept
              std::clamp(c.b, 0.0f, 1.0f),
              std::clamp(c.a, 0.0f, 1.0f) };
 }
+
+template <typename T>
+inline RGBA<T> clamp(const RGBA<T>& c, T lo, T hi) noexcept
+{
+    return { std::clamp(c.r, lo, hi),
+             std::clamp(c.g, lo, hi),
+             std::clamp(c.b, lo, hi),
+             std::clamp(c.a, lo, hi) };
+}
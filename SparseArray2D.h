@@ -0,0 +1,414 @@
+#pragma once
+
+#include "Array2D.h"
+#include "Instrumentation.h"
+#include "Morton.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <execution>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// An image with Array2DSFC's tiling whose tiles are allocated on first write. Until a tile is written, it reads as
+// the fill value, which every unwritten tile shares, so memory and construction time scale with the written area
+// rather than with the image. For masks, partial renders, and other mostly-constant images.
+//     SparseArray2DSFC<float> mask(width, height, 0.0f);
+//     mask.set(x, y, 1.0f);        // Allocates the tile of (x, y), filled with 0.0f, and writes.
+//     const float m = mask(x, y);  // Reads. Never allocates.
+//     mask.compact();              // Returns the tiles that are all 0.0f again to the fill value.
+//
+// Within a tile, elements are in the same Morton order as in Array2DSFC<T, log_tile_size>. Writes from several threads
+// are safe, also to the same tile: a tile is installed with a compare-and-swap, and the losing thread's tile is freed.
+// compact(), release_tile(), assignment, and destruction must not run concurrently with other access.
+template <typename T, std::uint32_t log_tile_size = 4, typename allocator_t = std::allocator<T>>
+class SparseArray2DSFC
+{
+    static constexpr int k_tile_width  = 1 << log_tile_size;
+    static constexpr int k_tile_height = 1 << log_tile_size;
+
+    using allocator_traits = std::allocator_traits<allocator_t>;
+
+public:
+    using size_type       = std::uint32_t;
+    using allocator_type  = allocator_t;
+    using value_type      = T;
+    using reference       = value_type&;
+    using const_reference = const value_type&;
+    using dense_type      = Array2DSFC<T, log_tile_size, allocator_t>;
+
+    static constexpr size_type tile_width  = k_tile_width;
+    static constexpr size_type tile_height = k_tile_height;
+    static constexpr size_type tile_area   = k_tile_width * k_tile_height;
+
+    SparseArray2DSFC()
+    : SparseArray2DSFC(0, 0)
+    {
+    }
+
+    // No tile is allocated: every element reads as fill.
+    SparseArray2DSFC(size_type      width,
+                     size_type      height,
+                     const T&       fill      = T{},
+                     allocator_type allocator = allocator_type{})
+    : m_allocator(allocator)
+    , m_width(width)
+    , m_height(height)
+    , m_fill(fill)
+    , m_tiles(std::size_t{ num_tiles_width(width) } * num_tiles_height(height))
+    {
+    }
+
+    SparseArray2DSFC(const SparseArray2DSFC& other)
+    : m_allocator(allocator_traits::select_on_container_copy_construction(other.m_allocator))
+    , m_width(other.m_width)
+    , m_height(other.m_height)
+    , m_fill(other.m_fill)
+    , m_tiles(other.m_tiles.size())
+    {
+        try {
+            for (std::size_t t = 0; t < m_tiles.size(); ++t) {
+                if (const T* const source = other.m_tiles[t].load(std::memory_order_acquire)) {
+                    m_tiles[t].store(new_tile(source), std::memory_order_relaxed);
+                }
+            }
+        } catch (...) {
+            release_tiles();
+            throw;
+        }
+    }
+
+    SparseArray2DSFC(SparseArray2DSFC&& other) noexcept
+    : m_allocator(std::move(other.m_allocator))
+    , m_width(std::exchange(other.m_width, 0))
+    , m_height(std::exchange(other.m_height, 0))
+    , m_fill(std::move(other.m_fill))
+    , m_tiles(std::move(other.m_tiles))
+    {
+        other.m_tiles.clear();
+    }
+
+    // Copies the tiles that hold something other than fill, and leaves the others unallocated.
+    template <typename ExecutionPolicy>
+    requires is_execution_policy_v<ExecutionPolicy> && std::equality_comparable<T>
+    SparseArray2DSFC(ExecutionPolicy&& policy, const dense_type& dense, const T& fill)
+    : SparseArray2DSFC(dense.width(), dense.height(), fill, dense.get_allocator())
+    {
+        for_each_index(policy, size_type{ 0 }, tile_count(), [&](size_type tile_index) {
+            const T* const source = dense.data() + std::size_t{ tile_index } * tile_area;
+            bool           empty  = true;
+            for_each_in_tile(tile_index, [&](size_type i) { empty = empty && source[i] == m_fill; });
+            if (!empty) {
+                T* const tile = new_tile(m_fill);
+                for_each_in_tile(tile_index, [&](size_type i) { tile[i] = source[i]; });
+                m_tiles[tile_index].store(tile, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    ~SparseArray2DSFC()
+    {
+        release_tiles();
+    }
+
+    SparseArray2DSFC& operator=(SparseArray2DSFC other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    void swap(SparseArray2DSFC& other) noexcept
+    {
+        using std::swap; // Allow ADL
+        swap(m_allocator, other.m_allocator);
+        swap(m_width, other.m_width);
+        swap(m_height, other.m_height);
+        swap(m_fill, other.m_fill);
+        m_tiles.swap(other.m_tiles);
+    }
+
+    allocator_type get_allocator() const noexcept
+    {
+        return m_allocator;
+    }
+
+    size_type width() const noexcept
+    {
+        return m_width;
+    }
+
+    size_type height() const noexcept
+    {
+        return m_height;
+    }
+
+    const_reference fill_value() const noexcept
+    {
+        return m_fill;
+    }
+
+    size_type num_tiles_width() const noexcept
+    {
+        return num_tiles_width(m_width);
+    }
+
+    size_type num_tiles_height() const noexcept
+    {
+        return num_tiles_height(m_height);
+    }
+
+    const_reference operator()(size_type x, size_type y) const noexcept
+    {
+        const T* const tile = m_tiles[tile_index_of(x, y)].load(std::memory_order_acquire);
+        return tile ? tile[index_in_tile(x, y)] : m_fill;
+    }
+
+    // A writable reference to (x, y), allocating its tile if it has none.
+    reference writable(size_type x, size_type y)
+    {
+        return tile_for_write(tile_index_of(x, y))[index_in_tile(x, y)];
+    }
+
+    // Writing the fill value to an unallocated tile leaves it unallocated.
+    void set(size_type x, size_type y, const T& value)
+    {
+        const size_type tile_index = tile_index_of(x, y);
+        if constexpr (std::equality_comparable<T>) {
+            if (!m_tiles[tile_index].load(std::memory_order_acquire) && value == m_fill) {
+                return;
+            }
+        }
+        tile_for_write(tile_index)[index_in_tile(x, y)] = value;
+    }
+
+    // Occupancy.
+    bool tile_allocated(size_type tile_x, size_type tile_y) const noexcept
+    {
+        return m_tiles[tile_y * num_tiles_width() + tile_x].load(std::memory_order_acquire) != nullptr;
+    }
+
+    size_type allocated_tile_count() const noexcept
+    {
+        return static_cast<size_type>(std::count_if(m_tiles.begin(), m_tiles.end(), [](const std::atomic<T*>& t) {
+            return t.load(std::memory_order_relaxed) != nullptr;
+        }));
+    }
+
+    // The share of tiles that are allocated, from 0 to 1.
+    double occupancy() const noexcept
+    {
+        if (m_tiles.empty()) {
+            return 0.0;
+        }
+        return static_cast<double>(allocated_tile_count()) / static_cast<double>(m_tiles.size());
+    }
+
+    std::size_t allocated_bytes() const noexcept
+    {
+        return std::size_t{ allocated_tile_count() } * tile_area * sizeof(T);
+    }
+
+    // The tile's tile_area slots in Morton order, or nullptr if the tile is unallocated. The padding slots of edge
+    // tiles hold the fill value.
+    const T* tile_data(size_type tile_x, size_type tile_y) const noexcept
+    {
+        return m_tiles[tile_y * num_tiles_width() + tile_x].load(std::memory_order_acquire);
+    }
+
+    // As tile_data, but allocates the tile if it has none.
+    T* allocate_tile(size_type tile_x, size_type tile_y)
+    {
+        return tile_for_write(tile_y * num_tiles_width() + tile_x);
+    }
+
+    // Returns the tile to the fill value and frees it.
+    void release_tile(size_type tile_x, size_type tile_y) noexcept
+    {
+        if (T* const tile = m_tiles[tile_y * num_tiles_width() + tile_x].exchange(nullptr, std::memory_order_acq_rel)) {
+            delete_tile(tile);
+        }
+    }
+
+    // Frees the tiles whose elements all equal the fill value again, and returns how many were freed.
+    template <typename ExecutionPolicy>
+    requires is_execution_policy_v<ExecutionPolicy> && std::equality_comparable<T>
+    size_type compact(ExecutionPolicy&& policy)
+    {
+        IMAGE_LIBRARY_TIMED_SCOPE("SparseArray2DSFC::compact");
+        std::atomic<size_type> released{ 0 };
+        for_each_index(policy, size_type{ 0 }, tile_count(), [&](size_type tile_index) {
+            T* const tile = m_tiles[tile_index].load(std::memory_order_relaxed);
+            if (tile && std::all_of(tile, tile + tile_area, [this](const T& v) { return v == m_fill; })) {
+                m_tiles[tile_index].store(nullptr, std::memory_order_relaxed);
+                delete_tile(tile);
+                released.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        return released.load();
+    }
+
+    size_type compact()
+    requires std::equality_comparable<T>
+    {
+        return compact(std::execution::seq);
+    }
+
+    // Calls f(tile_x, tile_y, tile) for every allocated tile, where tile is as from tile_data.
+    template <typename ExecutionPolicy, typename Function>
+    requires is_execution_policy_v<ExecutionPolicy>
+    void for_each_allocated_tile(ExecutionPolicy&& policy, Function f)
+    {
+        const size_type ntx = num_tiles_width();
+        for_each_index(policy, size_type{ 0 }, tile_count(), [&](size_type tile_index) {
+            if (T* const tile = m_tiles[tile_index].load(std::memory_order_acquire)) {
+                f(tile_index % ntx, tile_index / ntx, tile);
+            }
+        });
+    }
+
+    // An Array2DSFC with the same elements. Its storage order is the same, so allocated tiles are copied whole.
+    template <typename ExecutionPolicy>
+    requires is_execution_policy_v<ExecutionPolicy>
+    dense_type to_dense(ExecutionPolicy&& policy) const
+    {
+        dense_type dense(policy, m_width, m_height, m_fill, m_allocator);
+        for_each_index(policy, size_type{ 0 }, tile_count(), [&](size_type tile_index) {
+            const T* const tile = m_tiles[tile_index].load(std::memory_order_acquire);
+            if (!tile) {
+                return;
+            }
+            T* const out = dense.data() + std::size_t{ tile_index } * tile_area;
+            if constexpr (std::is_trivially_copyable_v<T>) {
+                std::memcpy(static_cast<void*>(out), static_cast<const void*>(tile), sizeof(T) * tile_area);
+            } else {
+                for_each_in_tile(tile_index, [&](size_type i) { out[i] = tile[i]; });
+            }
+        });
+        return dense;
+    }
+
+    dense_type to_dense() const
+    {
+        return to_dense(std::execution::seq);
+    }
+
+private:
+    static constexpr size_type num_tiles_width(size_type width) noexcept
+    {
+        return (width + k_tile_width - 1) >> log_tile_size;
+    }
+
+    static constexpr size_type num_tiles_height(size_type height) noexcept
+    {
+        return (height + k_tile_height - 1) >> log_tile_size;
+    }
+
+    size_type tile_count() const noexcept
+    {
+        return static_cast<size_type>(m_tiles.size());
+    }
+
+    size_type tile_index_of(size_type x, size_type y) const noexcept
+    {
+        assert(x < m_width && y < m_height);
+        return (y >> log_tile_size) * num_tiles_width() + (x >> log_tile_size);
+    }
+
+    static size_type index_in_tile(size_type x, size_type y) noexcept
+    {
+        return morton_tile_index<log_tile_size>(x & (k_tile_width - 1), y & (k_tile_height - 1));
+    }
+
+    // Calls f(i) for the in-tile index of every element of the tile, skipping the padding of edge tiles.
+    template <typename Function>
+    void for_each_in_tile(size_type tile_index, Function f) const
+    {
+        const size_type x0 = (tile_index % num_tiles_width()) * k_tile_width;
+        const size_type y0 = (tile_index / num_tiles_width()) * k_tile_height;
+        const size_type nx = std::min<size_type>(k_tile_width, m_width - x0);
+        const size_type ny = std::min<size_type>(k_tile_height, m_height - y0);
+        for (size_type y = 0; y < ny; ++y) {
+            for (size_type x = 0; x < nx; ++x) {
+                f(morton_tile_index<log_tile_size>(x, y));
+            }
+        }
+    }
+
+    T* tile_for_write(size_type tile_index)
+    {
+        T* tile = m_tiles[tile_index].load(std::memory_order_acquire);
+        if (tile) {
+            return tile;
+        }
+        T* const fresh = new_tile(m_fill);
+        if (m_tiles[tile_index].compare_exchange_strong(tile, fresh, std::memory_order_acq_rel)) {
+            return fresh;
+        }
+        // Another thread installed its tile first.
+        delete_tile(fresh);
+        return tile;
+    }
+
+    // A tile with every slot, padding included, constructed from value.
+    T* new_tile(const T& value)
+    {
+        IMAGE_LIBRARY_COUNT(allocations, 1);
+        IMAGE_LIBRARY_COUNT(bytes_allocated, std::uint64_t{ tile_area } * sizeof(T));
+        T* const tile = allocator_traits::allocate(m_allocator, tile_area);
+        if constexpr (std::is_trivially_copyable_v<T> && std::is_same_v<allocator_t, std::allocator<T>>) {
+            std::uninitialized_fill_n(tile, tile_area, value);
+        } else {
+            size_type constructed = 0;
+            try {
+                for (; constructed < tile_area; ++constructed) {
+                    allocator_traits::construct(m_allocator, tile + constructed, value);
+                }
+            } catch (...) {
+                for (size_type i = 0; i < constructed; ++i) {
+                    allocator_traits::destroy(m_allocator, tile + i);
+                }
+                allocator_traits::deallocate(m_allocator, tile, tile_area);
+                throw;
+            }
+        }
+        return tile;
+    }
+
+    // A copy of another array's tile.
+    T* new_tile(const T* source)
+    {
+        T* const tile = new_tile(m_fill);
+        std::copy(source, source + tile_area, tile);
+        return tile;
+    }
+
+    void delete_tile(T* tile) noexcept
+    {
+        for (size_type i = 0; i < tile_area; ++i) {
+            allocator_traits::destroy(m_allocator, tile + i);
+        }
+        allocator_traits::deallocate(m_allocator, tile, tile_area);
+    }
+
+    void release_tiles() noexcept
+    {
+        for (auto& t : m_tiles) {
+            if (T* const tile = t.exchange(nullptr, std::memory_order_relaxed)) {
+                delete_tile(tile);
+            }
+        }
+    }
+
+    allocator_type               m_allocator;
+    size_type                    m_width;
+    size_type                    m_height;
+    T                            m_fill;
+    std::vector<std::atomic<T*>> m_tiles;
+};
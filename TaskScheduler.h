@@ -0,0 +1,407 @@
+#pragma once
+
+#include "Morton.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A pool of worker threads that all of the library's parallel operations share. Work is handed out as ranges of
+// indices; each worker keeps its own queue, takes its newest work first, and when idle steals the oldest work of a
+// randomly chosen worker. A thread that waits for its work to finish runs queued work in the meantime, so parallel
+// operations may be nested without deadlock or oversubscription.
+//
+// Victims are chosen with generators seeded from the scheduler's seed, and task_seed(seed, index) gives each index a
+// reproducible seed of its own. Which thread runs an index still depends on timing: a parallel pass is reproducible
+// when what it computes for an index depends only on the index and its seed.
+
+enum class TaskPriority
+{
+    high,
+    normal,
+    low
+};
+
+// Cancels the parallel operations that were given this token. Operations stop handing out indices once it is
+// cancelled; calls already running finish.
+class CancellationToken
+{
+public:
+    void cancel() noexcept
+    {
+        m_cancelled.store(true, std::memory_order_relaxed);
+    }
+
+    bool cancelled() const noexcept
+    {
+        return m_cancelled.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<bool> m_cancelled{ false };
+};
+
+struct ParallelOptions
+{
+    TaskPriority priority{ TaskPriority::normal };
+
+    // Indices per task. 0 splits the range into a few tasks per thread.
+    std::size_t grain{ 0 };
+
+    const CancellationToken* cancellation{ nullptr };
+};
+
+// splitmix64 of the seed and the index.
+constexpr std::uint64_t task_seed(std::uint64_t seed, std::uint64_t index) noexcept
+{
+    std::uint64_t z = seed + (index + 1) * 0x9E3779B97F4A7C15ull;
+    z               = (z ^ (z >> 30u)) * 0xBF58476D1CE4E5B9ull;
+    z               = (z ^ (z >> 27u)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31u);
+}
+
+class TaskScheduler
+{
+public:
+    static constexpr std::uint64_t k_default_seed = 0x5EEDull;
+
+    // The calling thread works too, so a pool of n workers runs n + 1 tasks at a time.
+    explicit TaskScheduler(unsigned worker_count = default_worker_count(), std::uint64_t seed = k_default_seed)
+    : m_seed(seed)
+    {
+        for (unsigned i = 0; i <= worker_count; ++i) {
+            // The last queue takes work from threads outside the pool.
+            m_queues.push_back(std::make_unique<Queue>());
+        }
+        m_threads.reserve(worker_count);
+        for (unsigned i = 0; i < worker_count; ++i) {
+            m_threads.emplace_back([this, i] { worker_loop(i); });
+        }
+    }
+
+    TaskScheduler(const TaskScheduler&)            = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    ~TaskScheduler()
+    {
+        {
+            std::scoped_lock lock(m_sleep_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        m_threads.clear();
+    }
+
+    // The pool behind parallel_for and every other parallel operation in the library.
+    static TaskScheduler& global()
+    {
+        static TaskScheduler scheduler;
+        return scheduler;
+    }
+
+    static unsigned default_worker_count() noexcept
+    {
+        return std::max(1u, std::thread::hardware_concurrency()) - 1;
+    }
+
+    unsigned worker_count() const noexcept
+    {
+        return static_cast<unsigned>(m_threads.size());
+    }
+
+    std::uint64_t seed() const noexcept
+    {
+        return m_seed;
+    }
+
+    // Calls f(i) for every i in [begin, end), and returns once all of the calls have returned. The first exception
+    // thrown by f stops the remaining tasks and is re-thrown here. Returns false if the operation was cancelled before
+    // every index was handed out.
+    template <typename Index, typename Function>
+    bool parallel_for(Index begin, Index end, Function f, const ParallelOptions& options = {})
+    {
+        static_assert(std::is_integral_v<Index>);
+
+        if (begin >= end) {
+            return true;
+        }
+
+        const auto        count = static_cast<std::uint64_t>(end - begin);
+        const std::size_t tasks = (options.grain > 0)
+                                      ? static_cast<std::size_t>((count + options.grain - 1) / options.grain)
+                                      : static_cast<std::size_t>(std::min<std::uint64_t>(
+                                            count, std::uint64_t{ k_tasks_per_thread } * (worker_count() + 1)));
+
+        Body<Index, Function> body{ f, begin };
+        Group                 group(tasks, options.cancellation);
+
+        Queue& queue = *m_queues[current_queue()];
+        {
+            // Pushed last to first: this thread takes its work from the front of the range, thieves from the back.
+            std::scoped_lock lock(queue.mutex);
+            auto&            tasks_of_priority = queue.tasks[static_cast<std::size_t>(options.priority)];
+            for (std::size_t t = tasks; t-- > 0;) {
+                tasks_of_priority.push_back(
+                    Task{ &Body<Index, Function>::run, &body, &group, count * t / tasks, count * (t + 1) / tasks });
+            }
+        }
+        notify();
+        wait(group);
+
+        if (group.exception) {
+            std::rethrow_exception(group.exception);
+        }
+        return group.complete.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr unsigned    k_tasks_per_thread = 4;
+    static constexpr std::size_t k_priorities       = 3;
+
+    struct Group
+    {
+        Group(std::size_t tasks, const CancellationToken* cancellation) noexcept
+        : pending(tasks)
+        , cancellation(cancellation)
+        {
+        }
+
+        bool stopped() const noexcept
+        {
+            return failed.load(std::memory_order_relaxed) || (cancellation && cancellation->cancelled());
+        }
+
+        std::atomic<std::size_t> pending;
+        std::atomic<bool>        failed{ false };
+        std::atomic<bool>        complete{ true };
+        const CancellationToken* cancellation;
+        std::mutex               exception_mutex;
+        std::exception_ptr       exception;
+    };
+
+    template <typename Index, typename Function>
+    struct Body
+    {
+        // Returns false if the group was stopped part way.
+        static bool run(void* context, const Group& group, std::uint64_t first, std::uint64_t last)
+        {
+            auto& body = *static_cast<Body*>(context);
+            for (std::uint64_t i = first; i < last; ++i) {
+                if (group.stopped()) {
+                    return false;
+                }
+                body.f(static_cast<Index>(body.begin + static_cast<Index>(i)));
+            }
+            return true;
+        }
+
+        Function& f;
+        Index     begin;
+    };
+
+    struct Task
+    {
+        bool (*run)(void*, const Group&, std::uint64_t, std::uint64_t);
+        void*         context;
+        Group*        group;
+        std::uint64_t first;
+        std::uint64_t last;
+    };
+
+    struct Queue
+    {
+        std::mutex                                 mutex;
+        std::array<std::deque<Task>, k_priorities> tasks;
+    };
+
+    // The worker whose queue the current thread uses, if it is one of ours.
+    static inline thread_local const TaskScheduler* t_scheduler = nullptr;
+    static inline thread_local unsigned             t_worker    = 0;
+
+    std::size_t current_queue() const noexcept
+    {
+        return (t_scheduler == this) ? t_worker : m_queues.size() - 1;
+    }
+
+    static void execute(const Task& task)
+    {
+        Group& group = *task.group;
+        try {
+            if (!task.run(task.context, group, task.first, task.last)) {
+                group.complete.store(false, std::memory_order_relaxed);
+            }
+        } catch (...) {
+            std::scoped_lock lock(group.exception_mutex);
+            if (!group.exception) {
+                group.exception = std::current_exception();
+            }
+            group.failed.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    void finish(Group& group)
+    {
+        // The waiter may return, and destroy the group, as soon as pending reaches zero.
+        if (group.pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            notify();
+        }
+    }
+
+    // Higher priorities first; at each priority our own newest task, then the oldest task of another queue, starting
+    // from a random one.
+    bool try_run_one(std::size_t self, std::minstd_rand& rng)
+    {
+        const std::size_t queues = m_queues.size();
+        for (std::size_t priority = 0; priority < k_priorities; ++priority) {
+            std::optional<Task> task;
+            {
+                Queue&           own = *m_queues[self];
+                std::scoped_lock lock(own.mutex);
+                auto&            tasks = own.tasks[priority];
+                if (!tasks.empty()) {
+                    task = tasks.back();
+                    tasks.pop_back();
+                }
+            }
+            const std::size_t start = rng() % queues;
+            for (std::size_t i = 0; i < queues && !task; ++i) {
+                const std::size_t victim = (start + i) % queues;
+                if (victim == self) {
+                    continue;
+                }
+                Queue&           other = *m_queues[victim];
+                std::scoped_lock lock(other.mutex);
+                auto&            tasks = other.tasks[priority];
+                if (!tasks.empty()) {
+                    task = tasks.front();
+                    tasks.pop_front();
+                }
+            }
+            if (task) {
+                execute(*task);
+                finish(*task->group);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void notify()
+    {
+        {
+            std::scoped_lock lock(m_sleep_mutex);
+            m_epoch.fetch_add(1, std::memory_order_release);
+        }
+        m_wake.notify_all();
+    }
+
+    void worker_loop(unsigned index)
+    {
+        t_scheduler = this;
+        t_worker    = index;
+        std::minstd_rand rng(static_cast<std::minstd_rand::result_type>(task_seed(m_seed, index)));
+
+        for (;;) {
+            const std::uint64_t epoch = m_epoch.load(std::memory_order_acquire);
+            if (try_run_one(index, rng)) {
+                continue;
+            }
+            std::unique_lock lock(m_sleep_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_epoch.load(std::memory_order_relaxed) != epoch; });
+            if (m_stop) {
+                return;
+            }
+        }
+    }
+
+    // Runs queued work until the group is done.
+    void wait(Group& group)
+    {
+        const std::size_t self = current_queue();
+        std::minstd_rand  rng(static_cast<std::minstd_rand::result_type>(task_seed(m_seed, self)));
+
+        while (group.pending.load(std::memory_order_acquire) != 0) {
+            const std::uint64_t epoch = m_epoch.load(std::memory_order_acquire);
+            if (try_run_one(self, rng)) {
+                continue;
+            }
+            std::unique_lock lock(m_sleep_mutex);
+            m_wake.wait(lock, [&] {
+                return group.pending.load(std::memory_order_acquire) == 0 ||
+                       m_epoch.load(std::memory_order_relaxed) != epoch;
+            });
+        }
+    }
+
+    std::uint64_t                       m_seed;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::mutex                          m_sleep_mutex;
+    std::condition_variable             m_wake;
+    std::atomic<std::uint64_t>          m_epoch{ 0 };
+    bool                                m_stop{ false };
+    std::vector<std::jthread>           m_threads;
+};
+
+// Calls f(tile_x, tile_y) for every tile of a tiled image (e.g., Array2DSFC), or f(tile_x, tile_y, seed) with the
+// tile's task_seed. Tasks are runs of tiles in Morton order over the tile grid, so each task covers a compact block of
+// the image. Returns false if cancelled.
+template <typename ImageType, typename Function>
+bool parallel_for_tiles(TaskScheduler& scheduler, const ImageType& img, Function f, const ParallelOptions& options = {})
+{
+    // Tile indices are as wide as the image's (Array2DSFC64 has 64-bit ones); tile coordinates fit in 32 bits.
+    using index_type = decltype(img.num_tiles_width() * img.num_tiles_height());
+
+    const auto ntx = static_cast<std::uint32_t>(img.num_tiles_width());
+    const auto nty = static_cast<std::uint32_t>(img.num_tiles_height());
+    if (ntx == 0 || nty == 0) {
+        return true;
+    }
+
+    std::uint64_t side = 1;
+    while (side < std::max(ntx, nty)) {
+        side *= 2;
+    }
+    std::vector<index_type> order;
+    order.reserve(std::size_t{ ntx } * nty);
+    for (std::uint64_t code = 0; code < side * side; ++code) {
+        std::uint32_t tx;
+        std::uint32_t ty;
+        morton_decode(code, tx, ty);
+        if (tx < ntx && ty < nty) {
+            order.push_back(static_cast<index_type>(index_type{ ty } * ntx + tx));
+        }
+    }
+
+    return scheduler.parallel_for(
+        std::size_t{ 0 },
+        order.size(),
+        [&](std::size_t i) {
+            const index_type tile = order[i];
+            const auto       tx   = static_cast<std::uint32_t>(tile % ntx);
+            const auto       ty   = static_cast<std::uint32_t>(tile / ntx);
+            if constexpr (std::is_invocable_v<Function&, std::uint32_t, std::uint32_t, std::uint64_t>) {
+                f(tx, ty, task_seed(scheduler.seed(), tile));
+            } else {
+                f(tx, ty);
+            }
+        },
+        options);
+}
+
+template <typename ImageType, typename Function>
+bool parallel_for_tiles(const ImageType& img, Function f, const ParallelOptions& options = {})
+{
+    return parallel_for_tiles(TaskScheduler::global(), img, std::move(f), options);
+}
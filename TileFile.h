@@ -0,0 +1,748 @@
+#pragma once
+
+#include "Array2D.h"
+#include "Image.h"
+#include "Morton.h"
+#include "Parallel.h"
+#include "PixelTraits.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// A lossless, tiled on-disk format for Array2DSFC images. Every tile is compressed on its own, so tiles can be encoded
+// and decoded in parallel, and a single tile can be read without touching the rest of the file.
+//
+// Layout (all integers little-endian):
+//     char[4]        magic "ILTF"
+//     uint16         version
+//     uint8          pixel format (PixelFormat)
+//     uint8          log2 of the tile size
+//     uint32         width
+//     uint32         height
+//     uint32         number of tiles
+//     { uint64 offset, uint32 size } for each tile, in storage (row-major tile) order
+//     compressed tiles
+//
+// A tile holds the tile's storage slots (padding slots are zero) as byte planes: byte k of every pixel, then byte
+// k + 1, and so on, with channel bytes in little-endian order. Each plane is delta coded, which turns smooth data (e.g., the
+// exponent bytes of floats) into runs of small values, and then stored as whichever is smallest of:
+//     0: raw bytes
+//     1: a single repeated byte
+//     2: order-0 rANS with a per-plane frequency table
+
+namespace tile_file {
+constexpr std::array<char, 4> k_magic   = { 'I', 'L', 'T', 'F' };
+constexpr std::uint16_t       k_version = 1;
+
+constexpr std::uint32_t k_header_size      = 4 + 2 + 1 + 1 + 4 + 4 + 4;
+constexpr std::uint32_t k_index_entry_size = 8 + 4;
+
+enum class PlaneMethod : std::uint8_t
+{
+    raw      = 0,
+    constant = 1,
+    rans     = 2
+};
+
+class ByteWriter
+{
+public:
+    explicit ByteWriter(std::vector<std::uint8_t>& out) noexcept
+    : m_out(out)
+    {
+    }
+
+    template <typename T>
+    void put(T v)
+    {
+        static_assert(std::is_integral_v<T>);
+        for (std::size_t i = 0; i < sizeof(T); ++i) {
+            m_out.push_back(static_cast<std::uint8_t>(static_cast<std::make_unsigned_t<T>>(v) >> (8 * i)));
+        }
+    }
+
+    void put(std::span<const std::uint8_t> bytes)
+    {
+        m_out.insert(m_out.end(), bytes.begin(), bytes.end());
+    }
+
+private:
+    std::vector<std::uint8_t>& m_out;
+};
+
+class ByteReader
+{
+public:
+    explicit ByteReader(std::span<const std::uint8_t> in) noexcept
+    : m_in(in)
+    {
+    }
+
+    template <typename T>
+    T get()
+    {
+        static_assert(std::is_integral_v<T>);
+        require(sizeof(T));
+        std::make_unsigned_t<T> v = 0;
+        for (std::size_t i = 0; i < sizeof(T); ++i) {
+            v |= static_cast<std::make_unsigned_t<T>>(m_in[m_position++]) << (8 * i);
+        }
+        return static_cast<T>(v);
+    }
+
+    std::span<const std::uint8_t> get(std::size_t count)
+    {
+        require(count);
+        const auto bytes = m_in.subspan(m_position, count);
+        m_position += count;
+        return bytes;
+    }
+
+private:
+    void require(std::size_t count) const
+    {
+        if (m_in.size() - m_position < count) {
+            throw ImageError("Truncated tile data");
+        }
+    }
+
+    std::span<const std::uint8_t> m_in;
+    std::size_t                   m_position{ 0 };
+};
+
+// -------------------------------------------------------------------------------------------------------------------
+// Order-0 rANS with byte-wise renormalization and a 32-bit state.
+// -------------------------------------------------------------------------------------------------------------------
+
+constexpr std::uint32_t k_prob_bits  = 12;
+constexpr std::uint32_t k_prob_scale = 1u << k_prob_bits;
+constexpr std::uint32_t k_rans_low   = 1u << 23;
+
+struct SymbolStats
+{
+    std::array<std::uint32_t, 256> freq{};
+    std::array<std::uint32_t, 257> cumulative{};
+
+    void build_cumulative() noexcept
+    {
+        cumulative[0] = 0;
+        for (int s = 0; s < 256; ++s) {
+            cumulative[s + 1] = cumulative[s] + freq[s];
+        }
+    }
+};
+
+// Scales the counts to sum to k_prob_scale, keeping every present symbol at a frequency of at least one.
+inline SymbolStats normalize_frequencies(std::span<const std::uint8_t> data)
+{
+    std::array<std::uint32_t, 256> counts{};
+    for (const std::uint8_t b : data) {
+        ++counts[b];
+    }
+
+    SymbolStats   stats;
+    std::uint32_t sum = 0;
+    for (int s = 0; s < 256; ++s) {
+        if (counts[s] > 0) {
+            const auto f  = static_cast<std::uint32_t>(std::uint64_t{ counts[s] } * k_prob_scale / data.size());
+            stats.freq[s] = std::max(f, 1u);
+            sum += stats.freq[s];
+        }
+    }
+
+    // Give the rounding error to (or take it from) the most frequent symbols.
+    while (sum != k_prob_scale) {
+        const auto largest = static_cast<std::size_t>(std::max_element(stats.freq.begin(), stats.freq.end()) -
+                                                      stats.freq.begin());
+        if (sum < k_prob_scale) {
+            stats.freq[largest] += k_prob_scale - sum;
+            sum = k_prob_scale;
+        } else {
+            const std::uint32_t take = std::min(sum - k_prob_scale, stats.freq[largest] - 1);
+            stats.freq[largest] -= take;
+            sum -= take;
+        }
+    }
+
+    stats.build_cumulative();
+    return stats;
+}
+
+inline void write_frequencies(ByteWriter& out, const SymbolStats& stats)
+{
+    const auto present = static_cast<std::uint32_t>(std::count_if(stats.freq.begin(), stats.freq.end(), [](auto f) {
+        return f > 0;
+    }));
+    out.put(static_cast<std::uint8_t>(present - 1));
+    for (int s = 0; s < 256; ++s) {
+        const std::uint32_t f = stats.freq[s];
+        if (f == 0) {
+            continue;
+        }
+        out.put(static_cast<std::uint8_t>(s));
+        // Frequencies are at most 4096: one byte below 128, two bytes otherwise.
+        if (f < 0x80u) {
+            out.put(static_cast<std::uint8_t>(f));
+        } else {
+            out.put(static_cast<std::uint8_t>(0x80u | (f >> 8u)));
+            out.put(static_cast<std::uint8_t>(f & 0xFFu));
+        }
+    }
+}
+
+inline SymbolStats read_frequencies(ByteReader& in)
+{
+    SymbolStats         stats;
+    const std::uint32_t present = in.get<std::uint8_t>() + 1u;
+    for (std::uint32_t i = 0; i < present; ++i) {
+        const std::uint8_t s = in.get<std::uint8_t>();
+        std::uint32_t      f = in.get<std::uint8_t>();
+        if (f & 0x80u) {
+            f = ((f & 0x7Fu) << 8u) | in.get<std::uint8_t>();
+        }
+        stats.freq[s] = f;
+    }
+    stats.build_cumulative();
+    if (stats.cumulative[256] != k_prob_scale) {
+        throw ImageError("Corrupt frequency table");
+    }
+    return stats;
+}
+
+// Returns the encoded bytes. rANS encodes back to front, so we fill the buffer from its end.
+inline std::vector<std::uint8_t> rans_encode(std::span<const std::uint8_t> data, const SymbolStats& stats)
+{
+    std::vector<std::uint8_t> buffer(data.size() + data.size() / 2 + 16);
+    std::size_t               position = buffer.size();
+
+    auto put = [&](std::uint8_t b) {
+        if (position == 0) {
+            // Incompressible beyond our estimate: grow at the front.
+            const std::size_t extra = buffer.size();
+            buffer.insert(buffer.begin(), extra, 0);
+            position += extra;
+        }
+        buffer[--position] = b;
+    };
+
+    std::uint32_t state = k_rans_low;
+    for (std::size_t i = data.size(); i-- > 0;) {
+        const std::uint8_t  s     = data[i];
+        const std::uint32_t freq  = stats.freq[s];
+        const std::uint32_t limit = ((k_rans_low >> k_prob_bits) << 8u) * freq;
+        while (state >= limit) {
+            put(static_cast<std::uint8_t>(state & 0xFFu));
+            state >>= 8u;
+        }
+        state = ((state / freq) << k_prob_bits) + (state % freq) + stats.cumulative[s];
+    }
+    // The decoder reads the final state most significant byte first.
+    for (int i = 0; i < 4; ++i) {
+        put(static_cast<std::uint8_t>(state & 0xFFu));
+        state >>= 8u;
+    }
+
+    return { buffer.begin() + static_cast<std::ptrdiff_t>(position), buffer.end() };
+}
+
+inline void rans_decode(std::span<const std::uint8_t> in, const SymbolStats& stats, std::span<std::uint8_t> out)
+{
+    if (in.size() < 4) {
+        throw ImageError("Truncated rANS stream");
+    }
+
+    std::size_t   position = 0;
+    std::uint32_t state    = 0;
+    for (int i = 0; i < 4; ++i) {
+        state = (state << 8u) | in[position++];
+    }
+
+    constexpr std::uint32_t mask = k_prob_scale - 1;
+    for (auto& b : out) {
+        const std::uint32_t slot = state & mask;
+        // Find s with cumulative[s] <= slot < cumulative[s + 1].
+        const auto s = static_cast<std::uint32_t>(
+            std::upper_bound(stats.cumulative.begin() + 1, stats.cumulative.end(), slot) - stats.cumulative.begin() -
+            1);
+        b     = static_cast<std::uint8_t>(s);
+        state = stats.freq[s] * (state >> k_prob_bits) + slot - stats.cumulative[s];
+        while (state < k_rans_low && position < in.size()) {
+            state = (state << 8u) | in[position++];
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------------------------
+// Planes and tiles
+// -------------------------------------------------------------------------------------------------------------------
+
+inline void encode_plane(ByteWriter& out, std::span<std::uint8_t> plane)
+{
+    // Delta code in place.
+    for (std::size_t i = plane.size(); i-- > 1;) {
+        plane[i] = static_cast<std::uint8_t>(plane[i] - plane[i - 1]);
+    }
+
+    if (std::all_of(plane.begin(), plane.end(), [&](std::uint8_t b) { return b == plane[0]; })) {
+        out.put(static_cast<std::uint8_t>(PlaneMethod::constant));
+        out.put(plane[0]);
+        return;
+    }
+
+    const SymbolStats stats = normalize_frequencies(plane);
+    const auto        coded = rans_encode(plane, stats);
+
+    std::vector<std::uint8_t> table;
+    ByteWriter                table_writer(table);
+    write_frequencies(table_writer, stats);
+
+    if (table.size() + coded.size() + 4 < plane.size()) {
+        out.put(static_cast<std::uint8_t>(PlaneMethod::rans));
+        out.put(std::span<const std::uint8_t>(table));
+        out.put(static_cast<std::uint32_t>(coded.size()));
+        out.put(std::span<const std::uint8_t>(coded));
+    } else {
+        out.put(static_cast<std::uint8_t>(PlaneMethod::raw));
+        out.put(std::span<const std::uint8_t>(plane));
+    }
+}
+
+inline void decode_plane(ByteReader& in, std::span<std::uint8_t> plane)
+{
+    switch (static_cast<PlaneMethod>(in.get<std::uint8_t>())) {
+    case PlaneMethod::raw:
+        {
+            const auto bytes = in.get(plane.size());
+            std::copy(bytes.begin(), bytes.end(), plane.begin());
+            break;
+        }
+    case PlaneMethod::constant:
+        std::fill(plane.begin(), plane.end(), in.get<std::uint8_t>());
+        break;
+    case PlaneMethod::rans:
+        {
+            const SymbolStats   stats = read_frequencies(in);
+            const std::uint32_t size  = in.get<std::uint32_t>();
+            rans_decode(in.get(size), stats, plane);
+            break;
+        }
+    default:
+        throw ImageError("Unknown plane encoding");
+    }
+
+    for (std::size_t i = 1; i < plane.size(); ++i) {
+        plane[i] = static_cast<std::uint8_t>(plane[i] + plane[i - 1]);
+    }
+}
+
+// The memory offset of little-endian byte k of a channel of size channel_size.
+constexpr std::size_t channel_byte_offset(std::size_t k, std::size_t channel_size) noexcept
+{
+    return (std::endian::native == std::endian::little) ? k : channel_size - 1 - k;
+}
+
+// Encodes the bytes of a tile of pixels of type T.
+template <typename T>
+std::vector<std::uint8_t> encode_tile(std::span<const std::uint8_t> bytes)
+{
+    constexpr std::size_t k_pixel_size   = sizeof(T);
+    constexpr std::size_t k_channel_size = sizeof(channel_type_t<T>);
+
+    const std::size_t count = bytes.size() / k_pixel_size;
+
+    std::vector<std::uint8_t> plane(count);
+    std::vector<std::uint8_t> out;
+    out.reserve(count * k_pixel_size / 2);
+    ByteWriter writer(out);
+
+    for (std::size_t p = 0; p < k_pixel_size; ++p) {
+        const std::size_t channel = p / k_channel_size;
+        const std::size_t offset  = channel * k_channel_size + channel_byte_offset(p % k_channel_size, k_channel_size);
+        for (std::size_t i = 0; i < count; ++i) {
+            plane[i] = bytes[i * k_pixel_size + offset];
+        }
+        encode_plane(writer, plane);
+    }
+    return out;
+}
+
+template <typename T>
+void decode_tile(std::span<const std::uint8_t> in, T* slots, std::size_t count)
+{
+    constexpr std::size_t k_pixel_size   = sizeof(T);
+    constexpr std::size_t k_channel_size = sizeof(channel_type_t<T>);
+
+    auto* const bytes = reinterpret_cast<std::uint8_t*>(slots);
+
+    std::vector<std::uint8_t> plane(count);
+    ByteReader                reader(in);
+
+    for (std::size_t p = 0; p < k_pixel_size; ++p) {
+        decode_plane(reader, plane);
+        const std::size_t channel = p / k_channel_size;
+        const std::size_t offset  = channel * k_channel_size + channel_byte_offset(p % k_channel_size, k_channel_size);
+        for (std::size_t i = 0; i < count; ++i) {
+            bytes[i * k_pixel_size + offset] = plane[i];
+        }
+    }
+}
+
+struct TileIndexEntry
+{
+    std::uint64_t offset;
+    std::uint32_t size;
+};
+
+// Array2DSFC tiles are far smaller than this; the limit keeps 1 << log_tile_size defined and the tile area in 32 bits.
+constexpr std::uint32_t k_max_log_tile_size = 15;
+
+struct Header
+{
+    PixelFormat                 format{ PixelFormat::unknown };
+    std::uint32_t               log_tile_size{ 0 };
+    std::uint32_t               width{ 0 };
+    std::uint32_t               height{ 0 };
+    std::uint32_t               tile_count{ 0 };
+    std::uint64_t               stream_size{ 0 };
+    std::vector<TileIndexEntry> tiles;
+};
+
+// The number of bytes in the stream, from its start. The header is untrusted, so everything it says about offsets and
+// sizes is checked against this before anything is allocated.
+inline std::uint64_t stream_size(std::istream& ins)
+{
+    const auto position = ins.tellg();
+    ins.seekg(0, std::ios_base::end);
+    const auto end = ins.tellg();
+    ins.seekg(position);
+    if (position < 0 || end < 0 || !ins) {
+        throw ImageError("Tile files need a seekable stream");
+    }
+    return static_cast<std::uint64_t>(end);
+}
+
+// Reads and checks the fixed part of the header. The tile index follows; see read_index.
+inline Header read_header(std::istream& ins)
+{
+    const std::uint64_t size = stream_size(ins);
+
+    std::vector<std::uint8_t> fixed(k_header_size);
+    ins.read(reinterpret_cast<char*>(fixed.data()), fixed.size());
+    if (!ins || !std::equal(k_magic.begin(), k_magic.end(), fixed.begin())) {
+        throw ImageError("Not a tile file");
+    }
+
+    ByteReader reader(fixed);
+    reader.get(k_magic.size());
+    if (reader.get<std::uint16_t>() != k_version) {
+        throw ImageError("Unsupported tile file version");
+    }
+
+    Header header;
+    header.format        = static_cast<PixelFormat>(reader.get<std::uint8_t>());
+    header.log_tile_size = reader.get<std::uint8_t>();
+    header.width         = reader.get<std::uint32_t>();
+    header.height        = reader.get<std::uint32_t>();
+    header.tile_count    = reader.get<std::uint32_t>();
+    header.stream_size   = size;
+
+    if (header.log_tile_size > k_max_log_tile_size) {
+        throw ImageError("Unsupported tile size");
+    }
+    const std::uint64_t tile_size = std::uint64_t{ 1 } << header.log_tile_size;
+    const std::uint64_t tiles_x   = (std::uint64_t{ header.width } + tile_size - 1) / tile_size;
+    const std::uint64_t tiles_y   = (std::uint64_t{ header.height } + tile_size - 1) / tile_size;
+    if (tiles_x * tiles_y != header.tile_count) {
+        throw ImageError("Inconsistent tile index");
+    }
+    if (std::uint64_t{ header.tile_count } * k_index_entry_size > size - k_header_size) {
+        throw ImageError("Truncated tile index");
+    }
+    return header;
+}
+
+// Reads the tile index, and checks that every tile lies within the stream, after the index.
+inline void read_index(std::istream& ins, Header& header)
+{
+    std::vector<std::uint8_t> index(std::size_t{ header.tile_count } * k_index_entry_size);
+    ins.read(reinterpret_cast<char*>(index.data()), static_cast<std::streamsize>(index.size()));
+    if (!ins) {
+        throw ImageError("Truncated tile index");
+    }
+
+    const std::uint64_t payload_begin = k_header_size + std::uint64_t{ header.tile_count } * k_index_entry_size;
+
+    ByteReader index_reader(index);
+    header.tiles.resize(header.tile_count);
+    for (auto& tile : header.tiles) {
+        tile.offset = index_reader.get<std::uint64_t>();
+        tile.size   = index_reader.get<std::uint32_t>();
+        // Written so that nothing can wrap: size <= stream_size, then offset + size <= stream_size.
+        if (tile.offset < payload_begin || tile.size > header.stream_size ||
+            tile.offset > header.stream_size - tile.size) {
+            throw ImageError("Inconsistent tile index");
+        }
+    }
+}
+
+// Checks the header against the image type it is read into. read_header has already checked that the tile count
+// matches the dimensions.
+template <typename ImageType>
+void check_header(const Header& header)
+{
+    using T = typename ImageType::value_type;
+
+    if (header.format != pixel_format_v<T>) {
+        throw ImageError("Unexpected pixel format");
+    }
+    if ((std::uint64_t{ 1 } << header.log_tile_size) != ImageType::tile_width) {
+        throw ImageError("Unexpected tile size");
+    }
+}
+
+template <typename ImageType>
+constexpr void check_image_type()
+{
+    using T = typename ImageType::value_type;
+    static_assert(std::is_trivially_copyable_v<T>, "Pixels are serialized as bytes");
+    static_assert(pixel_format_v<T> != PixelFormat::unknown, "The pixel type needs a PixelFormat");
+}
+} // namespace tile_file
+
+template <typename ExecutionPolicy, typename T, std::uint32_t log_tile_size, typename allocator_t, typename index_t>
+requires is_execution_policy_v<ExecutionPolicy>
+void write_tile_file(ExecutionPolicy&&                                         policy,
+                     std::ostream&                                             outs,
+                     const Array2DSFC<T, log_tile_size, allocator_t, index_t>& img)
+{
+    using namespace tile_file;
+    using ImageType = Array2DSFC<T, log_tile_size, allocator_t, index_t>;
+    using size_type = typename ImageType::size_type;
+    check_image_type<ImageType>();
+
+    const size_type tiles_x    = img.num_tiles_width();
+    const size_type tile_count = tiles_x * img.num_tiles_height();
+    if constexpr (sizeof(size_type) > sizeof(std::uint32_t)) {
+        // The header stores the dimensions and the tile count in 32 bits.
+        constexpr size_type k_max = std::numeric_limits<std::uint32_t>::max();
+        if (img.width() > k_max || img.height() > k_max || tile_count > k_max) {
+            throw ImageError("Image too large for a tile file");
+        }
+    }
+
+    std::vector<std::vector<std::uint8_t>> tiles(tile_count);
+    for_each_index(policy, size_type{ 0 }, tile_count, [&](size_type tile_index) {
+        const size_type tile_x = tile_index % tiles_x;
+        const size_type tile_y = tile_index / tiles_x;
+        const size_type x0     = tile_x * ImageType::tile_width;
+        const size_type y0     = tile_y * ImageType::tile_height;
+
+        const T* const    first   = img.data() + img.tile_storage_index(tile_x, tile_y);
+        const auto* const storage = reinterpret_cast<const std::uint8_t*>(first);
+        if (x0 + ImageType::tile_width <= img.width() && y0 + ImageType::tile_height <= img.height()) {
+            const std::size_t size = ImageType::tile_area * sizeof(T);
+            tiles[tile_index]      = encode_tile<T>(std::span<const std::uint8_t>(storage, size));
+            return;
+        }
+
+        // The padding slots of an edge tile are never constructed: copy the slots inside the image, and leave the
+        // others zero.
+        std::vector<std::uint8_t> bytes(ImageType::tile_area * sizeof(T));
+        const size_type           nx = std::min<size_type>(ImageType::tile_width, img.width() - x0);
+        const size_type           ny = std::min<size_type>(ImageType::tile_height, img.height() - y0);
+        for (size_type y = 0; y < ny; ++y) {
+            for (size_type x = 0; x < nx; ++x) {
+                const std::size_t offset = morton_tile_index<log_tile_size>(x, y) * sizeof(T);
+                std::memcpy(bytes.data() + offset, storage + offset, sizeof(T));
+            }
+        }
+        tiles[tile_index] = encode_tile<T>(bytes);
+    });
+
+    std::vector<std::uint8_t> header;
+    ByteWriter                writer(header);
+    writer.put(std::span<const std::uint8_t>(reinterpret_cast<const std::uint8_t*>(k_magic.data()), k_magic.size()));
+    writer.put(k_version);
+    writer.put(static_cast<std::uint8_t>(pixel_format_v<T>));
+    writer.put(static_cast<std::uint8_t>(log_tile_size));
+    writer.put(static_cast<std::uint32_t>(img.width()));
+    writer.put(static_cast<std::uint32_t>(img.height()));
+    writer.put(static_cast<std::uint32_t>(tile_count));
+
+    std::uint64_t offset = k_header_size + std::uint64_t{ tile_count } * k_index_entry_size;
+    for (const auto& tile : tiles) {
+        writer.put(offset);
+        writer.put(static_cast<std::uint32_t>(tile.size()));
+        offset += tile.size();
+    }
+
+    outs.write(reinterpret_cast<const char*>(header.data()), header.size());
+    for (const auto& tile : tiles) {
+        outs.write(reinterpret_cast<const char*>(tile.data()), tile.size());
+    }
+    if (!outs) {
+        throw ImageError("Unable to write tile file");
+    }
+}
+
+template <typename ExecutionPolicy, typename T, std::uint32_t log_tile_size, typename allocator_t, typename index_t>
+requires is_execution_policy_v<ExecutionPolicy>
+void write_tile_file(ExecutionPolicy&&                                         policy,
+                     const std::filesystem::path&                              file,
+                     const Array2DSFC<T, log_tile_size, allocator_t, index_t>& img)
+{
+    std::ofstream outs(file, std::ios_base::binary | std::ios_base::out);
+    if (!outs) {
+        throw ImageError("Unable to open " + file.string());
+    }
+    write_tile_file(policy, outs, img);
+}
+
+template <typename ImageType>
+void write_tile_file(const std::filesystem::path& file, const ImageType& img)
+{
+    write_tile_file(std::execution::seq, file, img);
+}
+
+// Reads all of the compressed data with one read, and decodes the tiles in place.
+template <typename ImageType, typename ExecutionPolicy>
+requires is_execution_policy_v<ExecutionPolicy>
+ImageType read_tile_file(ExecutionPolicy&& policy, std::istream& ins)
+{
+    using namespace tile_file;
+    using size_type = typename ImageType::size_type;
+    check_image_type<ImageType>();
+
+    Header header = read_header(ins);
+    check_header<ImageType>(header);
+    read_index(ins, header);
+
+    // read_index has checked every tile against the stream size, so neither the sum nor the allocation can run away.
+    const std::uint64_t payload_begin = k_header_size + std::uint64_t{ header.tile_count } * k_index_entry_size;
+    std::uint64_t       payload_end   = payload_begin;
+    for (const auto& tile : header.tiles) {
+        payload_end = std::max(payload_end, tile.offset + tile.size);
+    }
+
+    std::vector<std::uint8_t> payload(payload_end - payload_begin);
+    ins.read(reinterpret_cast<char*>(payload.data()), static_cast<std::streamsize>(payload.size()));
+    if (!ins) {
+        throw ImageError("Truncated tile file");
+    }
+
+    ImageType       img(header.width, header.height);
+    const size_type tiles_x = img.num_tiles_width();
+
+    for_each_index(policy, size_type{ 0 }, static_cast<size_type>(header.tiles.size()), [&](size_type tile_index) {
+        const auto&     tile = header.tiles[tile_index];
+        const size_type first = img.tile_storage_index(tile_index % tiles_x, tile_index / tiles_x);
+        decode_tile(std::span<const std::uint8_t>(payload).subspan(tile.offset - payload_begin, tile.size),
+                    img.data() + first,
+                    ImageType::tile_area);
+    });
+    return img;
+}
+
+template <typename ImageType, typename ExecutionPolicy>
+requires is_execution_policy_v<ExecutionPolicy>
+ImageType read_tile_file(ExecutionPolicy&& policy, const std::filesystem::path& file)
+{
+    std::ifstream ins(file, std::ios_base::binary | std::ios_base::in);
+    if (!ins) {
+        throw ImageError("Unable to open " + file.string());
+    }
+    return read_tile_file<ImageType>(policy, ins);
+}
+
+template <typename ImageType>
+ImageType read_tile_file(const std::filesystem::path& file)
+{
+    return read_tile_file<ImageType>(std::execution::seq, file);
+}
+
+// Random access to the tiles of a file. The header and tile index are read when opening; each read_tile call then
+// seeks to and decodes one tile. A reader is not thread-safe: use one per thread.
+class TileFileReader
+{
+public:
+    explicit TileFileReader(const std::filesystem::path& file)
+    : m_ins(file, std::ios_base::binary | std::ios_base::in)
+    {
+        if (!m_ins) {
+            throw ImageError("Unable to open " + file.string());
+        }
+        m_header = tile_file::read_header(m_ins);
+        tile_file::read_index(m_ins, m_header);
+    }
+
+    PixelFormat pixel_format() const noexcept
+    {
+        return m_header.format;
+    }
+
+    std::uint32_t width() const noexcept
+    {
+        return m_header.width;
+    }
+
+    std::uint32_t height() const noexcept
+    {
+        return m_header.height;
+    }
+
+    std::uint32_t tile_size() const noexcept
+    {
+        return 1u << m_header.log_tile_size;
+    }
+
+    std::uint32_t num_tiles_width() const noexcept
+    {
+        return (m_header.width + tile_size() - 1) / tile_size();
+    }
+
+    std::uint32_t num_tiles_height() const noexcept
+    {
+        return (m_header.height + tile_size() - 1) / tile_size();
+    }
+
+    // Decodes one tile into tile_size() * tile_size() pixels in Morton order, which is the layout of a tile in
+    // Array2DSFC storage.
+    template <typename T>
+    void read_tile(std::uint32_t tile_x, std::uint32_t tile_y, std::span<T> out)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (pixel_format_v<T> != m_header.format) {
+            throw ImageError("Unexpected pixel format");
+        }
+        if (tile_x >= num_tiles_width() || tile_y >= num_tiles_height()) {
+            throw ImageError("Tile out of range");
+        }
+        if (out.size() != std::size_t{ tile_size() } * tile_size()) {
+            throw ImageError("Unexpected tile buffer size");
+        }
+
+        const auto& tile = m_header.tiles[tile_y * num_tiles_width() + tile_x];
+        m_buffer.resize(tile.size);
+        m_ins.seekg(static_cast<std::streamoff>(tile.offset));
+        m_ins.read(reinterpret_cast<char*>(m_buffer.data()), tile.size);
+        if (!m_ins) {
+            throw ImageError("Truncated tile file");
+        }
+        tile_file::decode_tile(std::span<const std::uint8_t>(m_buffer), out.data(), out.size());
+    }
+
+private:
+    std::ifstream             m_ins;
+    tile_file::Header         m_header;
+    std::vector<std::uint8_t> m_buffer;
+};
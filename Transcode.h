@@ -0,0 +1,166 @@
+#pragma once
+
+#include "Morton.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define IMAGE_LIBRARY_SSE2 1
+#endif
+
+// Copies between row-major and Morton-tiled storage of the same trivially copyable pixel type. blit() (ImageView.h)
+// comes here when one side is row-major and the other tiled, and so does convert_image() between an Array2D and an
+// Array2DSFC of the same pixel type:
+//     Array2DSFC<RGBf> sfc(photo.width(), photo.height());
+//     blit(std::execution::par, sfc, photo);
+//
+// The work is split by tile rows of the tiled side, so each task reads or writes tile_height rows of the row-major side
+// and a run of whole tiles. Within a tile, a 4x2 block of pixels is eight consecutive Morton slots: two pixels of one
+// row, two of the next, and again. With SSE2, 4-byte pixels go through as two 64-bit unpacks of a pair of rows; other
+// sizes as pairs of pixels. Tiles cut by the edge of a view go element by element, as their other slots belong to the
+// rest of the parent or are its padding.
+
+namespace transcode_detail {
+// Rows, stride elements apart, into a whole tile.
+template <std::uint32_t log_tile_size, typename T>
+void rows_to_tile(T* tile, const T* src, std::size_t stride) noexcept
+{
+    constexpr std::uint32_t k_size = 1u << log_tile_size;
+
+    if constexpr (log_tile_size < 2) {
+        for (std::uint32_t y = 0; y < k_size; ++y) {
+            for (std::uint32_t x = 0; x < k_size; ++x) {
+                tile[morton_tile_index<log_tile_size>(x, y)] = src[y * stride + x];
+            }
+        }
+    } else {
+        for (std::uint32_t y = 0; y < k_size; y += 2) {
+            const T* const r0 = src + y * stride;
+            const T* const r1 = r0 + stride;
+            for (std::uint32_t x = 0; x < k_size; x += 4) {
+                T* const out = tile + morton_tile_index<log_tile_size>(x, y);
+#if defined(IMAGE_LIBRARY_SSE2)
+                if constexpr (sizeof(T) == 4) {
+                    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x));
+                    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 0), _mm_unpacklo_epi64(a, b));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_unpackhi_epi64(a, b));
+                    continue;
+                }
+#endif
+                std::memcpy(out + 0, r0 + x + 0, 2 * sizeof(T));
+                std::memcpy(out + 2, r1 + x + 0, 2 * sizeof(T));
+                std::memcpy(out + 4, r0 + x + 2, 2 * sizeof(T));
+                std::memcpy(out + 6, r1 + x + 2, 2 * sizeof(T));
+            }
+        }
+    }
+}
+
+// A whole tile into rows, stride elements apart.
+template <std::uint32_t log_tile_size, typename T>
+void tile_to_rows(T* dst, std::size_t stride, const T* tile) noexcept
+{
+    constexpr std::uint32_t k_size = 1u << log_tile_size;
+
+    if constexpr (log_tile_size < 2) {
+        for (std::uint32_t y = 0; y < k_size; ++y) {
+            for (std::uint32_t x = 0; x < k_size; ++x) {
+                dst[y * stride + x] = tile[morton_tile_index<log_tile_size>(x, y)];
+            }
+        }
+    } else {
+        for (std::uint32_t y = 0; y < k_size; y += 2) {
+            T* const r0 = dst + y * stride;
+            T* const r1 = r0 + stride;
+            for (std::uint32_t x = 0; x < k_size; x += 4) {
+                const T* const in = tile + morton_tile_index<log_tile_size>(x, y);
+#if defined(IMAGE_LIBRARY_SSE2)
+                if constexpr (sizeof(T) == 4) {
+                    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 0));
+                    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 4));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(r0 + x), _mm_unpacklo_epi64(a, b));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(r1 + x), _mm_unpackhi_epi64(a, b));
+                    continue;
+                }
+#endif
+                std::memcpy(r0 + x + 0, in + 0, 2 * sizeof(T));
+                std::memcpy(r1 + x + 0, in + 2, 2 * sizeof(T));
+                std::memcpy(r0 + x + 2, in + 4, 2 * sizeof(T));
+                std::memcpy(r1 + x + 2, in + 6, 2 * sizeof(T));
+            }
+        }
+    }
+}
+
+// Calls whole(tile_x, x0, y0) for the tiles of the tile row that lie inside the view, and copy(x, y) for each element
+// of the others.
+template <typename TiledView, typename Whole, typename Copy>
+void for_each_tile_in_row(const TiledView& tiled, typename TiledView::size_type tile_y, Whole whole, Copy copy)
+{
+    using size_type = typename TiledView::size_type;
+
+    const size_type y0 = tile_y * TiledView::tile_height;
+    const size_type y1 = std::min<size_type>(y0 + TiledView::tile_height, tiled.height());
+    for (size_type tile_x = 0; tile_x < tiled.num_tiles_width(); ++tile_x) {
+        const size_type x0 = tile_x * TiledView::tile_width;
+        if (x0 + TiledView::tile_width <= tiled.width() && y1 - y0 == TiledView::tile_height) {
+            whole(tile_x, x0, y0);
+            continue;
+        }
+        const size_type x1 = std::min<size_type>(x0 + TiledView::tile_width, tiled.width());
+        for (size_type y = y0; y < y1; ++y) {
+            for (size_type x = x0; x < x1; ++x) {
+                copy(x, y);
+            }
+        }
+    }
+}
+
+// dst is a TiledImageView and src an ImageView of the same dimensions.
+template <typename ExecutionPolicy, typename TiledView, typename RowView>
+void rows_to_tiles(ExecutionPolicy&& policy, const TiledView& dst, const RowView& src)
+{
+    using size_type = typename TiledView::size_type;
+
+    constexpr auto log_tile_size = static_cast<std::uint32_t>(std::countr_zero(TiledView::tile_width));
+
+    assert(dst.width() == src.width() && dst.height() == src.height());
+    for_each_index(policy, size_type{ 0 }, dst.num_tiles_height(), [&](size_type tile_y) {
+        for_each_tile_in_row(
+            dst,
+            tile_y,
+            [&](size_type tile_x, size_type x0, size_type y0) {
+                rows_to_tile<log_tile_size>(dst.tile_data(tile_x, tile_y), src.row(y0) + x0, src.stride());
+            },
+            [&](size_type x, size_type y) { dst(x, y) = src(x, y); });
+    });
+}
+
+// dst is an ImageView and src a TiledImageView of the same dimensions.
+template <typename ExecutionPolicy, typename RowView, typename TiledView>
+void tiles_to_rows(ExecutionPolicy&& policy, const RowView& dst, const TiledView& src)
+{
+    using size_type = typename TiledView::size_type;
+
+    constexpr auto log_tile_size = static_cast<std::uint32_t>(std::countr_zero(TiledView::tile_width));
+
+    assert(dst.width() == src.width() && dst.height() == src.height());
+    for_each_index(policy, size_type{ 0 }, src.num_tiles_height(), [&](size_type tile_y) {
+        for_each_tile_in_row(
+            src,
+            tile_y,
+            [&](size_type tile_x, size_type x0, size_type y0) {
+                tile_to_rows<log_tile_size>(dst.row(y0) + x0, dst.stride(), src.tile_data(tile_x, tile_y));
+            },
+            [&](size_type x, size_type y) { dst(x, y) = src(x, y); });
+    });
+}
+} // namespace transcode_detail
@@ -0,0 +1,1002 @@
+#include "BlockCompression.h"
+#include "CowArray2D.h"
+#include "Filter.h"
+#include "Image.h"
+#include "ImageConvert.h"
+#include "Instrumentation.h"
+#include "Numa.h"
+#include "SparseArray2D.h"
+#include "TileFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <print>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Benchmarks for the library's I/O, indexing, allocation, sampling, filtering, conversion and compression, on synthetic
+// images.
+//     ImageLibraryBenchmark [--width N] [--height N] [--pixel TYPE] [--iterations N] [--filter TEXT]
+//                           [--format text|json|csv] [--output FILE] [--trace FILE] [--verbose]
+//
+// TYPE is one of rgb8, rgb16, rgbh, rgbf, rgba8, rgba16, rgbah, rgbaf (default rgbf), and selects the pixel type of
+// the I/O, indexing and conversion benchmarks. Each benchmark reports the best of its iterations. Only benchmarks whose
+// "group/name" contains the filter text are run; --verbose names each one on stderr as it starts. JSON and CSV output
+// are meant for tracking results across releases.
+// Built with IMAGE_LIBRARY_INSTRUMENTATION, --trace writes the library's timers and counters as a Chrome trace, and a
+// summary of them goes to stderr.
+
+namespace {
+enum class OutputFormat
+{
+    text,
+    json,
+    csv
+};
+
+struct Options
+{
+    std::uint32_t         width{ 4096 };
+    std::uint32_t         height{ 4096 };
+    int                   iterations{ 3 };
+    std::string           pixel{ "rgbf" };
+    std::string           filter;
+    OutputFormat          format{ OutputFormat::text };
+    std::filesystem::path output;
+    std::filesystem::path trace;
+    bool                  verbose{ false };
+};
+
+struct Result
+{
+    std::string group;
+    std::string name;
+    std::string pixel;
+    double      seconds{ 0.0 };
+    double      megapixels_per_second{ 0.0 };
+    double      megabytes_per_second{ 0.0 }; // I/O and copies only
+    double      remote_percent{ -1.0 };      // NUMA only
+};
+
+// Keeps the compiler from discarding the work of the indexing and sampling benchmarks.
+volatile float g_sink;
+
+class Suite
+{
+public:
+    explicit Suite(const Options& options)
+    : m_options(options)
+    {
+    }
+
+    const Options& options() const noexcept
+    {
+        return m_options;
+    }
+
+    bool selected(std::string_view group, std::string_view name) const
+    {
+        const std::string full = std::string(group) + "/" + std::string(name);
+        return m_options.filter.empty() || full.find(m_options.filter) != std::string::npos;
+    }
+
+    // Times f, which processes every pixel of the configured image size once, and returns the number of bytes it
+    // read or wrote (0 if that is not meaningful).
+    template <typename Function>
+    void run(std::string_view group, std::string_view name, std::string_view pixel, Function f)
+    {
+        if (!selected(group, name)) {
+            return;
+        }
+        if (m_options.verbose) {
+            std::println(std::cerr, "{}/{}", group, name);
+        }
+
+        using clock = std::chrono::steady_clock;
+
+        double      best  = std::numeric_limits<double>::infinity();
+        std::size_t bytes = 0;
+        for (int i = 0; i < m_options.iterations; ++i) {
+            const auto start = clock::now();
+            bytes            = f();
+            const auto end   = clock::now();
+
+            const std::chrono::duration<double> seconds = end - start;
+            best = std::min(best, seconds.count());
+        }
+
+        Result result{ std::string(group), std::string(name), std::string(pixel), best };
+        result.megapixels_per_second = pixel_count() / best / 1e6;
+        result.megabytes_per_second  = static_cast<double>(bytes) / best / 1e6;
+        add(std::move(result));
+    }
+
+    void add(Result result)
+    {
+        m_results.push_back(std::move(result));
+    }
+
+    // Adds the share of tiles processed from a remote NUMA node to the result of the last run.
+    void set_remote_percent(double percent)
+    {
+        m_results.back().remote_percent = percent;
+    }
+
+    double pixel_count() const noexcept
+    {
+        return static_cast<double>(m_options.width) * m_options.height;
+    }
+
+    void report(std::ostream& outs) const
+    {
+        switch (m_options.format) {
+        case OutputFormat::text:
+            report_text(outs);
+            break;
+        case OutputFormat::json:
+            report_json(outs);
+            break;
+        case OutputFormat::csv:
+            report_csv(outs);
+            break;
+        }
+    }
+
+private:
+    void report_text(std::ostream& outs) const
+    {
+        std::println(outs,
+                     "{}x{}, {} thread(s), best of {}",
+                     m_options.width,
+                     m_options.height,
+                     TaskScheduler::global().worker_count() + 1,
+                     m_options.iterations);
+        std::string_view group;
+        for (const auto& r : m_results) {
+            if (r.group != group) {
+                group = r.group;
+                std::println(outs, "\n{}", group);
+            }
+            std::print(outs, "  {:<40} {:<6} {:>10.2f} MP/s", r.name, r.pixel, r.megapixels_per_second);
+            if (r.megabytes_per_second > 0.0) {
+                std::print(outs, " {:>10.2f} MB/s", r.megabytes_per_second);
+            }
+            if (r.remote_percent >= 0.0) {
+                std::print(outs, " {:>7.1f}% remote", r.remote_percent);
+            }
+            std::println(outs, "");
+        }
+    }
+
+    void report_json(std::ostream& outs) const
+    {
+        std::println(outs, "{{");
+        std::println(outs, "  \"width\": {},", m_options.width);
+        std::println(outs, "  \"height\": {},", m_options.height);
+        std::println(outs, "  \"threads\": {},", TaskScheduler::global().worker_count() + 1);
+        std::println(outs, "  \"iterations\": {},", m_options.iterations);
+        std::println(outs, "  \"results\": [");
+        for (std::size_t i = 0; i < m_results.size(); ++i) {
+            const auto& r = m_results[i];
+            std::print(outs,
+                       "    {{ \"group\": \"{}\", \"name\": \"{}\", \"pixel\": \"{}\", \"seconds\": {}, "
+                       "\"megapixels_per_second\": {}",
+                       r.group,
+                       r.name,
+                       r.pixel,
+                       r.seconds,
+                       r.megapixels_per_second);
+            if (r.megabytes_per_second > 0.0) {
+                std::print(outs, ", \"megabytes_per_second\": {}", r.megabytes_per_second);
+            }
+            if (r.remote_percent >= 0.0) {
+                std::print(outs, ", \"remote_percent\": {}", r.remote_percent);
+            }
+            std::println(outs, " }}{}", (i + 1 < m_results.size()) ? "," : "");
+        }
+        std::println(outs, "  ]");
+        std::println(outs, "}}");
+    }
+
+    void report_csv(std::ostream& outs) const
+    {
+        std::println(outs,
+                     "group,name,pixel,width,height,seconds,megapixels_per_second,megabytes_per_second,"
+                     "remote_percent");
+        for (const auto& r : m_results) {
+            std::print(outs,
+                       "{},{},{},{},{},{},{},",
+                       r.group,
+                       r.name,
+                       r.pixel,
+                       m_options.width,
+                       m_options.height,
+                       r.seconds,
+                       r.megapixels_per_second);
+            if (r.megabytes_per_second > 0.0) {
+                std::print(outs, "{}", r.megabytes_per_second);
+            }
+            std::print(outs, ",");
+            if (r.remote_percent >= 0.0) {
+                std::print(outs, "{}", r.remote_percent);
+            }
+            std::println(outs, "");
+        }
+    }
+
+    Options             m_options;
+    std::vector<Result> m_results;
+};
+
+// Smooth gradients with a little high-frequency detail, so that blocks are neither constant nor noise.
+template <typename ImageType, typename Function>
+ImageType make_image(std::uint32_t width, std::uint32_t height, Function pixel)
+{
+    ImageType img(width, height);
+    for (std::uint32_t y = 0; y < height; ++y) {
+        for (std::uint32_t x = 0; x < width; ++x) {
+            img(x, y) = pixel(x, y, width, height);
+        }
+    }
+    return img;
+}
+
+RGBA8 ldr_pixel(std::uint32_t x, std::uint32_t y, std::uint32_t width, std::uint32_t height)
+{
+    const auto detail = static_cast<std::uint8_t>(((x * 7) ^ (y * 13)) & 15);
+    return RGBA8(static_cast<std::uint8_t>(x * 255 / width + detail),
+                 static_cast<std::uint8_t>(y * 255 / height),
+                 static_cast<std::uint8_t>((x + y) * 127 / width),
+                 static_cast<std::uint8_t>(255 - detail * 8));
+}
+
+RGBf hdr_pixel(std::uint32_t x, std::uint32_t y, std::uint32_t width, std::uint32_t height)
+{
+    const float detail = static_cast<float>(((x * 7) ^ (y * 13)) & 15) / 16.0f;
+    return RGBf(std::exp2(8.0f * x / width) + detail, std::exp2(4.0f * y / height), 0.25f + detail);
+}
+
+// Linear values in [0, 1], with an alpha channel for the conversions to RGBA.
+RGBAf unit_pixel(std::uint32_t x, std::uint32_t y, std::uint32_t width, std::uint32_t height)
+{
+    const float detail = static_cast<float>(((x * 7) ^ (y * 13)) & 15) / 64.0f;
+    return RGBAf(static_cast<float>(x) / width * 0.75f + detail,
+                 static_cast<float>(y) / height,
+                 static_cast<float>(x + y) / (width + height),
+                 1.0f - detail);
+}
+
+// xorshift64*: cheap enough not to dominate the random-access benchmarks.
+struct Random
+{
+    std::uint64_t next() noexcept
+    {
+        state ^= state >> 12u;
+        state ^= state << 25u;
+        state ^= state >> 27u;
+        return state * 0x2545F4914F6CDD1Dull;
+    }
+
+    std::uint64_t state{ 0x9E3779B97F4A7C15ull };
+};
+
+template <typename Pixel>
+float first_channel(const Pixel& p) noexcept
+{
+    return static_cast<float>(pixel_channel(p, 0));
+}
+
+template <typename ImageType>
+void run_access(Suite& suite, std::string_view layout, std::string_view pixel, const ImageType& img)
+{
+    const std::uint32_t width  = img.width();
+    const std::uint32_t height = img.height();
+    const std::string   prefix = std::string(layout) + " ";
+
+    suite.run("indexing", prefix + "row order", pixel, [&] {
+        float sum = 0.0f;
+        for (std::uint32_t y = 0; y < height; ++y) {
+            for (std::uint32_t x = 0; x < width; ++x) {
+                sum += first_channel(img(x, y));
+            }
+        }
+        g_sink = sum;
+        return std::size_t{ 0 };
+    });
+    suite.run("indexing", prefix + "column order", pixel, [&] {
+        float sum = 0.0f;
+        for (std::uint32_t x = 0; x < width; ++x) {
+            for (std::uint32_t y = 0; y < height; ++y) {
+                sum += first_channel(img(x, y));
+            }
+        }
+        g_sink = sum;
+        return std::size_t{ 0 };
+    });
+    suite.run("indexing", prefix + "random", pixel, [&] {
+        Random      random;
+        float       sum   = 0.0f;
+        std::size_t count = std::size_t{ width } * height;
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::uint64_t r = random.next();
+            sum += first_channel(img(static_cast<std::uint32_t>((r & 0xFFFFFFFFu) % width),
+                                     static_cast<std::uint32_t>((r >> 32u) % height)));
+        }
+        g_sink = sum;
+        return std::size_t{ 0 };
+    });
+    suite.run("indexing", prefix + "16x16 tiles", pixel, [&] {
+        float sum = 0.0f;
+        for (std::uint32_t ty = 0; ty < height; ty += 16) {
+            for (std::uint32_t tx = 0; tx < width; tx += 16) {
+                for (std::uint32_t y = ty; y < std::min(ty + 16, height); ++y) {
+                    for (std::uint32_t x = tx; x < std::min(tx + 16, width); ++x) {
+                        sum += first_channel(img(x, y));
+                    }
+                }
+            }
+        }
+        g_sink = sum;
+        return std::size_t{ 0 };
+    });
+}
+
+// The in-tile Morton index alone, for random positions: computed by interleaving bits, and as Array2DSFC gets it for
+// a tile size.
+template <std::uint32_t log_tile_size>
+void run_tile_index(Suite& suite)
+{
+    constexpr std::uint32_t k_mask = (1u << log_tile_size) - 1;
+
+    const std::string size  = std::to_string(1u << log_tile_size);
+    const auto        count = static_cast<std::size_t>(suite.pixel_count());
+
+    suite.run("indexing", "in-tile index " + size + "x" + size + ", interleaved bits", "-", [&] {
+        Random        random;
+        std::uint32_t sum = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::uint64_t r = random.next();
+            sum += morton_encode(static_cast<std::uint16_t>(r & k_mask),
+                                 static_cast<std::uint16_t>((r >> 32u) & k_mask));
+        }
+        g_sink = static_cast<float>(sum);
+        return std::size_t{ 0 };
+    });
+    suite.run("indexing", "in-tile index " + size + "x" + size + ", morton_tile_index", "-", [&] {
+        Random        random;
+        std::uint32_t sum = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::uint64_t r = random.next();
+            sum += morton_tile_index<log_tile_size>(static_cast<std::uint32_t>(r & k_mask),
+                                                    static_cast<std::uint32_t>((r >> 32u) & k_mask));
+        }
+        g_sink = static_cast<float>(sum);
+        return std::size_t{ 0 };
+    });
+}
+
+// Access latency: every element holds the position of the next in a single random cycle through the image, so each
+// lookup waits on the one before, and the index computation is on the critical path.
+template <typename ImageType>
+void run_pointer_chase(Suite& suite, std::string_view layout)
+{
+    const auto&         options = suite.options();
+    const std::uint32_t width   = options.width;
+    const std::uint32_t height  = options.height;
+    const std::string   name    = "pointer chase, " + std::string(layout);
+    if (!suite.selected("indexing", name) || width > 65'536 || height > 65'536) {
+        return;
+    }
+
+    // Sattolo's algorithm: a random permutation with a single cycle.
+    const std::size_t          count = std::size_t{ width } * height;
+    std::vector<std::uint32_t> next(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        next[i] = static_cast<std::uint32_t>(i);
+    }
+    Random random;
+    for (std::size_t i = count - 1; i > 0; --i) {
+        std::swap(next[i], next[random.next() % i]);
+    }
+
+    // Positions are packed as (y << 16) | x.
+    const auto pack = [width](std::size_t i) {
+        return static_cast<std::uint32_t>(((i / width) << 16u) | (i % width));
+    };
+    ImageType img(width, height);
+    for (std::size_t i = 0; i < count; ++i) {
+        img(static_cast<std::uint32_t>(i % width), static_cast<std::uint32_t>(i / width)) = pack(next[i]);
+    }
+
+    suite.run("indexing", name, "gray32", [&] {
+        std::uint32_t p = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            p = img(p & 0xFFFFu, p >> 16u);
+        }
+        g_sink = static_cast<float>(p);
+        return std::size_t{ 0 };
+    });
+}
+
+void run_index_variants(Suite& suite)
+{
+    run_tile_index<2>(suite);
+    run_tile_index<3>(suite);
+    run_tile_index<4>(suite);
+    run_tile_index<5>(suite);
+    run_tile_index<6>(suite);
+
+    run_pointer_chase<Array2D<std::uint32_t>>(suite, "Array2D");
+    run_pointer_chase<Array2DSFC<std::uint32_t, 2>>(suite, "Array2DSFC 4x4 tiles");
+    run_pointer_chase<Array2DSFC<std::uint32_t, 3>>(suite, "Array2DSFC 8x8 tiles");
+    run_pointer_chase<Array2DSFC<std::uint32_t, 4>>(suite, "Array2DSFC 16x16 tiles");
+    run_pointer_chase<Array2DSFC<std::uint32_t, 5>>(suite, "Array2DSFC 32x32 tiles");
+    run_pointer_chase<Array2DSFC<std::uint32_t, 6>>(suite, "Array2DSFC 64x64 tiles");
+    run_pointer_chase<Array2D64<std::uint32_t>>(suite, "Array2D64");
+    run_pointer_chase<Array2DSFC64<std::uint32_t>>(suite, "Array2DSFC64 16x16 tiles");
+}
+
+// The same access patterns through 64-bit indices, for the cost of the wide variants.
+template <typename Pixel>
+void run_wide_access(Suite& suite, std::string_view pixel, const Array2D<RGBAf>& source)
+{
+    run_access(suite, "Array2D64", pixel, convert_image<Array2D64<Pixel>>(std::execution::par, source));
+    run_access(suite, "Array2DSFC64", pixel, convert_image<Array2DSFC64<Pixel>>(std::execution::par, source));
+}
+
+// Copies the centre quarter of the image into a canvas of the same size: element by element through operator(), against
+// blit() between views, which copies rows (Array2D) or tiles (Array2DSFC) with memcpy.
+template <typename ImageType>
+void run_crop(Suite& suite, std::string_view layout, std::string_view pixel, const ImageType& img)
+{
+    using size_type = typename ImageType::size_type;
+
+    const size_type x0 = img.width() / 4 / 16 * 16;
+    const size_type y0 = img.height() / 4 / 16 * 16;
+    const size_type w  = img.width() / 2;
+    const size_type h  = img.height() / 2;
+    ImageType       canvas(img.width(), img.height());
+
+    suite.run("crop", std::string(layout) + " operator() copy", pixel, [&] {
+        for (size_type y = 0; y < h; ++y) {
+            for (size_type x = 0; x < w; ++x) {
+                canvas(x0 + x, y0 + y) = img(x0 + x, y0 + y);
+            }
+        }
+        g_sink = first_channel(canvas(x0, y0));
+        return std::size_t{ 0 };
+    });
+    suite.run("crop", std::string(layout) + " blit", pixel, [&] {
+        blit(crop(canvas, x0, y0, w, h), crop(img, x0, y0, w, h));
+        g_sink = first_channel(canvas(x0, y0));
+        return std::size_t{ 0 };
+    });
+}
+
+// Row-major to tiled and back, against memcpy of the same bytes between two row-major images. The byte counts are
+// what is read plus what is written.
+template <typename Pixel>
+void run_transcode(Suite& suite, std::string_view pixel, const Array2D<Pixel>& img, const Array2DSFC<Pixel>& sfc)
+{
+    using size_type = typename Array2D<Pixel>::size_type;
+
+    const auto        par   = std::execution::par;
+    const std::size_t bytes = 2 * sizeof(Pixel) * std::size_t{ img.width() } * img.height();
+    Array2D<Pixel>    rows(img.width(), img.height());
+    Array2DSFC<Pixel> tiles(img.width(), img.height());
+
+    suite.run("transcode", "memcpy", pixel, [&] {
+        std::memcpy(rows.data(), img.data(), bytes / 2);
+        g_sink = first_channel(rows(0, 0));
+        return bytes;
+    });
+    suite.run("transcode", "memcpy (parallel rows)", pixel, [&] {
+        for_each_index(par, size_type{ 0 }, img.height(), [&](size_type y) {
+            std::memcpy(&rows(0, y), &img(0, y), sizeof(Pixel) * img.width());
+        });
+        g_sink = first_channel(rows(0, 0));
+        return bytes;
+    });
+    suite.run("transcode", "rows to tiles, operator()", pixel, [&] {
+        for (size_type y = 0; y < img.height(); ++y) {
+            for (size_type x = 0; x < img.width(); ++x) {
+                tiles(x, y) = img(x, y);
+            }
+        }
+        g_sink = first_channel(tiles(0, 0));
+        return bytes;
+    });
+    suite.run("transcode", "rows to tiles", pixel, [&] {
+        blit(tiles, img);
+        g_sink = first_channel(tiles(0, 0));
+        return bytes;
+    });
+    suite.run("transcode", "rows to tiles (parallel)", pixel, [&] {
+        blit(par, tiles, img);
+        g_sink = first_channel(tiles(0, 0));
+        return bytes;
+    });
+    suite.run("transcode", "tiles to rows", pixel, [&] {
+        blit(rows, sfc);
+        g_sink = first_channel(rows(0, 0));
+        return bytes;
+    });
+    suite.run("transcode", "tiles to rows (parallel)", pixel, [&] {
+        blit(par, rows, sfc);
+        g_sink = first_channel(rows(0, 0));
+        return bytes;
+    });
+}
+
+// Gaussian blurs by each method, and a 3x3 sharpening kernel, at sigmas where the methods differ in cost.
+template <typename ImageType>
+void run_filter(Suite& suite, std::string_view layout, std::string_view pixel, const ImageType& img)
+{
+    const auto     par = std::execution::par;
+    ImageType      out(img.width(), img.height());
+    const Kernel2D sharpen(3, { 0.0f, -1.0f, 0.0f, -1.0f, 5.0f, -1.0f, 0.0f, -1.0f, 0.0f });
+
+    const auto blur = [&](std::string_view method_name, BlurMethod method, float sigma) {
+        const std::string name = std::string(layout) + " gaussian sigma " + std::to_string(static_cast<int>(sigma)) +
+                                 ", " + std::string(method_name) + " (parallel)";
+        suite.run("filter", name, pixel, [&] {
+            gaussian_blur(par, out, img, sigma, method);
+            g_sink = first_channel(out(0, 0));
+            return std::size_t{ 0 };
+        });
+    };
+
+    blur("kernel", BlurMethod::kernel, 2.0f);
+    blur("box", BlurMethod::box, 2.0f);
+    blur("kernel", BlurMethod::kernel, 8.0f);
+    blur("box", BlurMethod::box, 8.0f);
+    blur("recursive", BlurMethod::recursive, 8.0f);
+    suite.run("filter", std::string(layout) + " 3x3 kernel (parallel)", pixel, [&] {
+        convolve(par, out, img, sharpen);
+        g_sink = first_channel(out(0, 0));
+        return std::size_t{ 0 };
+    });
+}
+
+template <typename ImageType>
+void run_sampling(Suite& suite, std::string_view layout, std::string_view pixel, const ImageType& img)
+{
+    const std::size_t count = std::size_t{ img.width() } * img.height();
+
+    suite.run("sampling", std::string(layout) + " bilinear, random", pixel, [&] {
+        Random random;
+        float  sum = 0.0f;
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::uint64_t r = random.next();
+            const float         s = static_cast<float>(r & 0xFFFFFFu) * 0x1p-24f;
+            const float         t = static_cast<float>((r >> 32u) & 0xFFFFFFu) * 0x1p-24f;
+            sum += first_channel(sample_bilinear(img, s, t));
+        }
+        g_sink = sum;
+        return std::size_t{ 0 };
+    });
+    suite.run("sampling", std::string(layout) + " bilinear, 2x magnification", pixel, [&] {
+        const std::uint32_t width  = img.width();
+        const std::uint32_t height = img.height();
+        float               sum    = 0.0f;
+        // A quarter of the image at twice the resolution: as many samples as pixels.
+        for (std::uint32_t y = 0; y < height; ++y) {
+            for (std::uint32_t x = 0; x < width; ++x) {
+                const float s = static_cast<float>(x) / (2 * width);
+                const float t = static_cast<float>(y) / (2 * height);
+                sum += first_channel(sample_bilinear(img, s, t));
+            }
+        }
+        g_sink = sum;
+        return std::size_t{ 0 };
+    });
+}
+
+// Round trips through an in-memory stream, so that we time the codecs rather than the disk.
+template <typename ImageType, typename Write, typename Read>
+void run_io(Suite& suite, std::string_view format, std::string_view pixel, const ImageType& img, Write write, Read read)
+{
+    std::stringstream stream;
+    write(stream, img);
+    const std::string contents = stream.str();
+
+    suite.run("io", "write " + std::string(format), pixel, [&] {
+        std::ostringstream outs;
+        write(outs, img);
+        return static_cast<std::size_t>(outs.tellp());
+    });
+    suite.run("io", "read " + std::string(format), pixel, [&] {
+        std::istringstream ins(contents);
+        const ImageType    result = read(ins);
+        g_sink                    = first_channel(result(0, 0));
+        return contents.size();
+    });
+}
+
+// Tile-sized scratch arrays, as many as it takes to cover the image: what Array2DSFC construction itself costs, without
+// and with an allocation hook installed.
+template <typename Pixel>
+void run_allocation(Suite& suite, std::string_view pixel)
+{
+    using Scratch = Array2DSFC<Pixel>;
+
+    const auto&       options = suite.options();
+    const std::size_t pixels  = std::size_t{ options.width } * options.height;
+    const std::size_t count   = std::max<std::size_t>(pixels / Scratch::tile_area, 1);
+
+    const auto construct = [&] {
+        for (std::size_t i = 0; i < count; ++i) {
+            const Scratch scratch(Scratch::tile_width, Scratch::tile_height);
+            g_sink = first_channel(scratch(0, 0));
+        }
+        return std::size_t{ 0 };
+    };
+    suite.run("allocation", "Array2DSFC tile-sized", pixel, construct);
+
+    static std::atomic<std::uint64_t> events{ 0 };
+    const ArrayAllocationHook         previous = set_allocation_hook(
+        [](const ArrayAllocationEvent&) noexcept { events.fetch_add(1, std::memory_order_relaxed); });
+    suite.run("allocation", "Array2DSFC tile-sized, hook installed", pixel, construct);
+    set_allocation_hook(previous);
+}
+
+// A full-size image of which one corner, 1/64 of the area, is written: the dense image pays for all of it, the sparse
+// one for the tiles that are touched.
+template <typename Pixel>
+void run_sparse(Suite& suite, std::string_view pixel)
+{
+    const auto&         options = suite.options();
+    const std::uint32_t w       = std::max<std::uint32_t>(options.width / 8, 1);
+    const std::uint32_t h       = std::max<std::uint32_t>(options.height / 8, 1);
+
+    suite.run("sparse", "Array2DSFC construct, write 1/64", pixel, [&] {
+        Array2DSFC<Pixel> img(std::execution::par, options.width, options.height, Pixel{});
+        for (std::uint32_t y = 0; y < h; ++y) {
+            for (std::uint32_t x = 0; x < w; ++x) {
+                img(x, y) = Pixel{};
+            }
+        }
+        g_sink = first_channel(img(0, 0));
+        return std::size_t{ 0 };
+    });
+    suite.run("sparse", "SparseArray2DSFC construct, write 1/64", pixel, [&] {
+        SparseArray2DSFC<Pixel> img(options.width, options.height);
+        for (std::uint32_t y = 0; y < h; ++y) {
+            for (std::uint32_t x = 0; x < w; ++x) {
+                img.writable(x, y) = Pixel{};
+            }
+        }
+        g_sink = first_channel(img(0, 0));
+        return std::size_t{ 0 };
+    });
+}
+
+// An undo snapshot followed by an edit of one tile: a deep copy of the whole image against a copy-on-write snapshot,
+// which duplicates only the edited tile.
+template <typename Pixel>
+void run_snapshot(Suite& suite, std::string_view pixel, const Array2DSFC<Pixel>& sfc)
+{
+    const CowArray2DSFC<Pixel> cow(std::execution::par, sfc);
+
+    suite.run("snapshot", "Array2DSFC copy, edit one tile", pixel, [&] {
+        Array2DSFC<Pixel> copy(std::execution::par, sfc);
+        copy(0, 0) = Pixel{};
+        g_sink = first_channel(copy(0, 0));
+        return std::size_t{ 0 };
+    });
+    suite.run("snapshot", "CowArray2DSFC snapshot, edit one tile", pixel, [&] {
+        CowArray2DSFC<Pixel> copy = cow.snapshot();
+        copy.set(0, 0, Pixel{});
+        g_sink = first_channel(copy(0, 0));
+        return std::size_t{ 0 };
+    });
+}
+
+template <typename Pixel>
+void run_pixel_type(Suite& suite, std::string_view pixel)
+{
+    using Image    = Array2D<Pixel>;
+    using ImageSFC = Array2DSFC<Pixel>;
+
+    constexpr bool is_float = is_floating_point_channel_v<channel_type_t<Pixel>>;
+
+    const auto&    options = suite.options();
+    const auto     par     = std::execution::par;
+    const auto     source  = make_image<Array2D<RGBAf>>(options.width, options.height, unit_pixel);
+    const Image    img     = convert_image<Image>(par, source);
+    const ImageSFC sfc     = convert_image<ImageSFC>(par, source);
+
+    if constexpr (is_float) {
+        run_io(
+            suite, "pfm", pixel, img,
+            [](std::ostream& outs, const Image& i) { write_pfm(outs, i); },
+            [](std::istream& ins) { return read_pfm<Image>(ins); });
+        run_io(
+            suite, "pfm (Array2DSFC)", pixel, sfc,
+            [](std::ostream& outs, const ImageSFC& i) { write_pfm(outs, i); },
+            [](std::istream& ins) { return read_pfm<ImageSFC>(ins); });
+    } else {
+        run_io(
+            suite, "ppm 8-bit", pixel, img,
+            [](std::ostream& outs, const Image& i) { write_ppm_8(outs, i); },
+            [](std::istream& ins) { return read_ppm_8<Image>(std::execution::par, ins); });
+        run_io(
+            suite, "ppm 8-bit (Array2DSFC)", pixel, sfc,
+            [](std::ostream& outs, const ImageSFC& i) { write_ppm_8(outs, i); },
+            [](std::istream& ins) { return read_ppm_8<ImageSFC>(std::execution::par, ins); });
+        run_io(
+            suite, "ppm 16-bit", pixel, img,
+            [](std::ostream& outs, const Image& i) { write_ppm_16(outs, i); },
+            [](std::istream& ins) { return read_ppm_16<Image>(std::execution::par, ins); });
+        if constexpr (channel_count_v<Pixel> == 3) {
+            run_io(
+                suite, "plain ppm", pixel, img,
+                [](std::ostream& outs, const Image& i) { write_plain_ppm(std::execution::par, outs, i); },
+                [](std::istream& ins) { return read_plain_ppm<Image>(std::execution::par, ins); });
+        }
+        run_io(
+            suite, "pam 8-bit", pixel, img,
+            [](std::ostream& outs, const Image& i) { write_pam_8(outs, i); },
+            [](std::istream& ins) { return read_pnm<Image>(std::execution::par, ins); });
+    }
+    run_io(
+        suite, "tile file", pixel, sfc,
+        [](std::ostream& outs, const ImageSFC& i) { write_tile_file(std::execution::par, outs, i); },
+        [](std::istream& ins) { return read_tile_file<ImageSFC>(std::execution::par, ins); });
+
+    run_access(suite, "Array2D", pixel, img);
+    run_access(suite, "Array2DSFC", pixel, sfc);
+    run_wide_access<Pixel>(suite, pixel, source);
+    run_allocation<Pixel>(suite, pixel);
+    run_sparse<Pixel>(suite, pixel);
+    run_snapshot<Pixel>(suite, pixel, sfc);
+    run_crop(suite, "Array2D", pixel, img);
+    run_crop(suite, "Array2DSFC", pixel, sfc);
+    run_transcode(suite, pixel, img, sfc);
+    run_filter(suite, "Array2D", pixel, img);
+    run_filter(suite, "Array2DSFC", pixel, sfc);
+
+    // sample_bilinear needs floating-point arithmetic on pixels.
+    if constexpr (is_float) {
+        run_sampling(suite, "Array2D", pixel, img);
+        run_sampling(suite, "Array2DSFC", pixel, sfc);
+    } else {
+        run_sampling(suite, "Array2D", "rgbf", convert_image<Image_RGBf>(par, img));
+        run_sampling(suite, "Array2DSFC", "rgbf", convert_image<ImageSFC_RGBf>(par, sfc));
+    }
+
+    const ConversionOptions to_srgb{ .transfer = TransferFunction::linear_to_srgb };
+    const ConversionOptions to_linear{ .transfer = TransferFunction::srgb_to_linear };
+    const auto              ldr = convert_image<Image_RGBA8>(par, img, to_srgb);
+
+    suite.run("conversion", "linear to sRGB RGBA8", pixel, [&] {
+        g_sink = first_channel(convert_image<Image_RGBA8>(std::execution::seq, img, to_srgb)(0, 0));
+        return std::size_t{ 0 };
+    });
+    suite.run("conversion", "linear to sRGB RGBA8 (parallel)", pixel, [&] {
+        g_sink = first_channel(convert_image<Image_RGBA8>(par, img, to_srgb)(0, 0));
+        return std::size_t{ 0 };
+    });
+    suite.run("conversion", "linear to sRGB RGBA8, dithered (parallel)", pixel, [&] {
+        const ConversionOptions dithered{ .transfer = TransferFunction::linear_to_srgb, .dither = Dither::ordered };
+        g_sink = first_channel(convert_image<Image_RGBA8>(par, img, dithered)(0, 0));
+        return std::size_t{ 0 };
+    });
+    suite.run("conversion", "sRGB RGBA8 to linear", pixel, [&] {
+        g_sink = first_channel(convert_image<Image>(std::execution::seq, ldr, to_linear)(0, 0));
+        return std::size_t{ 0 };
+    });
+    suite.run("conversion", "sRGB RGBA8 to linear (parallel)", pixel, [&] {
+        g_sink = first_channel(convert_image<Image>(par, ldr, to_linear)(0, 0));
+        return std::size_t{ 0 };
+    });
+}
+
+void run_compression(Suite& suite)
+{
+    const auto& options = suite.options();
+
+    // The images are only made if a compression benchmark is selected.
+    std::optional<Array2DSFC<RGBA8>> ldr;
+    std::optional<Array2DSFC<RGBf>>  hdr;
+
+    auto run = [&](std::string_view name, std::string_view pixel, auto encode) {
+        if (!suite.selected("compression", name)) {
+            return;
+        }
+        if (!ldr) {
+            ldr = make_image<Array2DSFC<RGBA8>>(options.width, options.height, ldr_pixel);
+            hdr = make_image<Array2DSFC<RGBf>>(options.width, options.height, hdr_pixel);
+        }
+        suite.run("compression", name, pixel, [&] { return encode().data.size(); });
+    };
+
+    const auto par = std::execution::par;
+    const auto seq = std::execution::seq;
+    run("BC1 fast", "rgba8", [&] { return encode_bc1(seq, *ldr, BCMode::fast); });
+    run("BC1 fast (parallel)", "rgba8", [&] { return encode_bc1(par, *ldr, BCMode::fast); });
+    run("BC1 quality (parallel)", "rgba8", [&] { return encode_bc1(par, *ldr, BCMode::quality); });
+    run("BC3 fast (parallel)", "rgba8", [&] { return encode_bc3(par, *ldr, BCMode::fast); });
+    run("BC3 quality (parallel)", "rgba8", [&] { return encode_bc3(par, *ldr, BCMode::quality); });
+    run("BC6H fast", "rgbf", [&] { return encode_bc6h(seq, *hdr, BCMode::fast); });
+    run("BC6H fast (parallel)", "rgbf", [&] { return encode_bc6h(par, *hdr, BCMode::fast); });
+    run("BC6H quality (parallel)", "rgbf", [&] { return encode_bc6h(par, *hdr, BCMode::quality); });
+}
+
+// Scales every pixel with a node-local tile pass, and reports the share of tiles whose memory is on another node
+// than the thread that processed them.
+void run_numa(Suite& suite, std::string_view name, NumaPlacement placement)
+{
+    if (!suite.selected("numa", name)) {
+        return;
+    }
+
+    using ImageType = Array2DSFC<float, 4, NumaAllocator<float>>;
+
+    const auto& options = suite.options();
+    ImageType   img(std::execution::par, options.width, options.height, 1.0f, NumaAllocator<float>(placement));
+
+    suite.run("numa", name, "grayf", [&] {
+        numa_for_each_tile(img, [&](std::uint32_t tile_index) {
+            float* const tile = img.data() + std::size_t{ tile_index } * ImageType::tile_area;
+            for (std::uint32_t j = 0; j < ImageType::tile_area; ++j) {
+                tile[j] *= 1.0001f;
+            }
+        });
+        return std::size_t{ 0 };
+    });
+
+    std::atomic<std::uint64_t> remote{ 0 };
+    numa_for_each_tile(img, [&](std::uint32_t tile_index) {
+        const float* const tile = img.data() + std::size_t{ tile_index } * ImageType::tile_area;
+        if (numa_node_of_address(tile) != static_cast<int>(numa_current_node())) {
+            remote.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    const double tiles = static_cast<double>(img.num_tiles_width()) * img.num_tiles_height();
+    suite.set_remote_percent(100.0 * static_cast<double>(remote.load()) / tiles);
+}
+
+template <typename T>
+bool parse_argument(std::string_view text, T& value)
+{
+    const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc() && end == text.data() + text.size() && value > 0;
+}
+
+void usage()
+{
+    std::println(std::cerr,
+                 "Usage: ImageLibraryBenchmark [--width N] [--height N] [--pixel TYPE] [--iterations N] "
+                 "[--filter TEXT] [--format text|json|csv] [--output FILE] [--trace FILE] [--verbose]");
+    std::println(std::cerr, "TYPE: rgb8, rgb16, rgbh, rgbf, rgba8, rgba16, rgbah, rgbaf");
+}
+
+bool parse_options(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--verbose") {
+            options.verbose = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const std::string_view value = argv[++i];
+        if (arg == "--width") {
+            if (!parse_argument(value, options.width)) {
+                return false;
+            }
+        } else if (arg == "--height") {
+            if (!parse_argument(value, options.height)) {
+                return false;
+            }
+        } else if (arg == "--iterations") {
+            if (!parse_argument(value, options.iterations)) {
+                return false;
+            }
+        } else if (arg == "--pixel") {
+            options.pixel = value;
+        } else if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--output") {
+            options.output = value;
+        } else if (arg == "--trace") {
+            options.trace = value;
+        } else if (arg == "--format") {
+            if (value == "text") {
+                options.format = OutputFormat::text;
+            } else if (value == "json") {
+                options.format = OutputFormat::json;
+            } else if (value == "csv") {
+                options.format = OutputFormat::csv;
+            } else {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool run_pixel_type(Suite& suite)
+{
+    const std::string& pixel = suite.options().pixel;
+    if (pixel == "rgb8") {
+        run_pixel_type<RGB8>(suite, pixel);
+    } else if (pixel == "rgb16") {
+        run_pixel_type<RGB16>(suite, pixel);
+    } else if (pixel == "rgbh") {
+        run_pixel_type<RGBh>(suite, pixel);
+    } else if (pixel == "rgbf") {
+        run_pixel_type<RGBf>(suite, pixel);
+    } else if (pixel == "rgba8") {
+        run_pixel_type<RGBA8>(suite, pixel);
+    } else if (pixel == "rgba16") {
+        run_pixel_type<RGBA16>(suite, pixel);
+    } else if (pixel == "rgbah") {
+        run_pixel_type<RGBAh>(suite, pixel);
+    } else if (pixel == "rgbaf") {
+        run_pixel_type<RGBAf>(suite, pixel);
+    } else {
+        return false;
+    }
+    return true;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        usage();
+        return 1;
+    }
+
+    Suite suite(options);
+    if (!run_pixel_type(suite)) {
+        usage();
+        return 1;
+    }
+    run_index_variants(suite);
+    run_compression(suite);
+    run_numa(suite, "first touch", NumaPlacement::first_touch);
+    run_numa(suite, "interleave", NumaPlacement::interleave);
+    run_numa(suite, "block", NumaPlacement::block);
+
+    if (options.output.empty()) {
+        suite.report(std::cout);
+    } else {
+        std::ofstream outs(options.output);
+        if (!outs) {
+            std::println(std::cerr, "Unable to open {}", options.output.string());
+            return 1;
+        }
+        suite.report(outs);
+    }
+
+    if (!options.trace.empty()) {
+        std::ofstream outs(options.trace);
+        if (!outs) {
+            std::println(std::cerr, "Unable to open {}", options.trace.string());
+            return 1;
+        }
+        instrumentation::write_chrome_trace(outs);
+        instrumentation::write_summary(std::cerr);
+    }
+}
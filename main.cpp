@@ -1,5 +1,6 @@
 
 #include "Array2D.h"
+#include "Filter.h"
 #include "Image.h"
 
 #include <cmath>
@@ -225,45 +226,6 @@ struct SamplerBilinear
     }
 };
 
-class SamplerGauss
-{
-public:
-    SamplerGauss(int n_samples, float extents)
-    : m_num_samples(n_samples)
-    , m_extents(extents)
-    , m_rng()
-    , m_dist(0.0f, 3.0f*extents)
-    {
-    }
-
-    RGB operator()(const Image& img, float s, float t)
-    {
-        RGB ret;
-        for (int i = 0; i < m_num_samples; ++i) {
-            const float x = gen_sample(s);
-            const float y = gen_sample(t);
-            ret += sample_bilinear(img, x, y);
-        }
-        return ret / m_num_samples;
-    }
-
-private:
-    float gen_sample(float f)
-    {
-        float s;
-        do {
-            //s = f + std::clamp(m_dist(m_rng), -m_extents, m_extents);
-            s = f + m_dist(m_rng);
-        } while (s < 0.0f || s >= 1.0f);
-        return s;
-    }
-
-    int m_num_samples;
-    float m_extents;
-    std::mt19937 m_rng;
-    std::normal_distribution<float> m_dist;
-};
-
 class SamplerTriangle
 {
 public:
@@ -388,14 +350,9 @@ int main()
     //SamplerBilinear sampler_bilinear;
     //write("binliear.pfm", reconstruct_image(sampler_bilinear, img));
 
-    //SamplerGauss sampler_gauss1(1, 0.001f);
-    //write("gauss1.pfm", reconstruct_image(sampler_gauss1, img));
-
-    //SamplerGauss sampler_gauss2(2, 0.001f);
-    //write("gauss2.pfm", reconstruct_image(sampler_gauss2, img));
-
-    //SamplerGauss sampler_gauss3(3, 0.001f);
-    //write("gauss3.pfm", reconstruct_image(sampler_gauss3, img));
+    Image_RGBf blurred(img_f.width(), img_f.height());
+    gaussian_blur(std::execution::par, blurred, img_f, 2.0f);
+    write_pfm("gauss.pfm", blurred);
 
 #if 0
     using size_type = Image::size_type;
@@ -0,0 +1,109 @@
+#include "Image.h"
+#include "TileFile.h"
+
+#include <cstdint>
+#include <execution>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+
+// Writes images and reads them back, and checks that every pixel comes back unchanged.
+
+namespace {
+int g_failures = 0;
+
+void check(bool condition, std::string_view what)
+{
+    if (!condition) {
+        std::cerr << "FAILED: " << what << '\n';
+        ++g_failures;
+    }
+}
+
+template <typename ImageType, typename Value>
+ImageType make_image(std::uint32_t width, std::uint32_t height, Value value)
+{
+    ImageType img(width, height);
+    for (std::uint32_t y = 0; y < height; ++y) {
+        for (std::uint32_t x = 0; x < width; ++x) {
+            img(x, y) = value(x, y);
+        }
+    }
+    return img;
+}
+
+template <typename A, typename B>
+bool same_pixels(const A& a, const B& b)
+{
+    if (a.width() != b.width() || a.height() != b.height()) {
+        return false;
+    }
+    for (std::uint32_t y = 0; y < a.height(); ++y) {
+        for (std::uint32_t x = 0; x < a.width(); ++x) {
+            const auto& p = a(x, y);
+            const auto& q = b(x, y);
+            for (std::uint32_t c = 0; c < channel_count_v<typename A::value_type>; ++c) {
+                if (pixel_channel(p, c) != pixel_channel(q, c)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Edge tiles are cut by the image, so their padding is exercised too.
+template <typename Pixel>
+void tile_file_round_trip(std::string_view what)
+{
+    using ImageType = Array2DSFC<Pixel>;
+    const auto img  = make_image<ImageType>(37, 21, [](std::uint32_t x, std::uint32_t y) {
+        return static_cast<Pixel>(static_cast<float>(x * 7 + y * 3));
+    });
+
+    std::stringstream stream;
+    write_tile_file(std::execution::seq, stream, img);
+    const auto result = read_tile_file<ImageType>(std::execution::seq, stream);
+    check(same_pixels(img, result), what);
+}
+template <typename ImageType, typename Write>
+void pnm_round_trip(const ImageType& img, Write write, std::string_view what)
+{
+    std::stringstream stream;
+    write(stream, img);
+    const auto result = read_pnm<ImageType>(stream);
+    check(same_pixels(img, result), what);
+}
+} // namespace
+
+int main()
+{
+    // Every sample value of gray and alpha, and the dark end of RGB, where the sRGB encoding keeps values apart.
+    const auto gray8 = make_image<Image_Gray8>(256, 3, [](std::uint32_t x, std::uint32_t y) {
+        return static_cast<std::uint8_t>(x ^ y);
+    });
+    const auto gray16 = make_image<Image_Gray16>(256, 3, [](std::uint32_t x, std::uint32_t y) {
+        return static_cast<std::uint16_t>(x * 257 + y);
+    });
+    const auto rgba8 = make_image<Image_RGBA8>(256, 2, [](std::uint32_t x, std::uint32_t y) {
+        const auto dark = static_cast<std::uint8_t>((x + y) % 16);
+        return RGBA8(dark, static_cast<std::uint8_t>(dark + 1), static_cast<std::uint8_t>(dark + 2),
+                     static_cast<std::uint8_t>(x));
+    });
+    pnm_round_trip(gray8, [](std::ostream& outs, const auto& img) { write_pgm_8(outs, img); }, "PGM Gray8");
+    pnm_round_trip(gray16, [](std::ostream& outs, const auto& img) { write_pgm_16(outs, img); }, "PGM Gray16");
+    pnm_round_trip(gray8, [](std::ostream& outs, const auto& img) { write_pam_8(outs, img); }, "PAM Gray8");
+    pnm_round_trip(rgba8, [](std::ostream& outs, const auto& img) { write_pam_8(outs, img); }, "PAM RGBA8");
+
+    tile_file_round_trip<std::uint8_t>("tile file Gray8");
+    tile_file_round_trip<std::uint16_t>("tile file Gray16");
+    tile_file_round_trip<half>("tile file Grayh");
+    tile_file_round_trip<float>("tile file Grayf");
+
+    if (g_failures > 0) {
+        std::cerr << g_failures << " failed\n";
+        return 1;
+    }
+    std::cout << "All round trips passed\n";
+    return 0;
+}